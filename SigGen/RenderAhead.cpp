@@ -0,0 +1,239 @@
+//
+//  RenderAhead.cpp
+//  SigGen
+//
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include "RenderAhead.h"
+#include "rt_audit.hpp"
+
+class RenderAhead : public Neato::IRenderAhead
+{
+public:
+    RenderAhead(std::shared_ptr<Neato::IRenderCallback> render_callback, std::shared_ptr<Neato::IRenderParamsValidatedCallback> params_callback, uint32_t lookahead_frames, uint32_t block_frames, const Neato::realtime_thread_config_t& synthesis_thread)
+        : _renderImpl(render_callback)
+        , _params_callback(params_callback)
+        , _lookahead_frames(lookahead_frames)
+        , _block_frames(block_frames)
+        , _thread_config(synthesis_thread)
+        , _capacity_frames(0)
+        , _plane_count(1)
+        , _plane_frame_bytes(0)
+        , _write_frames(0)
+        , _read_frames(0)
+        , _consumer_signal(0)
+        , _stop_requested(false)
+        , _failed(false)
+        , _callbacks(0)
+        , _frames_requested(0)
+        , _underruns(0)
+        , _frames_short(0)
+        , _min_fill_frames(UINT32_MAX)
+        , _ok_return(Neato::CreateRenderReturn())
+    {
+    }
+
+    virtual ~RenderAhead()
+    {
+        _stop_requested = true;
+        _consumer_signal.fetch_add(1);
+        _consumer_signal.notify_one();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+    }
+
+    virtual void RenderParamsValidated(const Neato::audio_stream_description_t& creation_params)
+    {
+        if (_thread.joinable())
+        {
+            throw std::runtime_error("Render ahead stage is already running");
+        }
+        if (0 == _block_frames)
+        {
+            _block_frames = (creation_params.frames_per_packet > 0) ? creation_params.frames_per_packet : 512;
+        }
+        // whole blocks only, so the synthesis thread always renders into one contiguous piece of the ring
+        const uint32_t block_count = std::max<uint32_t>((_lookahead_frames + _block_frames - 1) / _block_frames, 2);
+        _capacity_frames = block_count * _block_frames;
+        // a planar block has each channel's frames back to back, so any run of frames out of the ring is a
+        // piece of every plane. one ring per plane, and the blocks are rendered to the side and split up
+        const bool planar = (0 != (creation_params.flags & Neato::format_flag_non_interleaved)) && (creation_params.channels_per_frame > 1);
+        if (planar && (creation_params.bits_per_channel == 0 || creation_params.bits_per_channel % 8 != 0))
+        {
+            throw std::runtime_error("Render ahead needs whole bytes per sample for a planar stream");
+        }
+        _plane_count = planar ? creation_params.channels_per_frame : 1;
+        _plane_frame_bytes = planar ? creation_params.bits_per_channel / 8 : creation_params.bytes_per_frame;
+        _ring.assign(static_cast<std::size_t>(_capacity_frames) * _plane_frame_bytes * _plane_count, 0);
+        _planar_block.assign(planar ? static_cast<std::size_t>(_block_frames) * _plane_frame_bytes * _plane_count : 0, 0);
+
+        // the real callback sees the block size it will actually be called with
+        Neato::audio_stream_description_t render_params = creation_params;
+        render_params.frames_per_packet = _block_frames;
+        render_params.bytes_per_packet = _block_frames * creation_params.bytes_per_frame;
+        _params_callback->RenderParamsValidated(render_params);
+
+        std::promise<void> configured;
+        std::future<void> configured_future = configured.get_future();
+        _thread = std::thread([this, &configured]()
+        {
+            _thread_report = Neato::MakeThreadRealtime(_thread_config);
+            configured.set_value();
+            Synthesize();
+        });
+        configured_future.wait();
+    }
+
+    // device thread: copies out of the ring and never waits on the synthesis thread
+    virtual std::shared_ptr<Neato::IRenderReturn> Render(const Neato::render_params_t& params)
+    {
+        // the device side has to stay wait free, the synthesis thread is the one allowed to be slow
+        Neato::rt_scope_t realtime;
+        if (_failed.load(std::memory_order_acquire))
+        {
+            return _render_error;
+        }
+        const uint64_t read_frames = _read_frames.load(std::memory_order_relaxed);
+        const uint64_t fill = _write_frames.load(std::memory_order_acquire) - read_frames;
+        const uint32_t available = static_cast<uint32_t>(std::min<uint64_t>(fill, params.frame_count));
+
+        for (uint32_t plane = 0; plane < _plane_count; plane++)
+        {
+            uint8_t* plane_buffer = params.frame_buffer + static_cast<std::size_t>(plane) * params.frame_count * _plane_frame_bytes;
+            uint32_t copied = 0;
+            while (copied < available)
+            {
+                const uint32_t ring_frame = static_cast<uint32_t>((read_frames + copied) % _capacity_frames);
+                const uint32_t count = std::min(available - copied, _capacity_frames - ring_frame);
+                std::memcpy(plane_buffer + static_cast<std::size_t>(copied) * _plane_frame_bytes, RingFrame(plane, ring_frame), static_cast<std::size_t>(count) * _plane_frame_bytes);
+                copied += count;
+            }
+            if (available < params.frame_count)
+            {
+                std::memset(plane_buffer + static_cast<std::size_t>(available) * _plane_frame_bytes, 0, static_cast<std::size_t>(params.frame_count - available) * _plane_frame_bytes);
+            }
+        }
+        if (available < params.frame_count)
+        {
+            _underruns.fetch_add(1, std::memory_order_relaxed);
+            _frames_short.fetch_add(params.frame_count - available, std::memory_order_relaxed);
+        }
+        _read_frames.store(read_frames + available, std::memory_order_release);
+        _consumer_signal.fetch_add(1, std::memory_order_release);
+        _consumer_signal.notify_one();
+
+        _callbacks.fetch_add(1, std::memory_order_relaxed);
+        _frames_requested.fetch_add(params.frame_count, std::memory_order_relaxed);
+        if (fill < _min_fill_frames.load(std::memory_order_relaxed))
+        {
+            _min_fill_frames.store(static_cast<uint32_t>(fill), std::memory_order_relaxed);
+        }
+        return _ok_return;
+    }
+
+    virtual Neato::render_ahead_stats_t GetStats() const
+    {
+        Neato::render_ahead_stats_t stats;
+        stats.callbacks = _callbacks.load(std::memory_order_relaxed);
+        stats.frames_requested = _frames_requested.load(std::memory_order_relaxed);
+        stats.underruns = _underruns.load(std::memory_order_relaxed);
+        stats.frames_short = _frames_short.load(std::memory_order_relaxed);
+        stats.capacity_frames = _capacity_frames;
+        stats.fill_frames = static_cast<uint32_t>(_write_frames.load(std::memory_order_acquire) - _read_frames.load(std::memory_order_acquire));
+        const uint32_t min_fill = _min_fill_frames.load(std::memory_order_relaxed);
+        stats.min_fill_frames = (min_fill == UINT32_MAX) ? stats.fill_frames : min_fill;
+        return stats;
+    }
+
+    virtual Neato::realtime_thread_report_t SynthesisThreadReport() const
+    {
+        return _thread_report;
+    }
+
+private:
+    uint8_t* RingFrame(uint32_t plane, uint32_t ring_frame)
+    {
+        return &_ring[(static_cast<std::size_t>(plane) * _capacity_frames + ring_frame) * _plane_frame_bytes];
+    }
+
+    // synthesis thread: renders a block whenever one fits, sleeps on the consumer otherwise
+    void Synthesize()
+    {
+        while (!_stop_requested)
+        {
+            const uint32_t signal = _consumer_signal.load(std::memory_order_acquire);
+            const uint64_t write_frames = _write_frames.load(std::memory_order_relaxed);
+            if (_capacity_frames - (write_frames - _read_frames.load(std::memory_order_acquire)) < _block_frames)
+            {
+                _consumer_signal.wait(signal, std::memory_order_acquire);
+                continue;
+            }
+            const uint32_t ring_frame = static_cast<uint32_t>(write_frames % _capacity_frames);
+            Neato::render_params_t params;
+            params.frame_count = _block_frames;
+            params.frame_buffer = _planar_block.empty() ? RingFrame(0, ring_frame) : _planar_block.data();
+            std::shared_ptr<Neato::IRenderReturn> ret = _renderImpl->Render(params);
+            if (ret && !ret->DidSucceed())
+            {
+                _render_error = ret;
+                _failed.store(true, std::memory_order_release);
+                return;
+            }
+            if (!_planar_block.empty())
+            {
+                const std::size_t plane_bytes = static_cast<std::size_t>(_block_frames) * _plane_frame_bytes;
+                for (uint32_t plane = 0; plane < _plane_count; plane++)
+                {
+                    std::memcpy(RingFrame(plane, ring_frame), _planar_block.data() + plane * plane_bytes, plane_bytes);
+                }
+            }
+            _write_frames.store(write_frames + _block_frames, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<Neato::IRenderCallback> _renderImpl;
+    std::shared_ptr<Neato::IRenderParamsValidatedCallback> _params_callback;
+    const uint32_t _lookahead_frames;
+    uint32_t _block_frames;
+    const Neato::realtime_thread_config_t _thread_config;
+    Neato::realtime_thread_report_t _thread_report;
+    uint32_t _capacity_frames;
+    // a planar stream has a plane per channel, each a ring of _capacity_frames samples. an interleaved one
+    // is a single plane of whole frames
+    uint32_t _plane_count;
+    uint32_t _plane_frame_bytes;
+    std::vector<uint8_t> _ring;
+    // where the synthesis thread renders a planar block before it's split across the planes
+    std::vector<uint8_t> _planar_block;
+
+    // frame counters only ever grow, the ring position is the counter modulo the capacity.
+    // each one is written by a single thread
+    alignas(64) std::atomic<uint64_t> _write_frames;
+    alignas(64) std::atomic<uint64_t> _read_frames;
+    std::atomic<uint32_t> _consumer_signal;
+    std::atomic<bool> _stop_requested;
+    std::atomic<bool> _failed;
+    std::thread _thread;
+
+    std::atomic<uint64_t> _callbacks;
+    std::atomic<uint64_t> _frames_requested;
+    std::atomic<uint64_t> _underruns;
+    std::atomic<uint64_t> _frames_short;
+    std::atomic<uint32_t> _min_fill_frames;
+
+    // handed back on every callback, so the device thread doesn't allocate a fresh one each time
+    std::shared_ptr<Neato::IRenderReturn> _ok_return;
+    std::shared_ptr<Neato::IRenderReturn> _render_error;
+};
+
+std::shared_ptr<Neato::IRenderAhead> Neato::CreateRenderAhead(std::shared_ptr<IRenderCallback> render_callback, std::shared_ptr<IRenderParamsValidatedCallback> params_callback, uint32_t lookahead_frames, uint32_t block_frames, const realtime_thread_config_t& synthesis_thread)
+{
+    return std::make_shared<RenderAhead>(render_callback, params_callback, lookahead_frames, block_frames, synthesis_thread);
+}
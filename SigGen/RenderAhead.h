@@ -0,0 +1,43 @@
+//
+//  RenderAhead.h
+//  SigGen
+//
+
+#pragma once
+
+#include "RenderGraph.h"
+#include "realtime_thread.hpp"
+
+namespace Neato
+{
+    struct render_ahead_stats_t
+    {
+        uint64_t callbacks = 0;
+        uint64_t frames_requested = 0;
+        // callbacks that found less in the ring than the device asked for, and the silence handed out instead
+        uint64_t underruns = 0;
+        uint64_t frames_short = 0;
+        uint32_t capacity_frames = 0;
+        uint32_t fill_frames = 0;
+        // lowest fill any callback has seen on arrival, how close the synthesis thread came to falling behind
+        uint32_t min_fill_frames = 0;
+    };
+
+    // Sits between a render graph and the real callback. A synthesis thread keeps a single producer /
+    // single consumer ring of rendered frames topped up to lookahead_frames, calling the real callback
+    // with a fixed block_frames (0 means the negotiated frames_per_packet). The device thread only copies
+    // out of the ring, whatever frame count it asks for, and gets silence and an underrun if it's empty.
+    // A planar (format_flag_non_interleaved) stream gets a ring per channel, so the device's buffer comes
+    // out planar for its own frame count.
+    //
+    // Hand it to CreateRenderGraph() as the params callback and to Start() as the render callback.
+    struct IRenderAhead : public IRenderCallback, public IRenderParamsValidatedCallback
+    {
+        virtual render_ahead_stats_t GetStats() const = 0;
+        // what MakeThreadRealtime() managed on the synthesis thread, filled in once the params are validated
+        virtual realtime_thread_report_t SynthesisThreadReport() const = 0;
+    };
+
+    // synthesis_thread is applied to the synthesis thread before it renders anything
+    std::shared_ptr<IRenderAhead> CreateRenderAhead(std::shared_ptr<IRenderCallback> render_callback, std::shared_ptr<IRenderParamsValidatedCallback> params_callback, uint32_t lookahead_frames, uint32_t block_frames = 0, const realtime_thread_config_t& synthesis_thread = realtime_thread_config_t());
+};
@@ -9,6 +9,7 @@
 #include <string>
 #include <memory>
 #include <stdint.h>
+#include "deadline_stats.hpp"
 
 typedef std::string utf8_string;
 
@@ -18,6 +19,9 @@ typedef std::string utf8_string;
 #if defined(_WIN32) || defined(_WIN64)
 #include "RenderGraph_Win.h"
 #endif //_WIN32 || _WIN64
+#if defined(__linux__)
+#include "RenderGraph_Linux.h"
+#endif //__linux__
 
 namespace Neato
 {
@@ -71,6 +75,8 @@ namespace Neato
     {
         virtual std::shared_ptr<IRenderReturn> Start(std::shared_ptr<IRenderCallback> render_callback) = 0;
         virtual std::shared_ptr<IRenderReturn> Stop() = 0;
+        // how long each Render call took against the buffer it filled. safe to call from any thread while playing
+        virtual deadline_stats_t GetDeadlineStats() const = 0;
     };
 
     struct IRenderParamsValidatedCallback
@@ -0,0 +1,343 @@
+//
+//  RenderGraph_Linux.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include "RenderGraph_Null.h"
+#include "rt_audit.hpp"
+#include "wav_file.h"
+
+class LinuxRenderConstants : public Neato::PlatformRenderConstantsDictionary
+{
+public:
+    // there is no platform format enum to translate into, the neutral values are used as-is
+    virtual uint32_t Format(uint32_t format) const
+    {
+        return format;
+    }
+    virtual uint32_t Flag(uint32_t flag) const
+    {
+        return flag;
+    }
+};
+
+class LinuxRenderReturn : public Neato::IRenderReturn
+{
+public:
+    LinuxRenderReturn()
+    {
+        SetCodeAndDescription(0);
+    }
+    explicit LinuxRenderReturn(int code)
+    {
+        SetCodeAndDescription(code);
+    }
+    explicit LinuxRenderReturn(int code, utf8_string desc)
+    {
+        SetCodeAndDescription(code, desc);
+    }
+    virtual Neato::OS_RETURN GetErrorCode() const
+    {
+        return _code;
+    }
+    virtual utf8_string GetErrorString() const
+    {
+        return _description;
+    }
+    virtual bool DidSucceed() const
+    {
+        return (_code == 0);
+    }
+    void SetDescription(utf8_string description)
+    {
+        _description = description;
+    }
+    void SetCode(int error)
+    {
+        _code = error;
+    }
+    void SetCodeAndDescription(int error)
+    {
+        _code = error;
+        _description = _code_to_decription(error);
+    }
+    void SetCodeAndDescription(int error, utf8_string desc)
+    {
+        _code = error;
+        _description = desc;
+    }
+private:
+    utf8_string _code_to_decription(int code)
+    {
+        utf8_string desc("");
+        if (code != 0)
+        {
+            desc = std::strerror(code);
+        }
+        return desc;
+    }
+private:
+    utf8_string _description;
+    int _code;
+};
+
+std::shared_ptr<Neato::IRenderReturn> Neato::CreateRenderReturn()
+{
+    return std::make_shared<LinuxRenderReturn>();
+}
+std::shared_ptr<Neato::IRenderReturn> Neato::CreateRenderReturn(OS_RETURN status, const utf8_string& desc)
+{
+    return std::make_shared<LinuxRenderReturn>(status, desc);
+}
+
+std::shared_ptr<Neato::PlatformRenderConstantsDictionary> Neato::CreateRenderConstantsDictionary()
+{
+    return std::make_shared<LinuxRenderConstants>();
+}
+
+namespace
+{
+    uint64_t MonotonicNanoseconds()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+    }
+
+    void SleepUntil(uint64_t deadline_ns)
+    {
+        timespec deadline;
+        deadline.tv_sec = static_cast<time_t>(deadline_ns / 1000000000ull);
+        deadline.tv_nsec = static_cast<long>(deadline_ns % 1000000000ull);
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr))
+        {
+        }
+    }
+
+    void StoreMax(std::atomic<uint64_t>& max_value, uint64_t value)
+    {
+        uint64_t current = max_value.load(std::memory_order_relaxed);
+        while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    Neato::audio_stream_description_t ValidateNullStreamDescription(const Neato::audio_stream_description_t& requested)
+    {
+        Neato::audio_stream_description_t validated = requested;
+        if (validated.frames_per_packet == 0)
+        {
+            validated.frames_per_packet = static_cast<uint32_t>(std::lround(validated.sample_rate * 0.01));
+        }
+        // there's nothing to negotiate with, anything the output stage can write is fine
+        return Neato::ValidateWavStreamDescription(validated);
+    }
+}
+
+class NullRenderGraph : public Neato::INullRenderGraph
+{
+public:
+    NullRenderGraph(const Neato::audio_stream_description_t& params, std::shared_ptr<Neato::IRenderParamsValidatedCallback> callback, const Neato::null_device_options_t& options)
+        : _generic_stream_desc(ValidateNullStreamDescription(params))
+        , _options(options)
+        , _buffer_frames(std::max<uint32_t>(2, _generic_stream_desc.frames_per_packet))
+        , _period_frames(_buffer_frames / 2)
+        , _buffer(static_cast<std::size_t>(_buffer_frames) * _generic_stream_desc.bytes_per_frame)
+        , _stop_requested(false)
+        , _render_error(Neato::CreateRenderReturn())
+        , _deadlines(_generic_stream_desc.sample_rate)
+    {
+        callback->RenderParamsValidated(_generic_stream_desc);
+    }
+
+    virtual ~NullRenderGraph()
+    {
+        Stop();
+    }
+
+    virtual std::shared_ptr<Neato::IRenderReturn> Start(std::shared_ptr<Neato::IRenderCallback> render_callback)
+    {
+        std::shared_ptr<Neato::IRenderReturn> error = Neato::CreateRenderReturn();
+        if (_thread.joinable())
+        {
+            error->SetCodeAndDescription(EBUSY, "Null device already started");
+            return error;
+        }
+        _renderImpl = render_callback;
+        _stop_requested = false;
+        // the thread sets itself up before the first render, and Start() doesn't return until it has
+        std::promise<void> configured;
+        std::future<void> configured_future = configured.get_future();
+        _thread = std::thread([this, &configured]()
+        {
+            _thread_report = Neato::MakeThreadRealtime(_options.render_thread);
+            configured.set_value();
+            Render();
+        });
+        configured_future.wait();
+        return error;
+    }
+
+    virtual std::shared_ptr<Neato::IRenderReturn> Stop()
+    {
+        _stop_requested = true;
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+        return _render_error;
+    }
+
+    virtual Neato::deadline_stats_t GetDeadlineStats() const
+    {
+        return _deadlines.Snapshot();
+    }
+
+    virtual Neato::null_device_stats_t GetStats() const
+    {
+        Neato::null_device_stats_t stats;
+        stats.wakeups = _wakeups.load(std::memory_order_relaxed);
+        stats.callbacks = _callbacks.load(std::memory_order_relaxed);
+        stats.frames_rendered = _frames_rendered.load(std::memory_order_relaxed);
+        stats.underruns = _underruns.load(std::memory_order_relaxed);
+        stats.frames_short = _frames_short.load(std::memory_order_relaxed);
+        stats.max_wakeup_late_ns = _max_wakeup_late_ns.load(std::memory_order_relaxed);
+        stats.checksum = _checksum.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    virtual Neato::realtime_thread_report_t RenderThreadReport() const
+    {
+        return _thread_report;
+    }
+
+private:
+    // the buffer is filled before the device starts, then it plays a frame every 1/sample_rate. each wakeup
+    // works out how much it has played, counts an underrun if that is more than was ever written, and tops it up
+    void Render()
+    {
+        const double ns_per_frame = 1e9 / _generic_stream_desc.sample_rate;
+        std::mt19937 random_engine(_options.seed);
+        std::uniform_real_distribution<double> jitter_dist(0.0, std::max(0.0, _options.jitter_seconds) * 1e9);
+        uint64_t checksum = 14695981039346656037ull;
+        uint64_t frames_written = 0;
+        if (!Fill(_buffer_frames, frames_written, checksum))
+        {
+            return;
+        }
+        const uint64_t start_ns = MonotonicNanoseconds();
+
+        for (uint64_t wakeup = 1; !_stop_requested; wakeup++)
+        {
+            // every wakeup is scheduled off the start, so lateness and jitter never add up into drift
+            const uint64_t scheduled_ns = start_ns + static_cast<uint64_t>(std::llround(wakeup * _period_frames * ns_per_frame));
+            SleepUntil(scheduled_ns + static_cast<uint64_t>(jitter_dist(random_engine)));
+            const uint64_t now_ns = MonotonicNanoseconds();
+            _wakeups.fetch_add(1, std::memory_order_relaxed);
+            StoreMax(_max_wakeup_late_ns, now_ns - std::min(now_ns, scheduled_ns));
+
+            const uint64_t frames_played = static_cast<uint64_t>((now_ns - start_ns) / ns_per_frame);
+            if (frames_played > frames_written)
+            {
+                // the device ran dry and played silence, it carries on from where it is now
+                _underruns.fetch_add(1, std::memory_order_relaxed);
+                _frames_short.fetch_add(frames_played - frames_written, std::memory_order_relaxed);
+                frames_written = frames_played;
+            }
+            if (!Fill(_buffer_frames - static_cast<uint32_t>(frames_written - frames_played), frames_written, checksum))
+            {
+                return;
+            }
+        }
+    }
+
+    // a fixed size device fills the room it has a period at a time, a padding driven one all in one go
+    bool Fill(uint32_t frames_available, uint64_t& frames_written, uint64_t& checksum)
+    {
+        const uint32_t chunk_frames = _options.variable_buffer_size ? frames_available : _period_frames;
+        while (chunk_frames > 0 && frames_available >= chunk_frames)
+        {
+            if (!RenderChunk(chunk_frames, checksum))
+            {
+                return false;
+            }
+            frames_written += chunk_frames;
+            frames_available -= chunk_frames;
+        }
+        return true;
+    }
+
+    bool RenderChunk(uint32_t frame_count, uint64_t& checksum)
+    {
+        Neato::render_params_t params;
+        params.frame_count = frame_count;
+        params.frame_buffer = _buffer.data();
+        std::shared_ptr<Neato::IRenderReturn> ret;
+        {
+            Neato::rt_scope_t realtime;
+            Neato::callback_timer_t timer(_deadlines, frame_count);
+            ret = _renderImpl->Render(params);
+        }
+        if (ret && !ret->DidSucceed())
+        {
+            _render_error = ret;
+            return false;
+        }
+        if (_options.checksum)
+        {
+            // FNV-1a
+            const std::size_t byte_count = static_cast<std::size_t>(frame_count) * _generic_stream_desc.bytes_per_frame;
+            for (std::size_t i = 0; i < byte_count; i++)
+            {
+                checksum = (checksum ^ _buffer[i]) * 1099511628211ull;
+            }
+            _checksum.store(checksum, std::memory_order_relaxed);
+        }
+        _callbacks.fetch_add(1, std::memory_order_relaxed);
+        _frames_rendered.fetch_add(frame_count, std::memory_order_relaxed);
+        return true;
+    }
+
+    Neato::audio_stream_description_t _generic_stream_desc;
+    const Neato::null_device_options_t _options;
+    // the buffer the device drains, and how often it wakes up to refill it
+    const uint32_t _buffer_frames;
+    const uint32_t _period_frames;
+    std::vector<uint8_t> _buffer;
+    std::atomic<bool> _stop_requested;
+    std::thread _thread;
+    Neato::realtime_thread_report_t _thread_report;
+    std::shared_ptr<Neato::IRenderReturn> _render_error;
+    std::shared_ptr<Neato::IRenderCallback> _renderImpl;
+    Neato::DeadlineMonitor _deadlines;
+
+    std::atomic<uint64_t> _wakeups = 0;
+    std::atomic<uint64_t> _callbacks = 0;
+    std::atomic<uint64_t> _frames_rendered = 0;
+    std::atomic<uint64_t> _underruns = 0;
+    std::atomic<uint64_t> _frames_short = 0;
+    std::atomic<uint64_t> _max_wakeup_late_ns = 0;
+    std::atomic<uint64_t> _checksum = 0;
+};
+
+std::shared_ptr<Neato::INullRenderGraph> Neato::CreateNullRenderGraph(const audio_stream_description_t& creation_params, std::shared_ptr<IRenderParamsValidatedCallback> callback, const null_device_options_t& options)
+{
+    return std::make_shared<NullRenderGraph>(creation_params, callback, options);
+}
+
+std::shared_ptr<Neato::IRenderGraph> Neato::CreateRenderGraph(const Neato::audio_stream_description_t& creation_params, std::shared_ptr<Neato::IRenderParamsValidatedCallback> callback)
+{
+    // no sound card backend, a null device keeps the callback on a realtime schedule and drops what it renders
+    return CreateNullRenderGraph(creation_params, callback, null_device_options_t());
+}
@@ -0,0 +1,22 @@
+//
+//  RenderGraph_Linux.h
+//  SigGen
+//
+
+#pragma once
+#include <stdint.h>
+
+constexpr bool PLATFORM_FORMAT_MEMBERS_REQUIRED = 0;
+
+namespace Neato
+{
+    // errno style: 0 is success
+    using OS_RETURN = int;
+
+    struct render_params_t
+    {
+        render_params_t() : frame_count(0), frame_buffer(nullptr) {}
+        uint32_t frame_count;
+        uint8_t* frame_buffer;
+    };
+};
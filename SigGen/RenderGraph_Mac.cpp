@@ -8,6 +8,7 @@
 #include <cmath>
 #include <numbers>
 #include "RenderGraph.h"
+#include "rt_audit.hpp"
 //#include "TestRenderer.hpp"
 
 OSStatus InternalRenderingCallback(void *inRefCon,
@@ -19,6 +20,7 @@ OSStatus InternalRenderingCallback(void *inRefCon,
 {
     neato::IRenderGraph* renderer = (neato::IRenderGraph*)(inRefCon);
     neato::render_params_t params = {ioActionFlags, inTimeStamp, inBusNumber, inNumberFrames, ioData};
+    Neato::rt_scope_t realtime;
     std::shared_ptr<neato::IRenderReturn> ret_ptr = renderer->Render(params);
     return ret_ptr->GetErrorCode();
 }
@@ -125,6 +127,7 @@ public:
     MacRenderGraph(const neato::audio_stream_description_t& params, std::shared_ptr<neato::IRenderCallback> callback)
     : _generic_stream_desc(params)
     , _renderImpl(callback)
+    , _deadlines(params.sample_rate)
     {
         OSErr err;
         _component_description.componentType = kAudioUnitType_Output;
@@ -219,8 +222,14 @@ public:
         return error;
     }
     
+    virtual Neato::deadline_stats_t GetDeadlineStats() const
+    {
+        return _deadlines.Snapshot();
+    }
+    
     std::shared_ptr<neato::IRenderReturn> Render(const neato::render_params_t& params)
     {
+        Neato::callback_timer_t timer(_deadlines, params.inNumberFrames);
         return _renderImpl->Render(params);
     }
 private:
@@ -231,7 +240,7 @@ private:
     AudioStreamBasicDescription _stream_description;
     neato::audio_stream_description_t _generic_stream_desc;
     std::shared_ptr<neato::IRenderCallback> _renderImpl;
-
+    Neato::DeadlineMonitor _deadlines;
 };
 
 std::shared_ptr<neato::PlatformRenderConstantsDictionary> neato::CreateRenderConstantsDictionary()
@@ -0,0 +1,57 @@
+//
+//  RenderGraph_Null.h
+//  SigGen
+//
+
+#pragma once
+
+#include "RenderGraph.h"
+#include "realtime_thread.hpp"
+
+namespace Neato
+{
+    struct null_device_options_t
+    {
+        // each wakeup is late by a uniform random amount up to this, on top of the scheduler's own
+        double jitter_seconds = 0.0;
+        // hand the callback whatever the buffer has room for on each wakeup, the way WASAPI's padding does,
+        // instead of exactly one period
+        bool variable_buffer_size = false;
+        // run every rendered byte through a checksum instead of just dropping it
+        bool checksum = true;
+        uint32_t seed = 1;
+        // applied to the render thread before it renders anything, everything off leaves it as it started
+        realtime_thread_config_t render_thread;
+    };
+
+    struct null_device_stats_t
+    {
+        uint64_t wakeups = 0;
+        uint64_t callbacks = 0;
+        uint64_t frames_rendered = 0;
+        // times the simulated device played past the end of what had been rendered, and the frames of
+        // silence it played instead
+        uint64_t underruns = 0;
+        uint64_t frames_short = 0;
+        // furthest any wakeup came after the time it was scheduled for, jitter included
+        uint64_t max_wakeup_late_ns = 0;
+        // FNV-1a over the rendered bytes in order, so it matches an offline render of the same thing
+        // whatever sizes the buffers came in
+        uint64_t checksum = 0;
+    };
+
+    // A sound device with no hardware behind it. A render thread sleeps on CLOCK_MONOTONIC absolute
+    // deadlines, a period (half the negotiated frames_per_packet) apart, and on each wakeup tops up a
+    // buffer of frames_per_packet that drains in real time, like the WASAPI graph does. Realtime callback
+    // behaviour, deadline stats and xruns can be measured on a box with no sound card. Linux only, it is
+    // what CreateRenderGraph() gives back there.
+    struct INullRenderGraph : public IRenderGraph
+    {
+        virtual null_device_stats_t GetStats() const = 0;
+        // what MakeThreadRealtime() managed on the render thread, filled in by the time Start() returns
+        virtual realtime_thread_report_t RenderThreadReport() const = 0;
+    };
+
+    // frames_per_packet of 0 picks 10 ms, the formats are the ones the WAV writer takes
+    std::shared_ptr<INullRenderGraph> CreateNullRenderGraph(const audio_stream_description_t& creation_params, std::shared_ptr<IRenderParamsValidatedCallback> callback, const null_device_options_t& options);
+};
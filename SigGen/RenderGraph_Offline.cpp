@@ -0,0 +1,137 @@
+//
+//  RenderGraph_Offline.cpp
+//  SigGen
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include "RenderGraph_Offline.h"
+#include "wav_file.h"
+
+class OfflineRenderGraph : public Neato::IOfflineRenderGraph
+{
+public:
+    OfflineRenderGraph(const Neato::audio_stream_description_t& params, std::shared_ptr<Neato::IRenderParamsValidatedCallback> callback, const utf8_string& file_path, double duration_seconds)
+        : _generic_stream_desc(Neato::ValidateWavStreamDescription(params))
+        , _writer(file_path, _generic_stream_desc)
+        , _total_frames(static_cast<uint64_t>(duration_seconds * _generic_stream_desc.sample_rate))
+        , _stop_requested(false)
+        , _render_error(Neato::CreateRenderReturn())
+        , _deadlines(_generic_stream_desc.sample_rate)
+    {
+        callback->RenderParamsValidated(_generic_stream_desc);
+    }
+
+    virtual ~OfflineRenderGraph()
+    {
+        Stop();
+    }
+
+    virtual std::shared_ptr<Neato::IRenderReturn> Start(std::shared_ptr<Neato::IRenderCallback> render_callback)
+    {
+        std::shared_ptr<Neato::IRenderReturn> error = Neato::CreateRenderReturn();
+        if (_thread.joinable())
+        {
+            error->SetCodeAndDescription(EBUSY, "Offline render already started");
+            return error;
+        }
+        _renderImpl = render_callback;
+        _stop_requested = false;
+        _thread = std::thread([this]() { Render(); });
+        return error;
+    }
+
+    virtual std::shared_ptr<Neato::IRenderReturn> Stop()
+    {
+        _stop_requested = true;
+        return WaitForCompletion();
+    }
+
+    virtual std::shared_ptr<Neato::IRenderReturn> WaitForCompletion()
+    {
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+        try
+        {
+            _writer.Close();
+        }
+        catch (const std::runtime_error& e)
+        {
+            _render_error->SetCodeAndDescription(EIO, e.what());
+        }
+        return _render_error;
+    }
+
+    virtual Neato::offline_render_stats_t GetStats() const
+    {
+        return _stats;
+    }
+
+    // nothing waits on an offline render, but the budget each block used says how much headroom a device would have
+    virtual Neato::deadline_stats_t GetDeadlineStats() const
+    {
+        return _deadlines.Snapshot();
+    }
+
+private:
+    void Render()
+    {
+        const uint32_t bytes_per_frame = _generic_stream_desc.bytes_per_frame;
+        const uint32_t frames_per_packet = _generic_stream_desc.frames_per_packet;
+        const auto start_time = std::chrono::steady_clock::now();
+        uint64_t frames_rendered = 0;
+
+        try
+        {
+            while (frames_rendered < _total_frames && !_stop_requested)
+            {
+                Neato::render_params_t params;
+                params.frame_count = static_cast<uint32_t>(std::min<uint64_t>(frames_per_packet, _total_frames - frames_rendered));
+                // render straight into the writer's buffer, no copy between the callback and the file
+                params.frame_buffer = _writer.Reserve(static_cast<std::size_t>(params.frame_count) * bytes_per_frame);
+                std::shared_ptr<Neato::IRenderReturn> ret;
+                {
+                    Neato::callback_timer_t timer(_deadlines, params.frame_count);
+                    ret = _renderImpl->Render(params);
+                }
+                if (ret && !ret->DidSucceed())
+                {
+                    _render_error = ret;
+                    break;
+                }
+                _writer.Commit(static_cast<std::size_t>(params.frame_count) * bytes_per_frame);
+                frames_rendered += params.frame_count;
+            }
+        }
+        catch (const std::runtime_error& e)
+        {
+            _render_error->SetCodeAndDescription(EIO, e.what());
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+        _stats.frames_rendered = frames_rendered;
+        _stats.rendered_seconds = frames_rendered / _generic_stream_desc.sample_rate;
+        _stats.wall_clock_seconds = elapsed.count();
+        _stats.realtime_factor = (elapsed.count() > 0.0) ? (_stats.rendered_seconds / elapsed.count()) : 0.0;
+    }
+
+private:
+    Neato::audio_stream_description_t _generic_stream_desc;
+    Neato::WavFileWriter _writer;
+    uint64_t _total_frames;
+    std::atomic<bool> _stop_requested;
+    std::thread _thread;
+    Neato::offline_render_stats_t _stats;
+    std::shared_ptr<Neato::IRenderReturn> _render_error;
+    std::shared_ptr<Neato::IRenderCallback> _renderImpl;
+    Neato::DeadlineMonitor _deadlines;
+};
+
+std::shared_ptr<Neato::IOfflineRenderGraph> Neato::CreateOfflineRenderGraph(const Neato::audio_stream_description_t& creation_params, std::shared_ptr<Neato::IRenderParamsValidatedCallback> callback, const utf8_string& file_path, double duration_seconds)
+{
+    return std::make_shared<OfflineRenderGraph>(creation_params, callback, file_path, duration_seconds);
+}
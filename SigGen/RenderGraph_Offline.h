@@ -0,0 +1,32 @@
+//
+//  RenderGraph_Offline.h
+//  SigGen
+//
+
+#pragma once
+
+#include "RenderGraph.h"
+
+namespace Neato
+{
+    struct offline_render_stats_t
+    {
+        uint64_t frames_rendered = 0;
+        double rendered_seconds = 0.0;
+        double wall_clock_seconds = 0.0;
+        // rendered_seconds / wall_clock_seconds, so 100 means a minute of audio took 0.6 seconds
+        double realtime_factor = 0.0;
+    };
+
+    // Drives the render callback as fast as the CPU allows and streams the result into a WAV file
+    // instead of a device. Start() kicks off the render thread, WaitForCompletion() blocks until
+    // the requested duration has been written, Stop() cuts it short. Either one finalizes the file.
+    struct IOfflineRenderGraph : public IRenderGraph
+    {
+        virtual std::shared_ptr<IRenderReturn> WaitForCompletion() = 0;
+        virtual offline_render_stats_t GetStats() const = 0;
+    };
+
+    // creation_params uses the neutral format_id_* values, the WAV file is always interleaved
+    std::shared_ptr<IOfflineRenderGraph> CreateOfflineRenderGraph(const audio_stream_description_t& creation_params, std::shared_ptr<IRenderParamsValidatedCallback> callback, const utf8_string& file_path, double duration_seconds);
+};
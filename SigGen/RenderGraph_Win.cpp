@@ -8,6 +8,7 @@
 #include <memory>
 #include "avrt.h"
 #include "RenderGraph.h"
+#include "rt_audit.hpp"
 
 using Microsoft::WRL::ComPtr;
 
@@ -220,6 +221,7 @@ public:
         std::memcpy(&_mix_format, p_wave_format_out, sizeof(WAVEFORMATEXTENSIBLE));
 
         _frame_size = _mix_format.Format.nBlockAlign;
+        _deadlines.SetSampleRate(_generic_stream_desc.sample_rate);
 
         _params_callback->RenderParamsValidated(_generic_stream_desc);
 
@@ -277,6 +279,11 @@ public:
         return error;
     }
 
+    virtual Neato::deadline_stats_t GetDeadlineStats() const
+    {
+        return _deadlines.Snapshot();
+    }
+
     void Render()
     {
         DWORD nTaskIndex = 0;
@@ -328,7 +335,11 @@ public:
 					if (SUCCEEDED(hr))
 					{
 						params.frame_count = frames_available_count;
-						_renderImpl->Render(params);
+						{
+							Neato::rt_scope_t realtime;
+							Neato::callback_timer_t timer(_deadlines, frames_available_count);
+							_renderImpl->Render(params);
+						}
 						hr = _render_client->ReleaseBuffer(frames_available_count, 0);
 					}
 				}
@@ -377,7 +388,7 @@ private:
             }
             else if (::IsEqualGUID(wave_format.SubFormat, KSDATAFORMAT_SUBTYPE_PCM))
             {
-                if (wave_format.Format.wBitsPerSample != 16)
+                if (wave_format.Format.wBitsPerSample != 16 && wave_format.Format.wBitsPerSample != 24)
                 {
                     std::string msg = "Unknown PCM integer sample type";
                     _RPTF0(_CRT_ERROR, msg.c_str());
@@ -396,7 +407,7 @@ private:
         }
         else if (wave_format.Format.wFormatTag == WAVE_FORMAT_PCM)
         {
-            if (wave_format.Format.wBitsPerSample != 16)
+            if (wave_format.Format.wBitsPerSample != 16 && wave_format.Format.wBitsPerSample != 24)
             {
                 std::string msg = "Unknown PCM integer sample type";
                 _RPTF0(_CRT_ERROR, msg.c_str());
@@ -484,6 +495,7 @@ private:
 
     std::shared_ptr<Neato::IRenderParamsValidatedCallback> _params_callback;
     std::shared_ptr<Neato::IRenderCallback> _renderImpl;
+    Neato::DeadlineMonitor _deadlines;
 };
 
 DWORD WINAPI RenderThread(void* param)
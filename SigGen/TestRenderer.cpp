@@ -6,38 +6,36 @@
 //
 #include <memory>
 #include <numbers>
+#include <cmath>
 
 #include "envelope.hpp"
 #include "TestRenderer.hpp"
 #include "sequence.h"
+#include "oscillator_bank.hpp"
+#include "graph_compiler.hpp"
+#include "dsp_expressions.hpp"
+#include "parallel_graph.hpp"
 
 //#include "composite_waveforms.hpp"
 
-static std::shared_ptr<neato::ISampleSource> CreateFMBell(double center_freq, const neato::audio_stream_description_t& stream_desc_in)
+static std::shared_ptr<Neato::ISampleSource> CreateFMBell(double center_freq, const Neato::audio_stream_description_t& stream_desc_in)
 {
-    //frequency of the carrier gets modulated by a saw with a constant gain
-    std::shared_ptr<neato::ISampleSource> saw_temp = std::make_shared<neato::ConstSaw>(1.4 * center_freq, stream_desc_in.sample_rate, false);
+    const double sample_rate = stream_desc_in.sample_rate;
     
-    //make a modualted signal with the saw and the gain
-    std::shared_ptr<neato::ISampleSource> saw_with_gain = std::make_shared<neato::SampleMultiplier>(saw_temp, 160.0);
-    
-    //make a frequency modulator
-    //std::shared_ptr<neato::ICustomModulatorFunction> center_freq_mod = std::make_shared<neato::CenterFrequencyModulator>(center_freq);
-    std::vector<std::shared_ptr<neato::ISampleSource>> frequency_modulator_signals = {saw_with_gain, std::make_shared<neato::DCOffset>(center_freq)};
-    std::shared_ptr<neato::ISampleSource> frequncy_modulator = std::make_shared<neato::SampleSummer>(frequency_modulator_signals);
+    //frequency of the carrier gets modulated by a saw with a constant gain, riding on the center frequency
+    Neato::Expr::Sum frequency_modulator{Neato::Expr::Mul{Neato::Expr::Saw{1.4 * center_freq, sample_rate, false}, Neato::Expr::Const{160.0}}, Neato::Expr::Const{center_freq}};
     
     //create the sine wave with the frequency modulator
-    std::shared_ptr<neato::ISampleSource> carrier_temp = std::make_shared<neato::MutableSine>(center_freq, stream_desc_in.sample_rate, frequncy_modulator);
+    Neato::Expr::Sine carrier{frequency_modulator, sample_rate};
     
     //make an envelope for the bell
-    std::shared_ptr<neato::ISampleSource> bell_envelope = neato::CreateEnvelope(neato::EnvelopeID::Bell1, stream_desc_in.sample_rate, 1.0);
+    std::shared_ptr<Neato::ISampleSource> bell_envelope = Neato::CreateEnvelope(Neato::EnvelopeID::Bell1, sample_rate, 1.0);
     
-    //make an overall modulated signal with the sine, the custom modulated saw for frequency mod, and the bell envelope for amplitude mod
-    std::shared_ptr<neato::ISampleSource> signal = std::make_shared<neato::SampleMultiplier>(carrier_temp, bell_envelope);
-    return signal;
+    //the whole topology is fixed, so it's one inlined expression instead of a tree of shared nodes
+    return Neato::MakeExpressionSource(Neato::Expr::Mul{carrier, Neato::Expr::Source{bell_envelope}});
 }
 
-static std::shared_ptr<neato::ISampleSource> CreateFlute(double center_freq, double sample_rate)
+static std::shared_ptr<Neato::ISampleSource> CreateFlute(double center_freq, double sample_rate, uint32_t noise_seed)
 {
     const uint8_t harmonic_count = 6;
     const double tremolo_freq = 5.0;
@@ -47,116 +45,141 @@ static std::shared_ptr<neato::ISampleSource> CreateFlute(double center_freq, dou
     std::vector<double> tremolo_gains = { 0.1001,  0.2, 0.1, 0.001, 0.001, 0.001 };
         
     //tremolo modulators for higher harmonics
-    std::vector<std::shared_ptr<neato::ISampleSource>> tremolo_sines;
+    std::vector<std::shared_ptr<Neato::ISampleSource>> tremolo_sines;
     tremolo_sines.reserve(harmonic_count);
     for(uint32_t i = 0; i < harmonic_count; i++)
     {
-        tremolo_sines.push_back(std::make_shared<neato::ConstSine>(tremolo_freq, sample_rate));
+        tremolo_sines.push_back(std::make_shared<Neato::ConstSine>(tremolo_freq, sample_rate));
     }
     
     //apply a gain to the tremolos. Don't want a huge variation in volume
-    std::vector<std::shared_ptr<neato::ISampleSource>> tremolos_with_gain = neato::CreateMultiplierArray(tremolo_sines, tremolo_gains);
+    std::vector<std::shared_ptr<Neato::ISampleSource>> tremolos_with_gain = Neato::CreateMultiplierArray(tremolo_sines, tremolo_gains);
 
     //create clean sine waves
-    std::vector<double> frequencies = neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));
-    std::vector<std::shared_ptr<neato::ISampleSource>> signals = neato::CreateConstSineArray(frequencies, sample_rate);
+    std::vector<double> frequencies = Neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));
+    std::vector<std::shared_ptr<Neato::ISampleSource>> signals = Neato::CreateConstSineArray(frequencies, sample_rate);
     
     //put tremolo modulators on sines
-    std::vector<std::shared_ptr<neato::ISampleSource>> signals_with_tremolo;
+    std::vector<std::shared_ptr<Neato::ISampleSource>> signals_with_tremolo;
     signals_with_tremolo.reserve(harmonic_count);
     for(uint32_t i = 0; i < harmonic_count; i++)
     {
-        std::vector<std::shared_ptr<neato::ISampleSource>> signals_to_sum;
+        std::vector<std::shared_ptr<Neato::ISampleSource>> signals_to_sum;
         signals_to_sum.push_back(signals.at(i));
         signals_to_sum.push_back(tremolos_with_gain.at(i));
-        signals_with_tremolo.push_back(std::make_shared<neato::SampleSummer>(signals_to_sum));
+        signals_with_tremolo.push_back(std::make_shared<Neato::SampleSummer>(signals_to_sum));
     }
     
-    std::vector<double> gain_values = neato::dbToGains(std::move(frequency_gains_in_db));
+    std::vector<double> gain_values = Neato::dbToGains(std::move(frequency_gains_in_db));
     //gain multipliers
-    std::vector<std::shared_ptr<neato::ISampleSource>> signals_with_tremolo_and_gain = neato::CreateMultiplierArray(signals_with_tremolo, gain_values);
+    std::vector<std::shared_ptr<Neato::ISampleSource>> signals_with_tremolo_and_gain = Neato::CreateMultiplierArray(signals_with_tremolo, gain_values);
 
     //add noise signal
-    std::shared_ptr<neato::ISampleSource> noise = std::make_shared<neato::WhiteNoise>();
-    std::shared_ptr<neato::ISampleSource> noise_with_gain = std::make_shared<neato::SampleMultiplier>(noise, neato::dbToGain(white_noise_gain_db));
+    std::shared_ptr<Neato::ISampleSource> noise = std::make_shared<Neato::WhiteNoise>(noise_seed);
+    std::shared_ptr<Neato::ISampleSource> noise_with_gain = std::make_shared<Neato::SampleMultiplier>(noise, Neato::dbToGain(white_noise_gain_db));
     signals_with_tremolo_and_gain.push_back(noise_with_gain);
     
     //make summed signal
-    std::shared_ptr<neato::ISampleSource> raw_sig = std::make_shared<neato::SampleSummer>(signals_with_tremolo_and_gain);
+    std::shared_ptr<Neato::ISampleSource> raw_sig = std::make_shared<Neato::SampleSummer>(signals_with_tremolo_and_gain);
     
     //make overall envelope
-    std::shared_ptr<neato::ISampleSource> env_temp = neato::CreateEnvelope(neato::EnvelopeID::Bell1, sample_rate, 1.0);
+    std::shared_ptr<Neato::ISampleSource> env_temp = Neato::CreateEnvelope(Neato::EnvelopeID::Bell1, sample_rate, 1.0);
     
     //make a modulated signal
-    return std::make_shared<neato::SampleMultiplier>(raw_sig, env_temp);
+    return std::make_shared<Neato::SampleMultiplier>(raw_sig, env_temp);
 }
 
-static std::shared_ptr<neato::ISampleSource> CreateFluteSequence(double center_freq, double sample_rate)
+// fixed per pitch, so renders from different builds can be compared sample for sample
+static uint32_t NoiseSeed(double frequency)
 {
-    std::vector<neato::sequence_element> elements;
-    std::vector<double> frequencies = { 
-         233.08
-        ,261.63
-        ,293.66
-        ,311.13
-        ,349.23
-        ,392.00
-        ,440.00
-        ,466.16 };
+    return static_cast<uint32_t>(std::lround(frequency * 100.0));
+}
 
+// one flute note every 1.2 s, through the frequencies in the order given. compiled notes render faster but
+// are one opaque node to anything walking the graph. notes go through render_cache when there is one
+static std::shared_ptr<Neato::ISampleSourceWithDuration> CreateFluteRun(const std::vector<double>& frequencies, double sample_rate, bool compile = true, Neato::RenderCache* render_cache = nullptr)
+{
+    std::vector<Neato::sequence_element> elements;
     uint8_t i = 0;
     for (double frequency : frequencies)
     {
-        std::shared_ptr<neato::ISampleSource> base_sound = CreateFlute(frequency, sample_rate);
+        std::shared_ptr<Neato::ISampleSource> base_sound = CreateFlute(frequency, sample_rate, NoiseSeed(frequency));
+        if (compile)
+        {
+            base_sound = Neato::CompileGraph(base_sound);
+        }
         double duration = 1.0;
-        std::shared_ptr elem_base = neato::CreateSoundWithDuration(base_sound, duration, sample_rate);
-        neato::sequence_element elem;
+        std::shared_ptr elem_base = Neato::CreateSoundWithDuration(base_sound, duration, sample_rate);
+        if (render_cache)
+        {
+            elem_base = render_cache->Cached(elem_base);
+        }
+        Neato::sequence_element elem;
         elem.base_sound = elem_base;
         elem.delay_to_start = (double)i * 1.2;
         elements.push_back(elem);
         i++;
     }
+    return Neato::CreateSequence(elements, sample_rate);
+}
 
-    std::vector<neato::sequence_element> elements_down;
-    i = 0;
-    for (auto iter = frequencies.rbegin(); iter != frequencies.rend(); iter++)
-    {
-        double frequency = *iter;
-        std::shared_ptr<neato::ISampleSource> base_sound = CreateFlute(frequency, sample_rate);
-        double duration = 1.0;
-        std::shared_ptr elem_base = neato::CreateSoundWithDuration(base_sound, duration, sample_rate);
-        neato::sequence_element elem;
-        elem.base_sound = elem_base;
-        elem.delay_to_start = (double)i * 1.2;
-        elements_down.push_back(elem);
-        i++;
-    }
-    
-    auto seq1 =  neato::CreateSequence(elements, sample_rate);
-    auto seq2 = neato::CreateSequence(elements_down, sample_rate);
+static const std::vector<double> flute_scale = { 
+     233.08
+    ,261.63
+    ,293.66
+    ,311.13
+    ,349.23
+    ,392.00
+    ,440.00
+    ,466.16 };
 
-    std::vector<neato::sequence_element> final_elements;
+static std::shared_ptr<Neato::ISampleSource> CreateFluteSequence(double center_freq, double sample_rate, bool compile, Neato::RenderCache* render_cache)
+{
+    auto seq1 = CreateFluteRun(flute_scale, sample_rate, compile, render_cache);
+    auto seq2 = CreateFluteRun(std::vector<double>(flute_scale.rbegin(), flute_scale.rend()), sample_rate, compile, render_cache);
+
+    std::vector<Neato::sequence_element> final_elements;
 
-    neato::sequence_element elem_up;
+    Neato::sequence_element elem_up;
     elem_up.base_sound = seq1;
     elem_up.delay_to_start = 0.0;
 
-    neato::sequence_element elem_down;
+    Neato::sequence_element elem_down;
     elem_down.base_sound = seq2;
     elem_down.delay_to_start = seq1->Duration();
 
     final_elements.push_back(elem_up);
     final_elements.push_back(elem_down);
 
-    return neato::CreateSequence(final_elements, sample_rate);
+    return Neato::CreateSequence(final_elements, sample_rate);
+
+}
+
+// the same run up and back down, with the way up on the left and the way down on the right
+static std::shared_ptr<Neato::IMultichannelSource> CreatePannedFluteSequence(double sample_rate, uint32_t channel_count, bool compile, Neato::RenderCache* render_cache)
+{
+    auto seq_up = CreateFluteRun(flute_scale, sample_rate, compile, render_cache);
+    auto seq_down = CreateFluteRun(std::vector<double>(flute_scale.rbegin(), flute_scale.rend()), sample_rate, compile, render_cache);
+
+    Neato::sequence_element elem_down;
+    elem_down.base_sound = seq_down;
+    elem_down.delay_to_start = seq_up->Duration();
 
+    Neato::sample_source_vector_t inputs = {seq_up, Neato::CreateSequence({elem_down}, sample_rate)};
+    return Neato::CreatePannedMixerBus(inputs, {-0.5, 0.5}, channel_count, sample_rate);
+}
+
+// a mono source on every channel at full level
+static std::shared_ptr<Neato::IMultichannelSource> MonoMix(std::shared_ptr<Neato::ISampleSource> signal, const Neato::audio_stream_description_t& stream_desc_in)
+{
+    return Neato::CreateMixerBus({signal}, {std::vector<double>(stream_desc_in.channels_per_frame, 1.0)}, stream_desc_in.sample_rate);
 }
 
-static std::shared_ptr<neato::ISampleSource> CreateCompositeSignalWithBellEnvelopes(double center_freq, const neato::audio_stream_description_t& stream_desc_in)
+static std::shared_ptr<Neato::ISampleSource> CreateCompositeSignalWithBellEnvelopes(double center_freq, const Neato::audio_stream_description_t& stream_desc_in)
 {
     std::vector<double> frequency_multiples = {1.0, 1.272, 1.554};//, 6.0 / 3.89};
-    std::vector<double> frequencies = neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));// = {400.0, 500.0, 600.00};
-    std::vector<std::shared_ptr<neato::ISampleSource>> sine_waves = neato::CreateConstSineArray(frequencies, stream_desc_in.sample_rate);
+    std::vector<double> frequencies = Neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));// = {400.0, 500.0, 600.00};
+    std::vector<std::shared_ptr<Neato::ISampleSource>> sine_waves = Neato::CreateConstSineArray(frequencies, stream_desc_in.sample_rate);
     
     const std::vector<double>::size_type signal_count = frequencies.size();
     std::vector<double> gains;
@@ -167,24 +190,23 @@ static std::shared_ptr<neato::ISampleSource> CreateCompositeSignalWithBellEnvelo
     }
     
     //make the envelopes
-    std::vector<std::shared_ptr<neato::ISampleSource>> envelopes;
+    std::vector<std::shared_ptr<Neato::ISampleSource>> envelopes;
     envelopes.reserve(signal_count);
     for (std::vector<double>::size_type i = 0; i < signal_count; i++)
     {
-        std::shared_ptr<neato::ISampleSource> env_temp = neato::CreateEnvelope(neato::EnvelopeID::Bell1, stream_desc_in.sample_rate, gains.at(i));
+        std::shared_ptr<Neato::ISampleSource> env_temp = Neato::CreateEnvelope(Neato::EnvelopeID::Bell1, stream_desc_in.sample_rate, gains.at(i));
         envelopes.push_back(env_temp);
     }
     
-    std::shared_ptr<neato::ISampleSource> composite_signal = std::make_shared<neato::SampleSummer>(neato::CreateMultiplierArray(sine_waves, envelopes));
+    std::shared_ptr<Neato::ISampleSource> composite_signal = std::make_shared<Neato::SampleSummer>(Neato::CreateMultiplierArray(sine_waves, envelopes));
     return composite_signal;
 }
 
-static std::shared_ptr<neato::ISampleSource> CreateAdditiveBell(double center_freq, const neato::audio_stream_description_t& stream_desc_in)
+static std::shared_ptr<Neato::ISampleSource> CreateAdditiveBell(double center_freq, const Neato::audio_stream_description_t& stream_desc_in)
 {
     std::vector<double> frequency_multiples = {0.56, 0.92, 1.19, 1.71, 2, 2.74, 3, 3.76, 4.07, 5.50};
     const std::vector<double>::size_type signal_count = frequency_multiples.size();
-    std::vector<double> frequencies = neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));
-    std::vector<std::shared_ptr<neato::ISampleSource>> sine_waves = neato::CreateConstSineArray(frequencies, stream_desc_in.sample_rate);
+    std::vector<double> frequencies = Neato::FrequenciesFromMultiples(center_freq, std::move(frequency_multiples));
     
     // make the envelope scale values
     constexpr double fundamental_gain = 0.5;
@@ -198,65 +220,78 @@ static std::shared_ptr<neato::ISampleSource> CreateAdditiveBell(double center_fr
         gains.push_back( fundamental_gain / std::pow((double)1.75, (double)i) );
     }
     
-    //make the envelopes
-    std::vector<std::shared_ptr<neato::ISampleSource>> envelopes;
-    envelopes.reserve(signal_count);
-    for (auto gain : gains)
-    {
-        std::shared_ptr<neato::ISampleSource> env_temp = neato::CreateEnvelope(neato::EnvelopeID::Bell1, stream_desc_in.sample_rate, gain);
-        envelopes.push_back(env_temp);
-    }
-    
-    //multiply envelopes and signals
-    std::vector<std::shared_ptr<neato::ISampleSource>> multiplied_signals = neato::CreateMultiplierArray(sine_waves, envelopes);
+    //every partial shares the same envelope shape, only the scale differs, so the scales become
+    //the partial gains in one oscillator bank and a single unit envelope goes over the sum
+    std::shared_ptr<Neato::ISampleSource> partials = Neato::CreateOscillatorBank(frequencies, gains, stream_desc_in.sample_rate);
+    std::shared_ptr<Neato::ISampleSource> bell_envelope = Neato::CreateEnvelope(Neato::EnvelopeID::Bell1, stream_desc_in.sample_rate, 1.0);
     
-    //sum all the signals
-    std::shared_ptr<neato::ISampleSource> composite_signal = std::make_shared<neato::SampleSummer>(multiplied_signals);
+    std::shared_ptr<Neato::ISampleSource> composite_signal = std::make_shared<Neato::SampleMultiplier>(partials, bell_envelope);
     
     return composite_signal;
 }
 
-static std::shared_ptr<neato::ISampleSource> CreateHarmonicBells(double center_freq, const neato::audio_stream_description_t& stream_desc_in)
+static std::shared_ptr<Neato::ISampleSource> CreateHarmonicBells(double center_freq, const Neato::audio_stream_description_t& stream_desc_in)
 {
-    std::shared_ptr<neato::ISampleSource> bell1 = CreateAdditiveBell(center_freq, stream_desc_in);
-    std::shared_ptr<neato::ISampleSource> bell2 = CreateAdditiveBell(center_freq * 0.5, stream_desc_in);
-    std::shared_ptr<neato::ISampleSource> bell3 = CreateAdditiveBell(center_freq * 2.0, stream_desc_in);
-    std::shared_ptr<neato::ISampleSource> bell4 = CreateAdditiveBell(center_freq * 4.0, stream_desc_in);
-    std::vector<std::shared_ptr<neato::ISampleSource>> signals = {bell1, bell2, bell3, bell4};
-    std::shared_ptr<neato::ISampleSource> composite_signal = std::make_shared<neato::SampleSummer>(signals);
+    std::shared_ptr<Neato::ISampleSource> bell1 = CreateAdditiveBell(center_freq, stream_desc_in);
+    std::shared_ptr<Neato::ISampleSource> bell2 = CreateAdditiveBell(center_freq * 0.5, stream_desc_in);
+    std::shared_ptr<Neato::ISampleSource> bell3 = CreateAdditiveBell(center_freq * 2.0, stream_desc_in);
+    std::shared_ptr<Neato::ISampleSource> bell4 = CreateAdditiveBell(center_freq * 4.0, stream_desc_in);
+    std::vector<std::shared_ptr<Neato::ISampleSource>> signals = {bell1, bell2, bell3, bell4};
+    std::shared_ptr<Neato::ISampleSource> composite_signal = std::make_shared<Neato::SampleSummer>(signals);
     return composite_signal;
 }
 
-TestRenderer::TestRenderer()
+TestRenderer::TestRenderer(bool compile_graphs, std::shared_ptr<Neato::RenderCache> render_cache, bool panned)
+    : _render_return(Neato::CreateRenderReturn())
+    , _compile_graphs(compile_graphs)
+    , _render_cache(render_cache)
+    , _panned(panned)
 {
 
 }
 
-void TestRenderer::RendererCreated(const neato::audio_stream_description_t& stream_desc_in)
+void TestRenderer::RenderParamsValidated(const Neato::audio_stream_description_t& stream_desc_in)
 {
     _stream_desc = stream_desc_in;
+    _channel_blocks.assign(stream_desc_in.channels_per_frame, std::vector<Neato::sample_t>(stream_desc_in.frames_per_packet));
+    _channel_spans.resize(stream_desc_in.channels_per_frame);
+    _output_spans.resize(stream_desc_in.channels_per_frame);
+    _formatter = std::make_unique<Neato::OutputFormatter>(stream_desc_in);
     double center_freq = 300.0f;
-    //signal = CreateFMBell(center_freq, stream_desc_in);
-    //signal = CreateAdditiveBell(center_freq, stream_desc_in);
-    //signal = CreateHarmonicBells(center_freq, stream_desc_in);
-    //signal = CreateCompositeSignalWithBellEnvelopes(center_freq, stream_desc_in);
-    //signal = CreateFlute(center_freq, stream_desc_in.sample_rate);
-    signal = CreateFluteSequence(center_freq, stream_desc_in.sample_rate);
+    //mix = MonoMix(CreateFMBell(center_freq, stream_desc_in), stream_desc_in);
+    //mix = MonoMix(CreateAdditiveBell(center_freq, stream_desc_in), stream_desc_in);
+    //mix = MonoMix(CreateHarmonicBells(center_freq, stream_desc_in), stream_desc_in);
+    //mix = MonoMix(Neato::CreateParallelGraph(CreateHarmonicBells(center_freq, stream_desc_in), Neato::DefaultWorkerCount()), stream_desc_in);
+    //mix = MonoMix(CreateCompositeSignalWithBellEnvelopes(center_freq, stream_desc_in), stream_desc_in);
+    //mix = MonoMix(CreateFlute(center_freq, stream_desc_in.sample_rate, NoiseSeed(center_freq)), stream_desc_in);
+    if (_panned)
+    {
+        mix = CreatePannedFluteSequence(stream_desc_in.sample_rate, stream_desc_in.channels_per_frame, _compile_graphs, _render_cache.get());
+    }
+    else
+    {
+        mix = MonoMix(CreateFluteSequence(center_freq, stream_desc_in.sample_rate, _compile_graphs, _render_cache.get()), stream_desc_in);
+    }
+
+    // scratch blocks grow to the biggest block they've seen, get that done here instead of on the audio thread
+    mix->ForEachChild([&stream_desc_in](std::shared_ptr<Neato::ISampleSource>& input)
+    {
+        Neato::PrimeScratchBlocks(input, stream_desc_in.frames_per_packet);
+    });
 }
 
-std::shared_ptr<neato::IRenderReturn> TestRenderer::Render(const neato::render_params_t& params)
+std::shared_ptr<Neato::IRenderReturn> TestRenderer::Render(const Neato::render_params_t& params)
 {
-    std::shared_ptr<neato::IRenderReturn> error = neato::CreateRenderReturn();
-    
-    for (uint32_t buffer_offset = 0; buffer_offset < params.frame_count * _stream_desc.bytes_per_frame; buffer_offset += _stream_desc.bytes_per_frame)
+    // pull the whole callback buffer through the mix in one go, then write every channel in whatever
+    // format the device settled on
+    for (std::size_t channel = 0; channel < _channel_blocks.size(); channel++)
     {
-        float sample = (float)(signal->Sample());
-        float* buffer = (float*)&params.frame_buffer[buffer_offset];
-        for (uint32_t channel = 0; channel < _stream_desc.channels_per_frame; channel++)
-        {
-            buffer[channel] = sample;
-        }
+        _channel_spans[channel] = Neato::ScratchBlock(_channel_blocks[channel], params.frame_count);
+        _output_spans[channel] = _channel_spans[channel];
     }
+    mix->SampleChannels(_channel_spans);
+    _formatter->Write(_output_spans, params.frame_buffer);
     
-    return error;
+    // made once up front, a make_shared per callback is an allocation on the audio thread
+    return _render_return;
 }
@@ -7,17 +7,34 @@
 
 #pragma once
 
+#include <vector>
+
 #include "RenderGraph.h"
 #include "base_waveforms.hpp"
+#include "output_format.hpp"
+#include "mixer_bus.hpp"
+#include "render_cache.hpp"
 
-class TestRenderer : public neato::IRenderCallback
+class TestRenderer : public Neato::IRenderCallback, public Neato::IRenderParamsValidatedCallback
 {
 public:
-    TestRenderer();
-    virtual std::shared_ptr<neato::IRenderReturn> Render(const neato::render_params_t& params) override;
-    virtual void RendererCreated(const neato::audio_stream_description_t& creation_params) override;
+    // compile_graphs false leaves every node of the demo in place, for the profiler to see into.
+    // with a render_cache every note goes through it, so a repeated pitch is only rendered once.
+    // the flute run plays on every channel, panned puts the way up on the left and the way down on the right
+    explicit TestRenderer(bool compile_graphs = true, std::shared_ptr<Neato::RenderCache> render_cache = nullptr, bool panned = false);
+    virtual std::shared_ptr<Neato::IRenderReturn> Render(const Neato::render_params_t& params) override;
+    virtual void RenderParamsValidated(const Neato::audio_stream_description_t& creation_params) override;
+    // the graph being played, valid once the render params are validated
+    std::shared_ptr<Neato::IMultichannelSource> Mix() const { return mix; }
 private:
-    neato::audio_stream_description_t _stream_desc;
-    std::shared_ptr<neato::ISampleSource> signal;
+    Neato::audio_stream_description_t _stream_desc;
+    std::shared_ptr<Neato::IMultichannelSource> mix;
+    std::vector<std::vector<Neato::sample_t>> _channel_blocks;
+    std::vector<std::span<Neato::sample_t>> _channel_spans;
+    std::vector<std::span<const Neato::sample_t>> _output_spans;
+    std::unique_ptr<Neato::OutputFormatter> _formatter;
+    std::shared_ptr<Neato::IRenderReturn> _render_return;
+    const bool _compile_graphs;
+    std::shared_ptr<Neato::RenderCache> _render_cache;
+    const bool _panned;
 };
-
@@ -7,6 +7,7 @@
 
 #include "base_waveforms.hpp"
 #include <cassert>
+#include <typeinfo>
 
 namespace Neato
 {
@@ -14,6 +15,54 @@ namespace Neato
     {
         
     }
+
+    bool GraphDescription::Child(const ISampleSource* child)
+    {
+        if (nullptr == child)
+        {
+            Add(uint8_t(0));
+            return true;
+        }
+        child = child->DescribedNode();
+        auto found = visited.find(child);
+        if (found != visited.end())
+        {
+            Add(uint8_t(1));
+            Add(found->second);
+            return true;
+        }
+        visited.emplace(child, static_cast<uint32_t>(visited.size()));
+        Add(uint8_t(2));
+        Add(std::string(typeid(*child).name()));
+        return child->Describe(*this);
+    }
+
+    void SumSourcesIntoBlock(sample_source_vector_t& sources, std::span<sample_t> block, std::vector<sample_t>& scratch)
+    {
+        std::fill(block.begin(), block.end(), 0.0);
+        std::span<sample_t> source_block = ScratchBlock(scratch, block.size());
+        for (std::shared_ptr<ISampleSource>& source : sources)
+        {
+            source->SampleBlock(source_block);
+            for (std::size_t i = 0; i < block.size(); i++)
+            {
+                block[i] += source_block[i];
+            }
+        }
+    }
+    
+    void PrimeScratchBlocks(std::shared_ptr<ISampleSource>& root, std::size_t frame_count)
+    {
+        std::vector<sample_t> block(frame_count);
+        child_visitor_t prime;
+        prime = [&block, &prime](std::shared_ptr<ISampleSource>& node)
+        {
+            node->ForEachChild(prime);
+            node->SampleBlock(block);
+            node->Reset();
+        };
+        prime(root);
+    }
     
     std::vector<double> FrequenciesFromMultiples(double center_freq, std::vector<double>&& frequency_multiples)
     {
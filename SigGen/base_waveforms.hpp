@@ -14,19 +14,111 @@
 #include <map>
 #include <vector>
 #include <random>
+#include <span>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include "wavetable.hpp"
+#include "fast_math.hpp"
+#include "noise.hpp"
 
 constexpr static const double two_pi = std::numbers::pi * 2.0;
 
 namespace Neato
 {
+    class ISampleSource;
+    // gets a reference to the parent's own pointer, so a visitor can swap in a wrapper
+    using child_visitor_t = std::function<void(std::shared_ptr<ISampleSource>& child)>;
+
+    // What a render cache keys a graph on: the type of every node, the parameters its output depends on
+    // and its children in order, written out byte for byte so two graphs only match if they would render
+    // the same samples. A node reached a second time is written as a reference back to the first, a shared
+    // node advances once for every parent that pulls on it and doesn't sound like two copies of itself.
+    class GraphDescription
+    {
+    public:
+        template <typename T>
+        void Add(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "only plain values can be added byte for byte");
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        void Add(const std::string& text)
+        {
+            Add(text.size());
+            bytes.append(text);
+        }
+        // describes child as the next input of the node being described. a null child is fine, it's written as such
+        bool Child(const ISampleSource* child);
+        const std::string& Bytes() const { return bytes; }
+    private:
+        std::string bytes;
+        std::unordered_map<const ISampleSource*, uint32_t> visited;
+    };
+
     class ISampleSource
     {
     public:
-        virtual double Sample() = 0;
+        virtual sample_t Sample() = 0;
+        // fills every frame of the block, in order, as if Sample() had been called block.size() times.
+        // sources that only know how to do Sample() get this per-sample fallback for free
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            for (sample_t& sample : block)
+            {
+                sample = Sample();
+            }
+        }
+        // hands every input this node pulls samples from to the visitor. leaves have none
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+        }
+        // puts the node back the way it was constructed, so it can be reused for a new note.
+        // the default resets every input, nodes with their own phase or position override it
+        virtual void Reset()
+        {
+            ForEachChild([](std::shared_ptr<ISampleSource>& child)
+            {
+                child->Reset();
+            });
+        }
+        // writes what the node's output depends on into the description: its parameters as of Reset() and its
+        // children, through description.Child(). false if the output isn't a function of those alone, because
+        // it follows live control input or just doesn't say, which is the default
+        virtual bool Describe(GraphDescription& description) const
+        {
+            return false;
+        }
+        // the node this one is described as. a decorator that only watches the node it wraps hands that one
+        // back, so a decorated graph describes exactly as the bare one does
+        virtual const ISampleSource* DescribedNode() const
+        {
+            return this;
+        }
         virtual ~ISampleSource() = 0;
     };
 
     typedef std::vector<std::shared_ptr<Neato::ISampleSource>> sample_source_vector_t;
+
+    // grows the scratch vector if the block is bigger than anything seen so far and hands back the front of it
+    inline std::span<sample_t> ScratchBlock(std::vector<sample_t>& scratch, std::size_t frame_count)
+    {
+        if (scratch.size() < frame_count)
+        {
+            scratch.resize(frame_count);
+        }
+        return std::span<sample_t>(scratch.data(), frame_count);
+    }
+
+    void SumSourcesIntoBlock(sample_source_vector_t& sources, std::span<sample_t> block, std::vector<sample_t>& scratch);
+
+    // renders one block of frame_count from every node under root, each on its own, and resets it after. every
+    // scratch block in the graph is grown before the audio thread gets there, including ones under sounds a
+    // sequence hasn't started yet
+    void PrimeScratchBlocks(std::shared_ptr<ISampleSource>& root, std::size_t frame_count);
     
     class AudioRadians : public ISampleSource
     {
@@ -35,11 +127,12 @@ namespace Neato
         : value(0.0f)
         , sample_rate(sample_rate_in)
         , frequency_modulator(frequency_modulator_in)
+        , initial_frequency(frequency_in)
         {
             setFrequency(frequency_in);
         }
         AudioRadians() = delete;
-        virtual double Sample()
+        virtual sample_t Sample()
         {
             double ret_value = value;
             if(frequency_modulator)
@@ -53,6 +146,56 @@ namespace Neato
             }
             return ret_value;
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            if (frequency_modulator)
+            {
+                // the modulator output lands in the block first, then gets swapped for the phase it produced
+                frequency_modulator->SampleBlock(block);
+                for (sample_t& sample : block)
+                {
+                    const double new_frequency = sample;
+                    sample = value;
+                    AudioRadians::setFrequency(new_frequency);
+                    value += increment;
+                    if (value > two_pi)
+                    {
+                        value -= two_pi;
+                    }
+                }
+            }
+            else
+            {
+                for (sample_t& sample : block)
+                {
+                    sample = value;
+                    value += increment;
+                    if (value > two_pi)
+                    {
+                        value -= two_pi;
+                    }
+                }
+            }
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            if (frequency_modulator)
+            {
+                visitor(frequency_modulator);
+            }
+        }
+        virtual void Reset()
+        {
+            value = 0.0;
+            setFrequency(initial_frequency);
+            ISampleSource::Reset();
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(initial_frequency);
+            description.Add(sample_rate);
+            return description.Child(frequency_modulator.get());
+        }
         virtual double getFrequency() {return frequency;}
         virtual void setFrequency(double new_frequency)
         {
@@ -66,23 +209,54 @@ namespace Neato
         double frequency;
         std::shared_ptr<ISampleSource> frequency_modulator;
         const double sample_rate;
+        const double initial_frequency;
     };
 
+    // the phase can move every sample, so this evaluates a polynomial sine instead of reading a table.
+    // lower accuracy tiers are cheaper, see SineAccuracy
     class MutableSine : public ISampleSource
     {
     public:
-        MutableSine(double frequency_in, double sample_rate_in, std::shared_ptr<ISampleSource> frequency_modulator_in)
-        : theta(frequency_in, sample_rate_in, frequency_modulator_in), value(0.0f)
+        MutableSine(double frequency_in, double sample_rate_in, std::shared_ptr<ISampleSource> frequency_modulator_in, SineAccuracy accuracy_in = SineAccuracy::full)
+        : theta(frequency_in, sample_rate_in, frequency_modulator_in), value(0.0f), accuracy(accuracy_in)
         {
             
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
-            double ret_value = value;
-            value = std::sin(theta.Sample());
+            sample_t ret_value = value;
+            value = FastSin(theta.Sample(), accuracy);
             return ret_value;
         }
-        double Value() const { return value;}
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            if (block.empty())
+            {
+                return;
+            }
+            theta.SampleBlock(block);
+            FastSinBlock(block, block, accuracy);
+            // output runs one sample behind the phase, like Sample()
+            const sample_t next_value = block.back();
+            std::copy_backward(block.begin(), block.end() - 1, block.end());
+            block[0] = value;
+            value = next_value;
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            theta.ForEachChild(visitor);
+        }
+        virtual void Reset()
+        {
+            theta.Reset();
+            value = 0.0;
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(accuracy);
+            return theta.Describe(description);
+        }
+        sample_t Value() const { return value;}
         virtual double getFrequency() {return theta.getFrequency();}
         virtual void setFrequency(double new_frequency)
         {
@@ -90,74 +264,103 @@ namespace Neato
         }
     private:
         AudioRadians theta;
-        double value;
+        sample_t value;
+        SineAccuracy accuracy;
     };
 
+    // reads the shared sine table at the playback frequency
     class ConstSine : public ISampleSource
     {
     public:
-        ConstSine(double frequency_in, double sample_rate_in) : index(0)
+        ConstSine(double frequency_in, double sample_rate_in, Interpolation interpolation_in = Interpolation::linear)
+            : wavetable(GetWavetable(WaveShape::sine))
+            , table(wavetable->LevelForFrequency(frequency_in, sample_rate_in))
+            , phase(0)
+            , increment(WavetablePhaseIncrement(frequency_in, sample_rate_in))
+            , interpolation(interpolation_in)
         {
-            uint32_t samples_per_cycle = uint32_t (sample_rate_in / frequency_in);// + 1;
-            sine_table.reserve(samples_per_cycle);
-            AudioRadians theta(frequency_in, sample_rate_in, std::shared_ptr<ISampleSource>());
-            for (uint32_t i = 0; i < samples_per_cycle; i++)
-            {
-                sine_table.push_back(std::sin(theta.Sample()));
-            }
         }
-        double Sample()
+        sample_t Sample()
         {
-            double value = sine_table[index];
-            index += 1;
-            if (index >= sine_table.size())
-            {
-                index = 0;
-            }
+            const sample_t value = ReadWavetable(table, phase, interpolation);
+            phase += increment;
             return value;
         }
-        double Value() const { return sine_table[index];}
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            ReadWavetableBlock(table, phase, increment, interpolation, block);
+        }
+        virtual void Reset()
+        {
+            phase = 0;
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(wavetable->Shape());
+            description.Add(wavetable->LevelOf(table));
+            description.Add(increment);
+            description.Add(interpolation);
+            return true;
+        }
+        sample_t Value() const { return ReadWavetable(table, phase, interpolation);}
+        const sample_t* Table() const { return table; }
+        uint32_t Phase() const { return phase; }
+        uint32_t Increment() const { return increment; }
+        Interpolation GetInterpolation() const { return interpolation; }
 
     private:
-        std::vector<double> sine_table;
-        std::vector<double>::size_type index;
+        std::shared_ptr<const Wavetable> wavetable;
+        const sample_t* table;
+        uint32_t phase;
+        uint32_t increment;
+        Interpolation interpolation;
     };
 
+    // reads the shared band-limited saw table, at the mip level that doesn't alias at the playback frequency
     class ConstSaw : public ISampleSource
     {
     public:
-        ConstSaw(double frequency_in, double sample_rate_in, bool negative_slope_in)
-            :index(0)
+        ConstSaw(double frequency_in, double sample_rate_in, bool negative_slope_in, Interpolation interpolation_in = Interpolation::linear)
+            : wavetable(GetWavetable(negative_slope_in ? WaveShape::saw_down : WaveShape::saw_up))
+            , table(wavetable->LevelForFrequency(frequency_in, sample_rate_in))
+            , phase(0)
+            , increment(WavetablePhaseIncrement(frequency_in, sample_rate_in))
+            , interpolation(interpolation_in)
         {
-            uint32_t samples_per_cycle = uint32_t (sample_rate_in / frequency_in);
-            saw_table.reserve(samples_per_cycle);
-            AudioRadians theta(frequency_in, sample_rate_in, std::shared_ptr<ISampleSource>());
-            for (uint32_t i = 0; i < samples_per_cycle; i++)
-            {
-                if (negative_slope_in)
-                {
-                    saw_table.push_back(1.0 - (2.0 * (theta.Sample() / two_pi)));
-                }
-                else
-                {
-                    saw_table.push_back((2.0 * (theta.Sample() / two_pi)) - 1.0);
-                }
-            }
         }
-        double Sample()
+        sample_t Sample()
         {
-            double value = saw_table[index];
-            index += 1;
-            if (index >= saw_table.size())
-            {
-                index = 0;
-            }
+            const sample_t value = ReadWavetable(table, phase, interpolation);
+            phase += increment;
             return value;
         }
-        double Value() const { return saw_table[index];}
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            ReadWavetableBlock(table, phase, increment, interpolation, block);
+        }
+        virtual void Reset()
+        {
+            phase = 0;
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(wavetable->Shape());
+            description.Add(wavetable->LevelOf(table));
+            description.Add(increment);
+            description.Add(interpolation);
+            return true;
+        }
+        sample_t Value() const { return ReadWavetable(table, phase, interpolation);}
+        const sample_t* Table() const { return table; }
+        uint32_t Phase() const { return phase; }
+        uint32_t Increment() const { return increment; }
+        Interpolation GetInterpolation() const { return interpolation; }
     private:
-        std::vector<double> saw_table;
-        std::vector<double>::size_type index;
+        std::shared_ptr<const Wavetable> wavetable;
+        const sample_t* table;
+        uint32_t phase;
+        uint32_t increment;
+        Interpolation interpolation;
     };
 
     class MutableSaw : public ISampleSource
@@ -170,9 +373,9 @@ namespace Neato
         {
             
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
-            double ret_value = value;
+            sample_t ret_value = value;
             if (negative_slope)
             {
                 value = 1.0 - (2.0 * (theta.Sample() / two_pi));
@@ -183,6 +386,32 @@ namespace Neato
             }
             return ret_value;
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            theta.SampleBlock(block);
+            const double slope = negative_slope ? -2.0 : 2.0;
+            const double offset = negative_slope ? 1.0 : -1.0;
+            for (sample_t& sample : block)
+            {
+                const sample_t next_value = offset + (slope * (sample / two_pi));
+                sample = value;
+                value = next_value;
+            }
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            theta.ForEachChild(visitor);
+        }
+        virtual void Reset()
+        {
+            theta.Reset();
+            value = 0.0;
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(negative_slope);
+            return theta.Describe(description);
+        }
         virtual double getFreguency() {return theta.getFrequency();}
         virtual void setFrequency(double new_frequency)
         {
@@ -190,37 +419,149 @@ namespace Neato
         }
     private:
         AudioRadians theta;
-        double value;
+        sample_t value;
         bool negative_slope;
     };
 
-    class WhiteNoise : public ISampleSource
+    // the seed, stream and position the noise sources below share, see noise.hpp. the output is a function of
+    // those three, so the same seed and stream render the same bits every run, and a render split across
+    // threads can Seek() each part to where it starts
+    class CounterNoise : public ISampleSource
     {
     public:
+        CounterNoise(uint64_t seed_in, uint64_t stream_in)
+        : seed(seed_in)
+        , stream(stream_in)
+        , generator(seed_in, stream_in)
+        , position(0)
+        {
+
+        }
+        virtual sample_t Sample()
+        {
+            sample_t sample = 0;
+            SampleBlock(std::span<sample_t>(&sample, 1));
+            return sample;
+        }
+        virtual void Reset()
+        {
+            Seek(0);
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(seed);
+            description.Add(stream);
+            return true;
+        }
+        // the next sample out is sample position_in of the stream
+        virtual void Seek(uint64_t position_in)
+        {
+            position = position_in;
+        }
+        uint64_t Position() const { return position; }
+        uint64_t Seed() const { return seed; }
+        uint64_t Stream() const { return stream; }
+    protected:
+        const uint64_t seed;
+        const uint64_t stream;
+        NoiseGenerator generator;
+        uint64_t position;
+    };
+
+    // uniform in [-1, 1)
+    class WhiteNoise : public CounterNoise
+    {
+    public:
+        // a different seed every time, the only noise here that can't be rendered the same way twice
         WhiteNoise()
-        : random_engine(random_device())
-        , random_dist(-1, 1)// Choose a random mean between -1 and 1
+        : WhiteNoise(std::random_device()())
+        {
+            
+        }
+        explicit WhiteNoise(uint64_t seed_in, uint64_t stream_in = 0)
+        : CounterNoise(seed_in, stream_in)
         {
             
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
-            return random_dist(random_engine);
+            return generator.Uniform(position++);
+        }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            generator.FillUniform(position, block);
+            position += block.size();
+        }
+    };
+
+    // -3 dB per octave, the white noise of the same seed and stream through pink_filter_t
+    class PinkNoise : public CounterNoise
+    {
+    public:
+        explicit PinkNoise(uint64_t seed_in, uint64_t stream_in = 0)
+        : CounterNoise(seed_in, stream_in)
+        {
+
+        }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            generator.FillUniform(position, block);
+            filter.Process(block);
+            position += block.size();
+        }
+        // the filter has to see everything before the new position, so this runs it from the start of the
+        // stream, or from here when seeking forward. not something to do on the render thread
+        virtual void Seek(uint64_t position_in)
+        {
+            if (position_in < position)
+            {
+                filter.Reset();
+                position = 0;
+            }
+            sample_t skipped[256];
+            while (position < position_in)
+            {
+                SampleBlock(std::span<sample_t>(skipped, static_cast<std::size_t>(std::min<uint64_t>(std::size(skipped), position_in - position))));
+            }
         }
     private:
-        std::random_device random_device;
-        std::default_random_engine random_engine;
-        std::uniform_real_distribution<double> random_dist;
+        pink_filter_t filter;
+    };
+
+    // zero mean, unit variance, so scale it to taste
+    class GaussianNoise : public CounterNoise
+    {
+    public:
+        explicit GaussianNoise(uint64_t seed_in, uint64_t stream_in = 0)
+        : CounterNoise(seed_in, stream_in)
+        {
+
+        }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            generator.FillGaussian(position, block);
+            position += block.size();
+        }
     };
     
     class DCOffset : public ISampleSource
     {
     public:
         DCOffset(double value_in) : value(value_in){}
-        virtual double Sample()
+        virtual sample_t Sample()
         {
             return value;
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            std::fill(block.begin(), block.end(), value);
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(value);
+            return true;
+        }
+        double Value() const { return value; }
     private:
         double value;
     };
@@ -232,17 +573,37 @@ namespace Neato
         {
             
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
-            double ret_val = 0;
+            sample_t ret_val = 0;
             std::for_each(sample_sources.begin(), sample_sources.end(), [&ret_val](std::shared_ptr<ISampleSource>& sampler)
             {
                 ret_val += sampler->Sample();
             });
             return ret_val;
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            SumSourcesIntoBlock(sample_sources, block, scratch);
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            for (std::shared_ptr<ISampleSource>& source : sample_sources)
+            {
+                visitor(source);
+            }
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(sample_sources.size());
+            return std::all_of(sample_sources.begin(), sample_sources.end(), [&description](const std::shared_ptr<ISampleSource>& source)
+            {
+                return description.Child(source.get());
+            });
+        }
     private:
         std::vector<std::shared_ptr<ISampleSource>> sample_sources;
+        std::vector<sample_t> scratch;
     };
 
     class MutableSummer : public ISampleSource
@@ -270,7 +631,9 @@ namespace Neato
             auto it = std::find(sample_sources.begin(), sample_sources.end(), source);
             if (it != sample_sources.end())
             {
-                sample_sources.erase(it);
+                // order doesn't matter to a sum, so fill the hole from the back instead of shifting everything down
+                *it = std::move(sample_sources.back());
+                sample_sources.pop_back();
             }
         }
         uint32_t SourceCount() const
@@ -282,17 +645,37 @@ namespace Neato
             auto it = std::find(sample_sources.begin(), sample_sources.end(), source);
             return (it != sample_sources.end());
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
-            double ret_val = 0;
+            sample_t ret_val = 0;
             std::for_each(sample_sources.begin(), sample_sources.end(), [&ret_val](std::shared_ptr<ISampleSource>& sampler)
             {
                 ret_val += sampler->Sample();
             });
             return ret_val;
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            SumSourcesIntoBlock(sample_sources, block, scratch);
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            for (std::shared_ptr<ISampleSource>& source : sample_sources)
+            {
+                visitor(source);
+            }
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            description.Add(sample_sources.size());
+            return std::all_of(sample_sources.begin(), sample_sources.end(), [&description](const std::shared_ptr<ISampleSource>& source)
+            {
+                return description.Child(source.get());
+            });
+        }
     private:
         std::vector<std::shared_ptr<ISampleSource>> sample_sources;
+        std::vector<sample_t> scratch;
     };
     
     class SampleMultiplier : public ISampleSource
@@ -309,13 +692,33 @@ namespace Neato
         {
             source2 = std::make_shared<DCOffset>(multiplier);
         }
-        virtual double Sample()
+        virtual sample_t Sample()
         {
             return source1->Sample() * source2->Sample();
         }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            std::span<sample_t> gains = ScratchBlock(scratch, block.size());
+            source1->SampleBlock(block);
+            source2->SampleBlock(gains);
+            for (std::size_t i = 0; i < block.size(); i++)
+            {
+                block[i] *= gains[i];
+            }
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            visitor(source1);
+            visitor(source2);
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            return description.Child(source1.get()) && description.Child(source2.get());
+        }
     private:
         std::shared_ptr<ISampleSource> source1;
         std::shared_ptr<ISampleSource> source2;
+        std::vector<sample_t> scratch;
     };
     
     std::vector<double> FrequenciesFromMultiples(double center_freq, std::vector<double>&& frequency_multiples);
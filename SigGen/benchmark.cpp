@@ -0,0 +1,314 @@
+//
+//  benchmark.cpp
+//  SigGen
+//
+
+#include <chrono>
+#include "benchmark.hpp"
+#include "envelope.hpp"
+#include "sequence.h"
+#include "oscillator_bank.hpp"
+#include "dsp_expressions.hpp"
+#include "voice_pool.hpp"
+#include "parallel_graph.hpp"
+
+namespace
+{
+    // keeps the optimizer from throwing the rendered samples away
+    volatile double benchmark_sink = 0.0;
+
+    std::shared_ptr<Neato::ISampleSource> CreateFrequencyModulator(double center_freq, double sample_rate)
+    {
+        // same modulator shape as the FM bell, a saw with gain riding on a DC center frequency
+        std::shared_ptr<Neato::ISampleSource> saw = std::make_shared<Neato::ConstSaw>(1.4 * center_freq, sample_rate, false);
+        Neato::sample_source_vector_t signals = {std::make_shared<Neato::SampleMultiplier>(saw, 160.0), std::make_shared<Neato::DCOffset>(center_freq)};
+        return std::make_shared<Neato::SampleSummer>(signals);
+    }
+
+    std::shared_ptr<Neato::ISampleSource> CreateExpressionFrequencyModulatedSine(double center_freq, double sample_rate)
+    {
+        // MutableSine/fm as one inlined expression
+        Neato::Expr::Sum frequency_modulator{Neato::Expr::Mul{Neato::Expr::Saw{1.4 * center_freq, sample_rate, false}, Neato::Expr::Const{160.0}}, Neato::Expr::Const{center_freq}};
+        return Neato::MakeExpressionSource(Neato::Expr::Sine{frequency_modulator, sample_rate});
+    }
+
+    // MutableSine/fm as it was before the polynomial sines, for the cost column to be read against
+    class LibmSine : public Neato::ISampleSource
+    {
+    public:
+        LibmSine(double frequency, double sample_rate, std::shared_ptr<Neato::ISampleSource> frequency_modulator)
+            : theta(frequency, sample_rate, frequency_modulator)
+        {
+        }
+        virtual Neato::sample_t Sample()
+        {
+            return std::sin(theta.Sample());
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            theta.SampleBlock(block);
+            for (Neato::sample_t& sample : block)
+            {
+                sample = std::sin(sample);
+            }
+        }
+    private:
+        Neato::AudioRadians theta;
+    };
+
+    // measured over a few cycles either side of zero, the range an oscillator phase lives in
+    template <Neato::SineAccuracy accuracy>
+    double MeasureSineError()
+    {
+        double max_error = 0.0;
+        for (int32_t i = -400000; i <= 400000; i++)
+        {
+            const double radians = i * 1.0e-4;
+            max_error = std::max(max_error, std::abs(Neato::FastSin<accuracy>(radians) - std::sin(radians)));
+        }
+        return max_error;
+    }
+
+    std::shared_ptr<Neato::ISampleSource> CreateFrequencyModulatedSummer(uint32_t voice_count, double sample_rate)
+    {
+        Neato::sample_source_vector_t voices;
+        for (uint32_t i = 0; i < voice_count; i++)
+        {
+            const double center_freq = 110.0 + 17.0 * i;
+            voices.push_back(std::make_shared<Neato::MutableSine>(center_freq, sample_rate, CreateFrequencyModulator(center_freq, sample_rate)));
+        }
+        return std::make_shared<Neato::SampleSummer>(voices);
+    }
+
+    std::shared_ptr<Neato::ISampleSource> CreateSummerWithFanOut(uint32_t fan_out, double sample_rate)
+    {
+        std::vector<double> frequencies;
+        frequencies.reserve(fan_out);
+        for (uint32_t i = 0; i < fan_out; i++)
+        {
+            frequencies.push_back(110.0 + 17.0 * i);
+        }
+        return std::make_shared<Neato::SampleSummer>(Neato::CreateConstSineArray(frequencies, sample_rate));
+    }
+
+    std::shared_ptr<Neato::ISampleSource> CreateBankWithPartials(uint32_t partial_count, double sample_rate)
+    {
+        std::vector<double> frequencies;
+        frequencies.reserve(partial_count);
+        for (uint32_t i = 0; i < partial_count; i++)
+        {
+            frequencies.push_back(110.0 + 17.0 * i);
+        }
+        return Neato::CreateOscillatorBank(frequencies, std::vector<double>(partial_count, 1.0 / partial_count), sample_rate);
+    }
+
+    std::shared_ptr<Neato::ISampleSource> CreateNoteSequence(double sample_rate)
+    {
+        // short overlapping notes so the sequence is busy adding and removing sources
+        std::vector<Neato::sequence_element> elements;
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            Neato::sequence_element element;
+            std::shared_ptr<Neato::ISampleSource> note = std::make_shared<Neato::ConstSine>(220.0 + 11.0 * (i % 16), sample_rate);
+            element.base_sound = Neato::CreateSoundWithDuration(note, 0.05, sample_rate);
+            element.delay_to_start = 0.025 * i;
+            elements.push_back(element);
+        }
+        return Neato::CreateSequence(elements, sample_rate);
+    }
+
+    // plays a bell from a voice pool every note_spacing samples, splitting blocks at the note starts. each
+    // note is let go held_notes notes later and rings out its release
+    class PooledNoteTrigger : public Neato::ISampleSource
+    {
+    public:
+        PooledNoteTrigger(double sample_rate)
+            : pool(Neato::CreateVoicePool(CreatePooledBell, 16, sample_rate, Neato::VoiceStealPolicy::oldest))
+            , note_spacing(static_cast<uint64_t>(0.05 * sample_rate))
+            , samples_to_next_note(0)
+            , note_count(0)
+        {
+        }
+        virtual Neato::sample_t Sample()
+        {
+            Neato::sample_t value = 0;
+            SampleBlock(std::span<Neato::sample_t>(&value, 1));
+            return value;
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            std::size_t written = 0;
+            while (written < block.size())
+            {
+                if (samples_to_next_note == 0)
+                {
+                    pool->NoteOn(note_count, 220.0 + 11.0 * (note_count % 16), 0.25);
+                    if (note_count >= held_notes)
+                    {
+                        pool->NoteOff(note_count - held_notes);
+                    }
+                    note_count++;
+                    samples_to_next_note = note_spacing;
+                }
+                const std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(block.size() - written, samples_to_next_note));
+                pool->SampleBlock(block.subspan(written, count));
+                written += count;
+                samples_to_next_note -= count;
+            }
+        }
+    private:
+        static Neato::pooled_voice_t CreatePooledBell(double sample_rate)
+        {
+            std::shared_ptr<Neato::MutableSine> carrier = std::make_shared<Neato::MutableSine>(440.0, sample_rate, std::shared_ptr<Neato::ISampleSource>());
+            Neato::adsr_params_t bell;
+            bell.attack_time = 0.002;
+            bell.decay_time = 0.15;
+            bell.sustain_gain = 0.4;
+            bell.release_time = 0.4;
+            std::shared_ptr<Neato::IGatedEnvelope> envelope = Neato::CreateADSREnvelope(bell, sample_rate, 1.0);
+            Neato::pooled_voice_t voice;
+            voice.source = std::make_shared<Neato::SampleMultiplier>(carrier, envelope);
+            voice.tune = [carrier](double frequency) { carrier->setFrequency(frequency); };
+            Neato::GateWithEnvelope(voice, envelope);
+            return voice;
+        }
+        static constexpr uint32_t held_notes = 4;
+        std::shared_ptr<Neato::VoicePool> pool;
+        const uint64_t note_spacing;
+        uint64_t samples_to_next_note;
+        uint32_t note_count;
+    };
+
+    double TimeRender(Neato::ISampleSource& source, const std::string& path, uint64_t sample_count, uint32_t block_frames, std::vector<Neato::sample_t>& block)
+    {
+        double sum = 0.0;
+        const auto start_time = std::chrono::steady_clock::now();
+        if (path == "sample")
+        {
+            for (uint64_t i = 0; i < sample_count; i++)
+            {
+                sum += source.Sample();
+            }
+        }
+        else
+        {
+            for (uint64_t rendered = 0; rendered < sample_count; rendered += block_frames)
+            {
+                std::span<Neato::sample_t> samples = Neato::ScratchBlock(block, std::min<uint64_t>(block_frames, sample_count - rendered));
+                source.SampleBlock(samples);
+                sum += samples[0];
+            }
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start_time;
+        benchmark_sink = benchmark_sink + sum;
+        return elapsed.count();
+    }
+}
+
+std::vector<Neato::benchmark_case_t> Neato::DefaultBenchmarkCases()
+{
+    std::vector<benchmark_case_t> cases =
+    {
+        {"ConstSine", [](double sample_rate) { return std::make_shared<ConstSine>(440.0, sample_rate); }},
+        {"ConstSine/cubic", [](double sample_rate) { return std::make_shared<ConstSine>(440.0, sample_rate, Interpolation::cubic); }},
+        {"MutableSine", [](double sample_rate) { return std::make_shared<MutableSine>(440.0, sample_rate, std::shared_ptr<ISampleSource>()); }},
+        {"MutableSine/fm", [](double sample_rate) { return std::make_shared<MutableSine>(440.0, sample_rate, CreateFrequencyModulator(440.0, sample_rate)); }, MeasureSineError<SineAccuracy::full>()},
+        {"MutableSine/fm/std::sin", [](double sample_rate) { return std::make_shared<LibmSine>(440.0, sample_rate, CreateFrequencyModulator(440.0, sample_rate)); }, 0.0},
+        {"MutableSine/fm/low", [](double sample_rate) { return std::make_shared<MutableSine>(440.0, sample_rate, CreateFrequencyModulator(440.0, sample_rate), SineAccuracy::low); }, MeasureSineError<SineAccuracy::low>()},
+        {"MutableSine/fm/medium", [](double sample_rate) { return std::make_shared<MutableSine>(440.0, sample_rate, CreateFrequencyModulator(440.0, sample_rate), SineAccuracy::medium); }, MeasureSineError<SineAccuracy::medium>()},
+        {"MutableSine/fm/high", [](double sample_rate) { return std::make_shared<MutableSine>(440.0, sample_rate, CreateFrequencyModulator(440.0, sample_rate), SineAccuracy::high); }, MeasureSineError<SineAccuracy::high>()},
+        {"ExpressionSine/fm", [](double sample_rate) { return CreateExpressionFrequencyModulatedSine(440.0, sample_rate); }},
+        {"ConstSaw", [](double sample_rate) { return std::make_shared<ConstSaw>(440.0, sample_rate, false); }},
+        {"MutableSaw", [](double sample_rate) { return std::make_shared<MutableSaw>(440.0, sample_rate, false, std::shared_ptr<ISampleSource>()); }},
+        {"WhiteNoise", [](double sample_rate) { return std::make_shared<WhiteNoise>(1); }},
+        {"PinkNoise", [](double sample_rate) { return std::make_shared<PinkNoise>(1); }},
+        {"GaussianNoise", [](double sample_rate) { return std::make_shared<GaussianNoise>(1); }},
+        {"SampleMultiplier", [](double sample_rate) { return std::make_shared<SampleMultiplier>(std::make_shared<ConstSine>(440.0, sample_rate), std::make_shared<ConstSine>(5.0, sample_rate)); }},
+        {"Bell1Envelope", [](double sample_rate) { return CreateEnvelope(EnvelopeID::Bell1, sample_rate, 1.0); }},
+        {"ADSREnvelope", [](double sample_rate) { return CreateADSREnvelope(adsr_params_t(), sample_rate, 1.0); }},
+        {"SequenceSampleSource", [](double sample_rate) { return CreateNoteSequence(sample_rate); }},
+        {"VoicePool", [](double sample_rate) { return std::make_shared<PooledNoteTrigger>(sample_rate); }},
+    };
+    for (uint32_t fan_out = 2; fan_out <= 256; fan_out *= 2)
+    {
+        cases.push_back({"SampleSummer/" + std::to_string(fan_out), [fan_out](double sample_rate) { return CreateSummerWithFanOut(fan_out, sample_rate); }});
+    }
+    cases.push_back({"SampleSummer/fm/64", [](double sample_rate) { return CreateFrequencyModulatedSummer(64, sample_rate); }});
+    cases.push_back({"ParallelGraph/fm/64", [](double sample_rate) { return CreateParallelGraph(CreateFrequencyModulatedSummer(64, sample_rate), DefaultWorkerCount()); }});
+    for (uint32_t partial_count = 2; partial_count <= 256; partial_count *= 2)
+    {
+        cases.push_back({"OscillatorBank/" + std::to_string(partial_count), [partial_count](double sample_rate) { return CreateBankWithPartials(partial_count, sample_rate); }});
+    }
+    return cases;
+}
+
+std::vector<Neato::benchmark_result_t> Neato::RunBenchmarks(const std::vector<benchmark_case_t>& cases, const benchmark_options_t& options)
+{
+    std::vector<benchmark_result_t> results;
+    std::vector<sample_t> block(options.block_frames);
+    for (const benchmark_case_t& benchmark_case : cases)
+    {
+        for (double sample_rate : options.sample_rates)
+        {
+            const uint64_t sample_count = static_cast<uint64_t>(sample_rate * options.seconds_of_audio);
+            for (const char* path : {"sample", "block"})
+            {
+                double best_ns = 0.0;
+                for (uint32_t repetition = 0; repetition < options.repetitions; repetition++)
+                {
+                    std::shared_ptr<ISampleSource> source = benchmark_case.factory(sample_rate);
+                    const double elapsed_ns = TimeRender(*source, path, sample_count, options.block_frames, block);
+                    if (repetition == 0 || elapsed_ns < best_ns)
+                    {
+                        best_ns = elapsed_ns;
+                    }
+                }
+                benchmark_result_t result;
+                result.name = benchmark_case.name;
+                result.path = path;
+                result.sample_rate = sample_rate;
+                result.block_frames = (result.path == "block") ? options.block_frames : 1;
+                result.samples = sample_count;
+                result.ns_per_sample = best_ns / sample_count;
+                result.samples_per_second = (best_ns > 0.0) ? (sample_count * 1.0e9 / best_ns) : 0.0;
+                result.max_error = benchmark_case.max_error;
+                results.push_back(result);
+            }
+        }
+    }
+    return results;
+}
+
+void Neato::WriteBenchmarkJson(std::ostream& out, const std::vector<benchmark_result_t>& results)
+{
+    out << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const benchmark_result_t& result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"path\": \"" << result.path
+            << "\", \"sample_rate\": " << result.sample_rate << ", \"block_frames\": " << result.block_frames
+            << ", \"samples\": " << result.samples << ", \"ns_per_sample\": " << result.ns_per_sample
+            << ", \"samples_per_second\": " << result.samples_per_second;
+        if (result.max_error >= 0.0)
+        {
+            out << ", \"max_error\": " << result.max_error;
+        }
+        out << "}" << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void Neato::WriteBenchmarkCsv(std::ostream& out, const std::vector<benchmark_result_t>& results)
+{
+    out << "name,path,sample_rate,block_frames,samples,ns_per_sample,samples_per_second,max_error\n";
+    for (const benchmark_result_t& result : results)
+    {
+        out << result.name << "," << result.path << "," << result.sample_rate << "," << result.block_frames << ","
+            << result.samples << "," << result.ns_per_sample << "," << result.samples_per_second << ",";
+        if (result.max_error >= 0.0)
+        {
+            out << result.max_error;
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  benchmark.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    struct benchmark_case_t
+    {
+        std::string name;
+        // builds a fresh node for the sample rate, construction is never part of the timing
+        std::function<std::shared_ptr<ISampleSource>(double sample_rate)> factory;
+        // worst case error against the exact function for approximations, negative when it doesn't apply
+        double max_error = -1.0;
+    };
+
+    struct benchmark_options_t
+    {
+        std::vector<double> sample_rates = {44100.0, 48000.0, 96000.0};
+        uint32_t block_frames = 512;
+        // seconds of audio rendered per measurement, best of repetitions is reported
+        double seconds_of_audio = 1.0;
+        uint32_t repetitions = 5;
+    };
+
+    struct benchmark_result_t
+    {
+        std::string name;
+        std::string path;   // "sample" for Sample() per frame, "block" for SampleBlock()
+        double sample_rate = 0.0;
+        uint32_t block_frames = 0;
+        uint64_t samples = 0;
+        double ns_per_sample = 0.0;
+        double samples_per_second = 0.0;
+        double max_error = -1.0;
+    };
+
+    std::vector<benchmark_case_t> DefaultBenchmarkCases();
+    std::vector<benchmark_result_t> RunBenchmarks(const std::vector<benchmark_case_t>& cases, const benchmark_options_t& options);
+    void WriteBenchmarkJson(std::ostream& out, const std::vector<benchmark_result_t>& results);
+    void WriteBenchmarkCsv(std::ostream& out, const std::vector<benchmark_result_t>& results);
+};
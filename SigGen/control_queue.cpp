@@ -0,0 +1,218 @@
+//
+//  control_queue.cpp
+//  SigGen
+//
+
+#include "control_queue.hpp"
+
+Neato::ControlledSource::ControlledSource(uint32_t command_capacity, uint32_t max_sources_in)
+    : commands(command_capacity)
+    , retired(max_sources_in + command_capacity)
+    , max_sources(max_sources_in)
+    , sample_time(0)
+{
+    pending.reserve(commands.Capacity());
+    sources.reserve(max_sources);
+    scratch.resize(4096);
+}
+
+uint32_t Neato::ControlledSource::AddParameter(parameter_setter_t setter)
+{
+    parameters.push_back(setter);
+    return static_cast<uint32_t>(parameters.size() - 1);
+}
+
+void Neato::ControlledSource::SetVoicePool(std::shared_ptr<VoicePool> pool)
+{
+    voice_pool = pool;
+}
+
+bool Neato::ControlledSource::Push(control_command_t& command)
+{
+    return commands.TryPush(command);
+}
+
+bool Neato::ControlledSource::SetParameter(uint32_t parameter, double value, uint64_t sample_time_in)
+{
+    control_command_t command;
+    command.type = ControlCommandType::set_parameter;
+    command.sample_time = sample_time_in;
+    command.target = parameter;
+    command.value = value;
+    return Push(command);
+}
+
+bool Neato::ControlledSource::AddSource(std::shared_ptr<ISampleSource> source, uint64_t sample_time_in)
+{
+    control_command_t command;
+    command.type = ControlCommandType::add_source;
+    command.sample_time = sample_time_in;
+    command.source = source;
+    return Push(command);
+}
+
+bool Neato::ControlledSource::RemoveSource(std::shared_ptr<ISampleSource> source, uint64_t sample_time_in)
+{
+    control_command_t command;
+    command.type = ControlCommandType::remove_source;
+    command.sample_time = sample_time_in;
+    command.source = source;
+    return Push(command);
+}
+
+bool Neato::ControlledSource::NoteOn(uint32_t note_id, double frequency, double gain, uint64_t sample_time_in)
+{
+    control_command_t command;
+    command.type = ControlCommandType::note_on;
+    command.sample_time = sample_time_in;
+    command.target = note_id;
+    command.value = frequency;
+    command.gain = gain;
+    return Push(command);
+}
+
+bool Neato::ControlledSource::NoteOff(uint32_t note_id, uint64_t sample_time_in)
+{
+    control_command_t command;
+    command.type = ControlCommandType::note_off;
+    command.sample_time = sample_time_in;
+    command.target = note_id;
+    return Push(command);
+}
+
+void Neato::ControlledSource::CollectRetired()
+{
+    std::shared_ptr<ISampleSource> source;
+    while (retired.TryPop(source))
+    {
+        source.reset();
+    }
+}
+
+void Neato::ControlledSource::Retire(std::shared_ptr<ISampleSource>& source)
+{
+    if (!retired.TryPush(source))
+    {
+        // nobody is collecting, the last reference goes here after all
+        source.reset();
+    }
+}
+
+void Neato::ControlledSource::DrainCommands()
+{
+    control_command_t command;
+    while (pending.size() < pending.capacity() && commands.TryPop(command))
+    {
+        // insert after everything due at the same time or earlier, so commands for one frame keep their order
+        auto position = pending.end();
+        while (position != pending.begin() && (position - 1)->sample_time > command.sample_time)
+        {
+            --position;
+        }
+        pending.insert(position, std::move(command));
+    }
+}
+
+void Neato::ControlledSource::Apply(control_command_t& command)
+{
+    switch (command.type)
+    {
+        case ControlCommandType::set_parameter:
+            if (command.target < parameters.size())
+            {
+                parameters[command.target](command.value);
+            }
+            break;
+        case ControlCommandType::add_source:
+            if (sources.size() < max_sources)
+            {
+                sources.push_back(std::move(command.source));
+            }
+            break;
+        case ControlCommandType::remove_source:
+        {
+            auto it = std::find(sources.begin(), sources.end(), command.source);
+            if (it != sources.end())
+            {
+                std::swap(*it, sources.back());
+                Retire(sources.back());
+                sources.pop_back();
+            }
+            break;
+        }
+        case ControlCommandType::note_on:
+            if (voice_pool)
+            {
+                voice_pool->NoteOn(command.target, command.value, command.gain);
+            }
+            break;
+        case ControlCommandType::note_off:
+            if (voice_pool)
+            {
+                voice_pool->NoteOff(command.target);
+            }
+            break;
+    }
+    // whatever the command still holds (a source that didn't fit, the caller's copy of a removed one) goes back too
+    if (command.source)
+    {
+        Retire(command.source);
+    }
+}
+
+Neato::sample_t Neato::ControlledSource::Sample()
+{
+    sample_t value = 0;
+    SampleBlock(std::span<sample_t>(&value, 1));
+    return value;
+}
+
+void Neato::ControlledSource::SampleBlock(std::span<sample_t> block)
+{
+    DrainCommands();
+    uint64_t now = sample_time.load(std::memory_order_relaxed);
+    std::size_t applied = 0;
+    std::size_t written = 0;
+    while (written < block.size())
+    {
+        while (applied < pending.size() && pending[applied].sample_time <= now)
+        {
+            Apply(pending[applied]);
+            applied++;
+        }
+        std::size_t count = block.size() - written;
+        if (applied < pending.size())
+        {
+            count = std::min<std::size_t>(count, static_cast<std::size_t>(pending[applied].sample_time - now));
+        }
+        std::span<sample_t> chunk = block.subspan(written, count);
+        SumSourcesIntoBlock(sources, chunk, scratch);
+        if (voice_pool)
+        {
+            std::span<sample_t> voices = ScratchBlock(scratch, count);
+            voice_pool->SampleBlock(voices);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                chunk[i] += voices[i];
+            }
+        }
+        written += count;
+        now += count;
+    }
+    pending.erase(pending.begin(), pending.begin() + applied);
+    sample_time.store(now, std::memory_order_release);
+}
+
+void Neato::ControlledSource::ForEachChild(const child_visitor_t& visitor)
+{
+    // render thread only, same as everything else that touches the live source list
+    for (std::shared_ptr<ISampleSource>& source : sources)
+    {
+        visitor(source);
+    }
+}
+
+std::shared_ptr<Neato::ControlledSource> Neato::CreateControlledSource(uint32_t command_capacity, uint32_t max_sources)
+{
+    return std::make_shared<ControlledSource>(command_capacity, max_sources);
+}
@@ -0,0 +1,183 @@
+//
+//  control_queue.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <atomic>
+#include "base_waveforms.hpp"
+#include "voice_pool.hpp"
+
+namespace Neato
+{
+    // Bounded multi-producer / single-consumer queue (Vyukov's ring with a sequence number per cell).
+    // Producers claim a cell with one compare-exchange and publish it with a release store. TryPop is
+    // wait-free: it looks at one cell and either takes it or reports the queue empty, so it's safe to
+    // call from the render thread. Capacity is rounded up to a power of two and fixed at construction.
+    template <typename T>
+    class CommandQueue
+    {
+    public:
+        explicit CommandQueue(uint32_t capacity_in)
+            : capacity(RoundUpToPowerOfTwo(capacity_in))
+            , cells(new cell_t[capacity])
+            , enqueue_position(0)
+            , dequeue_position(0)
+        {
+            for (uint64_t i = 0; i < capacity; i++)
+            {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        CommandQueue(const CommandQueue&) = delete;
+        CommandQueue& operator=(const CommandQueue&) = delete;
+
+        // any thread. false if the queue is full, the value is left alone in that case
+        bool TryPush(T& value)
+        {
+            uint64_t position = enqueue_position.load(std::memory_order_relaxed);
+            cell_t* cell = nullptr;
+            while (true)
+            {
+                cell = &cells[position & (capacity - 1)];
+                const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const int64_t difference = static_cast<int64_t>(sequence - position);
+                if (difference == 0)
+                {
+                    if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        // the one consumer thread only
+        bool TryPop(T& value)
+        {
+            cell_t& cell = cells[dequeue_position & (capacity - 1)];
+            const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (static_cast<int64_t>(sequence - (dequeue_position + 1)) < 0)
+            {
+                return false;
+            }
+            value = std::move(cell.value);
+            cell.sequence.store(dequeue_position + capacity, std::memory_order_release);
+            dequeue_position++;
+            return true;
+        }
+
+        uint32_t Capacity() const { return static_cast<uint32_t>(capacity); }
+
+    private:
+        struct cell_t
+        {
+            std::atomic<uint64_t> sequence;
+            T value;
+        };
+
+        static uint64_t RoundUpToPowerOfTwo(uint32_t value)
+        {
+            uint64_t rounded = 1;
+            while (rounded < value)
+            {
+                rounded <<= 1;
+            }
+            return rounded;
+        }
+
+        const uint64_t capacity;
+        std::unique_ptr<cell_t[]> cells;
+        alignas(64) std::atomic<uint64_t> enqueue_position;
+        alignas(64) uint64_t dequeue_position;
+    };
+
+    enum class ControlCommandType
+    {
+        set_parameter,
+        add_source,
+        remove_source,
+        note_on,
+        note_off
+    };
+
+    struct control_command_t
+    {
+        ControlCommandType type = ControlCommandType::set_parameter;
+        // frame on the ControlledSource's own clock. anything already in the past applies at the start of the next block
+        uint64_t sample_time = 0;
+        // parameter id or note id
+        uint32_t target = 0;
+        // parameter value or note frequency
+        double value = 0.0;
+        // note gain
+        double gain = 0.0;
+        std::shared_ptr<ISampleSource> source;
+    };
+
+    using parameter_setter_t = std::function<void(double value)>;
+
+    // A mix of live sources that other threads can change while it renders. Producers (UI, sequencer,
+    // network...) push timestamped commands. At the start of every block the render thread drains the
+    // queue without locking, and then splits the block at each command's frame so it lands sample-accurately.
+    //
+    // Parameters and the voice pool are wired up before rendering starts. Parameter setters, like
+    // MutableSine::setFrequency, only ever run on the render thread. Sources that get removed, or that
+    // don't fit, are handed back through a retire queue, so their memory is freed by whoever calls
+    // CollectRetired() and not on the render thread.
+    class ControlledSource : public ISampleSource
+    {
+    public:
+        ControlledSource(uint32_t command_capacity = 1024, uint32_t max_sources = 256);
+
+        // setup, before the first block
+        uint32_t AddParameter(parameter_setter_t setter);
+        void SetVoicePool(std::shared_ptr<VoicePool> pool);
+
+        // any thread. false if the command queue is full
+        bool SetParameter(uint32_t parameter, double value, uint64_t sample_time = 0);
+        bool AddSource(std::shared_ptr<ISampleSource> source, uint64_t sample_time = 0);
+        bool RemoveSource(std::shared_ptr<ISampleSource> source, uint64_t sample_time = 0);
+        bool NoteOn(uint32_t note_id, double frequency, double gain, uint64_t sample_time = 0);
+        bool NoteOff(uint32_t note_id, uint64_t sample_time = 0);
+        bool Push(control_command_t& command);
+        // frames rendered so far, for scheduling relative to now
+        uint64_t SampleTime() const { return sample_time.load(std::memory_order_acquire); }
+        // any one non-render thread. drops the references the render thread retired
+        void CollectRetired();
+
+        virtual sample_t Sample();
+        virtual void SampleBlock(std::span<sample_t> block);
+        virtual void ForEachChild(const child_visitor_t& visitor);
+
+    private:
+        void DrainCommands();
+        void Apply(control_command_t& command);
+        void Retire(std::shared_ptr<ISampleSource>& source);
+
+        CommandQueue<control_command_t> commands;
+        CommandQueue<std::shared_ptr<ISampleSource>> retired;
+        // drained but not due yet, kept in time order. capacity is reserved up front
+        std::vector<control_command_t> pending;
+        std::vector<parameter_setter_t> parameters;
+        std::shared_ptr<VoicePool> voice_pool;
+        sample_source_vector_t sources;
+        const uint32_t max_sources;
+        std::vector<sample_t> scratch;
+        std::atomic<uint64_t> sample_time;
+    };
+
+    std::shared_ptr<ControlledSource> CreateControlledSource(uint32_t command_capacity = 1024, uint32_t max_sources = 256);
+};
@@ -0,0 +1,179 @@
+//
+//  deadline_stats.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include "deadline_stats.hpp"
+
+namespace
+{
+    void StoreMax(std::atomic<uint64_t>& max_value, uint64_t value)
+    {
+        uint64_t current = max_value.load(std::memory_order_relaxed);
+        while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+uint32_t Neato::log_histogram_t::BucketOf(uint64_t value)
+{
+    if (value < sub_buckets)
+    {
+        return static_cast<uint32_t>(value);
+    }
+    // which power of two, then which step within it
+    const uint32_t shift = static_cast<uint32_t>(std::bit_width(value)) - 1 - sub_bucket_bits;
+    return (shift + 1) * sub_buckets + static_cast<uint32_t>((value >> shift) - sub_buckets);
+}
+
+uint64_t Neato::log_histogram_t::LowestValueIn(uint32_t bucket)
+{
+    if (bucket < sub_buckets)
+    {
+        return bucket;
+    }
+    const uint32_t shift = bucket / sub_buckets - 1;
+    return static_cast<uint64_t>(sub_buckets + bucket % sub_buckets) << shift;
+}
+
+uint64_t Neato::log_histogram_t::HighestValueIn(uint32_t bucket)
+{
+    return (bucket + 1 < bucket_count) ? LowestValueIn(bucket + 1) - 1 : UINT64_MAX;
+}
+
+uint64_t Neato::log_histogram_t::ValueAtPercentile(double percentile) const
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+    // the rank of the value wanted, counting from 1
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * total)));
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < counts.size(); bucket++)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+        {
+            return HighestValueIn(bucket);
+        }
+    }
+    return HighestValueIn(bucket_count - 1);
+}
+
+Neato::log_histogram_t Neato::DeadlineMonitor::atomic_histogram_t::Snapshot() const
+{
+    log_histogram_t snapshot;
+    snapshot.counts.resize(log_histogram_t::bucket_count);
+    for (uint32_t bucket = 0; bucket < log_histogram_t::bucket_count; bucket++)
+    {
+        snapshot.counts[bucket] = counts[bucket].load(std::memory_order_relaxed);
+        snapshot.total += snapshot.counts[bucket];
+    }
+    return snapshot;
+}
+
+void Neato::DeadlineMonitor::atomic_histogram_t::Clear()
+{
+    for (std::atomic<uint64_t>& count : counts)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+Neato::DeadlineMonitor::DeadlineMonitor(double sample_rate_in, double near_miss_threshold_in)
+    : sample_rate(sample_rate_in)
+    , near_miss_threshold(near_miss_threshold_in)
+    , callbacks(0)
+    , frames(0)
+    , near_misses(0)
+    , xruns(0)
+    , max_duration_ns(0)
+    , max_utilization(0)
+{
+}
+
+void Neato::DeadlineMonitor::SetSampleRate(double sample_rate_in)
+{
+    sample_rate = sample_rate_in;
+}
+
+void Neato::DeadlineMonitor::Record(std::chrono::steady_clock::duration elapsed, uint32_t frame_count)
+{
+    const uint64_t elapsed_ns = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+    frames.fetch_add(frame_count, std::memory_order_relaxed);
+    duration_ns.Record(elapsed_ns);
+    StoreMax(max_duration_ns, elapsed_ns);
+    if (frame_count == 0 || sample_rate <= 0.0)
+    {
+        // no buffer, no deadline to measure against
+        return;
+    }
+    const double budget_ns = frame_count * 1e9 / sample_rate;
+    const double used = elapsed_ns / budget_ns;
+    const uint64_t scaled = static_cast<uint64_t>(used * deadline_stats_t::utilization_scale);
+    utilization.Record(scaled);
+    StoreMax(max_utilization, scaled);
+    if (used > 1.0)
+    {
+        xruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (used >= near_miss_threshold)
+    {
+        near_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Neato::deadline_stats_t Neato::DeadlineMonitor::Snapshot() const
+{
+    deadline_stats_t stats;
+    stats.sample_rate = sample_rate;
+    stats.near_miss_threshold = near_miss_threshold;
+    stats.callbacks = callbacks.load(std::memory_order_relaxed);
+    stats.frames = frames.load(std::memory_order_relaxed);
+    stats.near_misses = near_misses.load(std::memory_order_relaxed);
+    stats.xruns = xruns.load(std::memory_order_relaxed);
+    stats.max_duration_ns = max_duration_ns.load(std::memory_order_relaxed);
+    stats.max_utilization = max_utilization.load(std::memory_order_relaxed) / deadline_stats_t::utilization_scale;
+    stats.duration_ns = duration_ns.Snapshot();
+    stats.utilization = utilization.Snapshot();
+    return stats;
+}
+
+void Neato::DeadlineMonitor::Clear()
+{
+    callbacks.store(0, std::memory_order_relaxed);
+    frames.store(0, std::memory_order_relaxed);
+    near_misses.store(0, std::memory_order_relaxed);
+    xruns.store(0, std::memory_order_relaxed);
+    max_duration_ns.store(0, std::memory_order_relaxed);
+    max_utilization.store(0, std::memory_order_relaxed);
+    duration_ns.Clear();
+    utilization.Clear();
+}
+
+void Neato::WriteDeadlineReport(std::ostream& out, const deadline_stats_t& stats)
+{
+    out << "Callbacks: " << stats.callbacks << " (" << stats.frames << " frames), "
+        << stats.near_misses << " near misses (>= " << stats.near_miss_threshold * 100.0 << "% of the budget), "
+        << stats.xruns << " xruns" << std::endl;
+    // a percentile is the top of its bucket, which can be past the largest value actually seen
+    const double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+    out << "Render time:";
+    for (double percentile : percentiles)
+    {
+        out << " p" << percentile << " " << std::min(stats.duration_ns.ValueAtPercentile(percentile), stats.max_duration_ns) / 1000.0 << " us,";
+    }
+    out << " max " << stats.max_duration_ns / 1000.0 << " us" << std::endl;
+    out << "Budget used:";
+    for (double percentile : percentiles)
+    {
+        out << " p" << percentile << " " << std::min(stats.UtilizationAtPercentile(percentile), stats.max_utilization) * 100.0 << "%,";
+    }
+    out << " max " << stats.max_utilization * 100.0 << "%" << std::endl;
+}
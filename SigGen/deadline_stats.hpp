@@ -0,0 +1,121 @@
+//
+//  deadline_stats.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace Neato
+{
+    // counts of values in log-linear buckets, HDR histogram style: every power of two is split into
+    // sub_buckets equal steps, so a bucket is never wider than 1/sub_buckets of the values in it and
+    // anything below sub_buckets is exact. 976 buckets cover the whole of uint64_t
+    struct log_histogram_t
+    {
+        static constexpr uint32_t sub_bucket_bits = 4;
+        static constexpr uint32_t sub_buckets = 1u << sub_bucket_bits;
+        static constexpr uint32_t bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+        static uint32_t BucketOf(uint64_t value);
+        // the smallest and largest value that land in bucket
+        static uint64_t LowestValueIn(uint32_t bucket);
+        static uint64_t HighestValueIn(uint32_t bucket);
+
+        // the highest value at or below which percentile (0-100) of the recorded values fall, 0 when empty
+        uint64_t ValueAtPercentile(double percentile) const;
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+    };
+
+    struct deadline_stats_t
+    {
+        double sample_rate = 0.0;
+        // a callback whose utilization reaches this fraction of its budget is a near miss
+        double near_miss_threshold = 0.0;
+        uint64_t callbacks = 0;
+        uint64_t frames = 0;
+        uint64_t near_misses = 0;
+        // callbacks that took longer than the buffer they filled lasts, the device had nothing to play
+        uint64_t xruns = 0;
+        uint64_t max_duration_ns = 0;
+        double max_utilization = 0.0;
+        // wall clock time of each Render call
+        log_histogram_t duration_ns;
+        // each call's time over frame_count / sample_rate, in 1/utilization_scale steps
+        log_histogram_t utilization;
+        static constexpr double utilization_scale = 10000.0;
+
+        double UtilizationAtPercentile(double percentile) const { return utilization.ValueAtPercentile(percentile) / utilization_scale; }
+    };
+
+    // Times render callbacks against the buffer period their frame_count implies. Record() is wait free and
+    // meant for the audio thread: a handful of relaxed atomic adds, no allocation. Snapshot() can be called
+    // from any other thread while that goes on; the counters are read one at a time, so a snapshot taken
+    // mid callback can be a callback out between them.
+    class DeadlineMonitor
+    {
+    public:
+        explicit DeadlineMonitor(double sample_rate_in = 0.0, double near_miss_threshold_in = 0.8);
+        // for when the stream is negotiated, not while callbacks are being recorded
+        void SetSampleRate(double sample_rate_in);
+        void Record(std::chrono::steady_clock::duration elapsed, uint32_t frame_count);
+        deadline_stats_t Snapshot() const;
+        // the caller makes sure nothing is recording
+        void Clear();
+
+    private:
+        class atomic_histogram_t
+        {
+        public:
+            void Record(uint64_t value) { counts[log_histogram_t::BucketOf(value)].fetch_add(1, std::memory_order_relaxed); }
+            log_histogram_t Snapshot() const;
+            void Clear();
+        private:
+            std::array<std::atomic<uint64_t>, log_histogram_t::bucket_count> counts = {};
+        };
+
+        double sample_rate;
+        const double near_miss_threshold;
+        std::atomic<uint64_t> callbacks;
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> near_misses;
+        std::atomic<uint64_t> xruns;
+        std::atomic<uint64_t> max_duration_ns;
+        std::atomic<uint64_t> max_utilization;
+        atomic_histogram_t duration_ns;
+        atomic_histogram_t utilization;
+    };
+
+    // times the Render call it is wrapped around
+    class callback_timer_t
+    {
+    public:
+        callback_timer_t(DeadlineMonitor& monitor_in, uint32_t frame_count_in)
+            : monitor(monitor_in)
+            , frame_count(frame_count_in)
+            , start(std::chrono::steady_clock::now())
+        {
+        }
+        ~callback_timer_t()
+        {
+            monitor.Record(std::chrono::steady_clock::now() - start, frame_count);
+        }
+        callback_timer_t(const callback_timer_t&) = delete;
+        callback_timer_t& operator=(const callback_timer_t&) = delete;
+    private:
+        DeadlineMonitor& monitor;
+        const uint32_t frame_count;
+        const std::chrono::steady_clock::time_point start;
+    };
+
+    // the counts, then render time and budget used at the 50th, 90th, 99th and 99.9th percentiles and the max
+    void WriteDeadlineReport(std::ostream& out, const deadline_stats_t& stats);
+};
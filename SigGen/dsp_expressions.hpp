@@ -0,0 +1,210 @@
+//
+//  dsp_expressions.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+
+// Compile time composition of the waveform kinds for instruments whose topology never changes.
+// Every node is a plain value type with Next() returning one sample, so a whole tree like
+//
+//     Expr::Mul{Expr::Sine{Expr::Sum{Expr::Mul{Expr::Saw{...}, Expr::Const{160.0}}, Expr::Const{f}}, sr}, Expr::Source{envelope}}
+//
+// is a single type the compiler can inline into one loop, no shared_ptr or virtual call per node.
+// Prepare(frame_count) runs once per block before the Next() calls so Source leaves can pull their
+// block from a regular ISampleSource. MakeExpressionSource() puts an ISampleSource face on the result.
+namespace Neato::Expr
+{
+    class Const
+    {
+    public:
+        explicit Const(double value_in) : value(static_cast<sample_t>(value_in)) {}
+        void Prepare(std::size_t frame_count) {}
+        sample_t Next() { return value; }
+        void Reset() {}
+        void ForEachChild(const child_visitor_t& visitor) {}
+    private:
+        sample_t value;
+    };
+
+    // same naive ramp as MutableSaw, computed instead of read from the band-limited ConstSaw table
+    class Saw
+    {
+    public:
+        Saw(double frequency, double sample_rate, bool negative_slope_in)
+            : phase(0.0)
+            , increment(frequency / sample_rate)
+            , slope(negative_slope_in ? -2.0 : 2.0)
+            , offset(negative_slope_in ? 1.0 : -1.0)
+        {
+        }
+        void Prepare(std::size_t frame_count) {}
+        sample_t Next()
+        {
+            const sample_t value = static_cast<sample_t>(offset + slope * phase);
+            phase += increment;
+            if (phase > 1.0)
+            {
+                phase -= 1.0;
+            }
+            return value;
+        }
+        void Reset() { phase = 0.0; }
+        void ForEachChild(const child_visitor_t& visitor) {}
+    private:
+        double phase;
+        double increment;
+        double slope;
+        double offset;
+    };
+
+    // MutableSine driven by a frequency expression, including its one sample of latency
+    template <typename Frequency>
+    class Sine
+    {
+    public:
+        Sine(Frequency frequency_in, double sample_rate_in)
+            : frequency(frequency_in)
+            , radians_per_hz(two_pi / sample_rate_in)
+            , theta(0.0)
+            , value(0.0)
+        {
+        }
+        void Prepare(std::size_t frame_count) { frequency.Prepare(frame_count); }
+        sample_t Next()
+        {
+            const sample_t ret_value = value;
+            value = static_cast<sample_t>(FastSin(theta));
+            theta += radians_per_hz * frequency.Next();
+            if (theta > two_pi)
+            {
+                theta -= two_pi;
+            }
+            return ret_value;
+        }
+        void Reset()
+        {
+            frequency.Reset();
+            theta = 0.0;
+            value = 0.0;
+        }
+        void ForEachChild(const child_visitor_t& visitor) { frequency.ForEachChild(visitor); }
+    private:
+        Frequency frequency;
+        double radians_per_hz;
+        double theta;
+        sample_t value;
+    };
+
+    template <typename Left, typename Right>
+    class Sum
+    {
+    public:
+        Sum(Left left_in, Right right_in) : left(left_in), right(right_in) {}
+        void Prepare(std::size_t frame_count)
+        {
+            left.Prepare(frame_count);
+            right.Prepare(frame_count);
+        }
+        sample_t Next() { return left.Next() + right.Next(); }
+        void Reset()
+        {
+            left.Reset();
+            right.Reset();
+        }
+        void ForEachChild(const child_visitor_t& visitor)
+        {
+            left.ForEachChild(visitor);
+            right.ForEachChild(visitor);
+        }
+    private:
+        Left left;
+        Right right;
+    };
+
+    template <typename Left, typename Right>
+    class Mul
+    {
+    public:
+        Mul(Left left_in, Right right_in) : left(left_in), right(right_in) {}
+        void Prepare(std::size_t frame_count)
+        {
+            left.Prepare(frame_count);
+            right.Prepare(frame_count);
+        }
+        sample_t Next() { return left.Next() * right.Next(); }
+        void Reset()
+        {
+            left.Reset();
+            right.Reset();
+        }
+        void ForEachChild(const child_visitor_t& visitor)
+        {
+            left.ForEachChild(visitor);
+            right.ForEachChild(visitor);
+        }
+    private:
+        Left left;
+        Right right;
+    };
+
+    // leaf that pulls a block from any runtime ISampleSource (envelopes, noise, sequences) during Prepare()
+    class Source
+    {
+    public:
+        explicit Source(std::shared_ptr<ISampleSource> source_in) : source(source_in), position(0) {}
+        void Prepare(std::size_t frame_count)
+        {
+            source->SampleBlock(ScratchBlock(block, frame_count));
+            position = 0;
+        }
+        sample_t Next() { return block[position++]; }
+        void Reset() { source->Reset(); }
+        void ForEachChild(const child_visitor_t& visitor) { visitor(source); }
+    private:
+        std::shared_ptr<ISampleSource> source;
+        std::vector<sample_t> block;
+        std::size_t position;
+    };
+};
+
+namespace Neato
+{
+    template <typename Expression>
+    class ExpressionSource : public ISampleSource
+    {
+    public:
+        explicit ExpressionSource(Expression expression_in) : expression(expression_in) {}
+        virtual sample_t Sample()
+        {
+            expression.Prepare(1);
+            return expression.Next();
+        }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            expression.Prepare(block.size());
+            for (sample_t& sample : block)
+            {
+                sample = expression.Next();
+            }
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            expression.ForEachChild(visitor);
+        }
+        virtual void Reset()
+        {
+            expression.Reset();
+        }
+    private:
+        Expression expression;
+    };
+
+    template <typename Expression>
+    std::shared_ptr<ISampleSource> MakeExpressionSource(Expression expression)
+    {
+        return std::make_shared<ExpressionSource<Expression>>(expression);
+    }
+};
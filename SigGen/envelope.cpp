@@ -17,52 +17,68 @@ namespace Neato
     enum class GainSegmentId
     {
         attack,
-        decay
+        decay,
+        release
+    };
+
+    enum class RampShape
+    {
+        linear,
+        exponential     // covers 60 dB of the distance to the target, then lands on it
     };
 }
 
-class LinearEnvelopeSegment : public Neato::IEnvelopeSegment
+// one ramp from a start gain to a target gain, computed as it plays. only the ramp's parameters are
+// stored, never its samples. fires the callback and starts over when the last sample has been read
+class RampEnvelopeSegment : public Neato::IEnvelopeSegment
 {
 public:
-    LinearEnvelopeSegment(double sample_rate_in, double gain_start_value, double gain_target_value, double gain_duration_time, Neato::GainSegmentId id)
+    RampEnvelopeSegment(double sample_rate_in, double gain_start_value, double gain_target_value, double gain_duration_time, Neato::GainSegmentId id, Neato::RampShape shape_in = Neato::RampShape::linear)
         : sample_time_accumulator(sample_rate_in)
+        , start_gain(gain_start_value)
+        , initial_start_gain(gain_start_value)
+        , target_gain(gain_target_value)
+        , sample_count(std::max<uint64_t>(1, static_cast<uint64_t>(sample_rate_in * gain_duration_time)))
         , current_segment_sample_index(0)
+        , shape(shape_in)
         , p_callback(nullptr)
         , id(id)
     {
-        //how many samples in duration?
-        uint32_t samples_per_duration = (uint32_t)(sample_rate_in * gain_duration_time);
-        
-        //how much gain is added during the entire duration?
-        double gain_per_duration = (double)gain_target_value - (double)gain_start_value;
-        
-        //how much gain is added for each sample?
-        //now you can save gain added per sample and do that each increment
-        // or you could precalculate the whole series
-        // and just look up next value each increment
-        double gain_per_sample = gain_per_duration / samples_per_duration;
-        gains_for_each_sample.reserve(samples_per_duration);
-        double gain_now = gain_start_value;
-        for (std::vector<double>::size_type samp_idx  = 0; samp_idx < samples_per_duration; samp_idx++)
-        {
-            gains_for_each_sample.push_back(gain_now);
-            gain_now += gain_per_sample;
-        }
+        Restart(start_gain);
     }
-    virtual double Sample()
+    virtual Neato::sample_t Sample()
     {
-        double return_gain = gains_for_each_sample[current_segment_sample_index];
-        current_segment_sample_index += 1;
-        if (current_segment_sample_index >= gains_for_each_sample.size())
+        Neato::sample_t return_gain = 0;
+        Render(&return_gain, 1);
+        Advance(1);
+        return return_gain;
+    }
+    virtual void SampleBlock(std::span<Neato::sample_t> block)
+    {
+        std::size_t written = 0;
+        while (written < block.size())
         {
-            current_segment_sample_index = 0;
-            if (nullptr != p_callback)
-            {
-                p_callback->StateComplete((int)id);
-            }
+            const std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(block.size() - written, SamplesRemaining()));
+            Render(block.data() + written, count);
+            written += count;
+            Advance(count);
         }
-        
-        return return_gain;
+    }
+    virtual uint64_t SamplesRemaining() const
+    {
+        return sample_count - current_segment_sample_index;
+    }
+    virtual void Reset()
+    {
+        Restart(initial_start_gain);
+    }
+    virtual bool Describe(Neato::GraphDescription& description) const
+    {
+        description.Add(initial_start_gain);
+        description.Add(target_gain);
+        description.Add(sample_count);
+        description.Add(shape);
+        return true;
     }
     virtual void SetGainStateCompletionCallback(std::shared_ptr<Neato::IStateCompletionCallback> callback_in)
     {
@@ -73,11 +89,64 @@ public:
     {
         p_callback = p_callback_in;
     }
+    // moves the start of the ramp, for a release or retrigger that begins wherever the gain happens to be
+    void Restart(double gain_start_value)
+    {
+        start_gain = gain_start_value;
+        current_segment_sample_index = 0;
+        if (shape == Neato::RampShape::linear)
+        {
+            step = (target_gain - start_gain) / sample_count;
+        }
+        else
+        {
+            step = std::pow(0.001, 1.0 / sample_count);
+            offset = start_gain - target_gain;
+        }
+    }
 private:
+    void Render(Neato::sample_t* out, std::size_t count)
+    {
+        if (shape == Neato::RampShape::linear)
+        {
+            // straight from the index, so there is no running sum to drift and the loop vectorizes
+            for (std::size_t i = 0; i < count; i++)
+            {
+                out[i] = static_cast<Neato::sample_t>(start_gain + static_cast<double>(current_segment_sample_index + i) * step);
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; i++)
+            {
+                out[i] = static_cast<Neato::sample_t>(target_gain + offset);
+                offset *= step;
+            }
+        }
+    }
+    void Advance(std::size_t count)
+    {
+        current_segment_sample_index += count;
+        if (current_segment_sample_index >= sample_count)
+        {
+            Restart(start_gain);
+            if (nullptr != p_callback)
+            {
+                p_callback->StateComplete((int)id);
+            }
+        }
+    }
+
     Neato::AudioTime sample_time_accumulator;
-    
-    std::vector<double> gains_for_each_sample;
-    std::vector<double>::size_type current_segment_sample_index;
+
+    double start_gain;
+    const double initial_start_gain;
+    const double target_gain;
+    const uint64_t sample_count;
+    uint64_t current_segment_sample_index;
+    const Neato::RampShape shape;
+    double step = 0.0;      // per sample increment when linear, per sample ratio when exponential
+    double offset = 0.0;    // exponential only, what is left of the distance to the target
     std::shared_ptr<Neato::IStateCompletionCallback> callback;
     Neato::IStateCompletionCallback* p_callback;
     Neato::GainSegmentId id;
@@ -90,10 +159,19 @@ public:
     {
         
     }
-    virtual double Sample()
+    virtual Neato::sample_t Sample()
     {
         return gain;
     }
+    virtual void SampleBlock(std::span<Neato::sample_t> block)
+    {
+        std::fill(block.begin(), block.end(), gain);
+    }
+    virtual bool Describe(Neato::GraphDescription& description) const
+    {
+        description.Add(gain);
+        return true;
+    }
 private:
     double gain;
 };
@@ -110,9 +188,9 @@ public:
         decay.SetGainStateCompletionCallback(this);
         current_segment = &attack;
     }
-    virtual double Sample()
+    virtual Neato::sample_t Sample()
     {
-        double gain = 0.0;
+        Neato::sample_t gain = 0;
         if (nullptr != current_segment)
         {
             gain = current_segment->Sample();
@@ -123,6 +201,28 @@ public:
         }
         return gain;
     }
+    virtual void SampleBlock(std::span<Neato::sample_t> block)
+    {
+        // render one segment at a time so the completion callback can switch segments between chunks
+        std::size_t written = 0;
+        while (written < block.size())
+        {
+            assert(nullptr != current_segment);
+            const std::size_t count = std::min<std::size_t>(block.size() - written, current_segment->SamplesRemaining());
+            current_segment->SampleBlock(block.subspan(written, count));
+            written += count;
+        }
+    }
+    virtual void Reset()
+    {
+        attack.Reset();
+        decay.Reset();
+        current_segment = &attack;
+    }
+    virtual bool Describe(Neato::GraphDescription& description) const
+    {
+        return attack.Describe(description) && decay.Describe(description);
+    }
     virtual void StateComplete(int stage_id)
     {
         if (stage_id == (int)Neato::GainSegmentId::attack)
@@ -135,12 +235,122 @@ public:
         }
     }
 private:
-    LinearEnvelopeSegment attack;
-    LinearEnvelopeSegment decay;
+    RampEnvelopeSegment attack;
+    RampEnvelopeSegment decay;
     Neato::IEnvelopeSegment* current_segment;
     
 };
 
+// attack and decay play once, the gain holds at the sustain level until Release(), and the release
+// segment starts from wherever the gain is at that moment
+class ADSREnvelope : public Neato::IGatedEnvelope, public Neato::IStateCompletionCallback
+{
+public:
+    ADSREnvelope(const Neato::adsr_params_t& params, double sample_rate_in, double scale)
+        : attack(sample_rate_in, 0.0, scale, params.attack_time, Neato::GainSegmentId::attack)
+        , decay(sample_rate_in, scale, params.sustain_gain * scale, params.decay_time, Neato::GainSegmentId::decay, Neato::RampShape::exponential)
+        , release(sample_rate_in, params.sustain_gain * scale, 0.0, params.release_time, Neato::GainSegmentId::release, Neato::RampShape::exponential)
+        , sustain_gain(params.sustain_gain * scale)
+        , current_gain(0.0)
+        , stage(Stage::attack)
+    {
+        attack.SetGainStateCompletionCallback(this);
+        decay.SetGainStateCompletionCallback(this);
+        release.SetGainStateCompletionCallback(this);
+    }
+    virtual Neato::sample_t Sample()
+    {
+        Neato::sample_t gain = 0;
+        SampleBlock(std::span<Neato::sample_t>(&gain, 1));
+        return gain;
+    }
+    virtual void SampleBlock(std::span<Neato::sample_t> block)
+    {
+        // one stage at a time, the completion callbacks move the stage on between chunks
+        std::size_t written = 0;
+        while (written < block.size())
+        {
+            RampEnvelopeSegment* segment = CurrentSegment();
+            if (nullptr == segment)
+            {
+                // sustain and finished are flat until the gate changes, which can only happen between blocks
+                std::fill(block.begin() + written, block.end(), current_gain);
+                break;
+            }
+            const std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(block.size() - written, segment->SamplesRemaining()));
+            segment->SampleBlock(block.subspan(written, count));
+            // the callback may already have moved on, in which case the gain is where that stage starts
+            current_gain = (stage == Stage::sustain) ? sustain_gain : (stage == Stage::finished) ? 0.0 : block[written + count - 1];
+            written += count;
+        }
+    }
+    virtual void Reset()
+    {
+        attack.Reset();
+        decay.Reset();
+        release.Reset();
+        current_gain = 0.0;
+        stage = Stage::attack;
+    }
+    virtual void Trigger()
+    {
+        attack.Restart(current_gain);
+        stage = Stage::attack;
+    }
+    virtual void Release()
+    {
+        if (stage != Stage::finished)
+        {
+            release.Restart(current_gain);
+            stage = Stage::release;
+        }
+    }
+    virtual bool Finished() const
+    {
+        return stage == Stage::finished;
+    }
+    virtual void StateComplete(int stage_id)
+    {
+        if (stage_id == (int)Neato::GainSegmentId::attack)
+        {
+            stage = Stage::decay;
+        }
+        if (stage_id == (int)Neato::GainSegmentId::decay)
+        {
+            stage = Stage::sustain;
+        }
+        if (stage_id == (int)Neato::GainSegmentId::release)
+        {
+            stage = Stage::finished;
+        }
+    }
+private:
+    enum class Stage
+    {
+        attack,
+        decay,
+        sustain,
+        release,
+        finished
+    };
+    RampEnvelopeSegment* CurrentSegment()
+    {
+        switch (stage)
+        {
+            case Stage::attack: return &attack;
+            case Stage::decay: return &decay;
+            case Stage::release: return &release;
+            default: return nullptr;
+        }
+    }
+    RampEnvelopeSegment attack;
+    RampEnvelopeSegment decay;
+    RampEnvelopeSegment release;
+    const double sustain_gain;
+    double current_gain;
+    Stage stage;
+};
+
 static std::shared_ptr<Neato::ISampleSource> CreateBell1(double sample_rate_in, double scale)
 {
     std::shared_ptr<Neato::ISampleSource> envelope = std::make_shared<Bell1Envelope>(sample_rate_in, scale);
@@ -164,6 +374,11 @@ std::shared_ptr<Neato::ISampleSource> Neato::CreateEnvelope(Neato::EnvelopeID id
     return envelope;
 }
 
+std::shared_ptr<Neato::IGatedEnvelope> Neato::CreateADSREnvelope(const adsr_params_t& params, double sample_rate_in, double scale)
+{
+    return std::make_shared<ADSREnvelope>(params, sample_rate_in, scale);
+}
+
 double Neato::dbToGain(double db)
 {
     double gain = 1.0;
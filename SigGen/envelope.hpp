@@ -21,6 +21,8 @@ namespace Neato
     public:
         virtual void SetGainStateCompletionCallback(std::shared_ptr<IStateCompletionCallback> callback_in)=0;
         virtual void SetGainStateCompletionCallback(IStateCompletionCallback* p_callback_in)=0;
+        // samples left before the segment completes and fires its callback
+        virtual uint64_t SamplesRemaining() const=0;
     };
 
     enum class EnvelopeID
@@ -30,6 +32,28 @@ namespace Neato
 
     std::shared_ptr<Neato::ISampleSource> CreateEnvelope(EnvelopeID id, double sample_rate_in, double scale);
 
+    // an envelope that waits on a note off. it starts in its attack, like the fixed envelopes
+    class IGatedEnvelope : public Neato::ISampleSource
+    {
+    public:
+        // attack again, from whatever the gain is now
+        virtual void Trigger()=0;
+        // skip to the release, from whatever the gain is now
+        virtual void Release()=0;
+        // true once the release has run out, the gain stays 0 after that
+        virtual bool Finished() const=0;
+    };
+
+    struct adsr_params_t
+    {
+        double attack_time = 0.005;     // seconds, linear from 0 to full scale
+        double decay_time = 0.1;        // seconds, exponential down to the sustain gain
+        double sustain_gain = 0.7;      // fraction of scale held until Release()
+        double release_time = 0.3;      // seconds, exponential down to 0
+    };
+
+    std::shared_ptr<IGatedEnvelope> CreateADSREnvelope(const adsr_params_t& params, double sample_rate_in, double scale);
+
     double dbToGain(double db);
     std::vector<double> dbToGains(std::vector<double>&& gains_in_db);
 };
@@ -0,0 +1,111 @@
+//
+//  fast_math.cpp
+//  SigGen
+//
+
+#include <cassert>
+#include "fast_math.hpp"
+
+namespace
+{
+    constexpr double cycles_per_radian = 0.5 / std::numbers::pi;
+
+    template <typename T>
+    using sine_block_fn = void (*)(const T* radians, T* out, std::size_t frame_count, double cycle_offset);
+
+    // cycle_offset is 0 for sine and a quarter cycle for cosine
+    template <Neato::SineAccuracy accuracy, typename T>
+    void SineBlockScalar(const T* radians, T* out, std::size_t frame_count, double cycle_offset)
+    {
+        for (std::size_t i = 0; i < frame_count; i++)
+        {
+            const T cycles = radians[i] * T(cycles_per_radian) + T(cycle_offset);
+            out[i] = Neato::SineOfCycles<accuracy>(cycles - std::floor(cycles + T(0.5)));
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // two registers per loop so the polynomial chains overlap
+    template <Neato::SineAccuracy accuracy, typename T>
+    void SineBlockSse2(const T* radians, T* out, std::size_t frame_count, double cycle_offset)
+    {
+        using namespace Neato::simd;
+        constexpr std::size_t lanes = sse_lanes<T>;
+        const std::size_t vector_count = frame_count - frame_count % (2 * lanes);
+        const sse_t<T> scale = BroadcastSse<T>(cycles_per_radian);
+        const sse_t<T> offset = BroadcastSse<T>(cycle_offset);
+        for (std::size_t i = 0; i < vector_count; i += 2 * lanes)
+        {
+            const sse_t<T> cycles_low = Add(Mul(LoadSse(radians + i), scale), offset);
+            const sse_t<T> cycles_high = Add(Mul(LoadSse(radians + i + lanes), scale), offset);
+            Store(out + i, Neato::SineOfCyclesSse<accuracy>(Sub(cycles_low, RoundNearest(cycles_low))));
+            Store(out + i + lanes, Neato::SineOfCyclesSse<accuracy>(Sub(cycles_high, RoundNearest(cycles_high))));
+        }
+        SineBlockScalar<accuracy>(radians + vector_count, out + vector_count, frame_count - vector_count, cycle_offset);
+    }
+
+    template <Neato::SineAccuracy accuracy, typename T>
+    NEATO_TARGET_AVX2 void SineBlockAvx2(const T* radians, T* out, std::size_t frame_count, double cycle_offset)
+    {
+        using namespace Neato::simd;
+        constexpr std::size_t lanes = avx_lanes<T>;
+        const std::size_t vector_count = frame_count - frame_count % (2 * lanes);
+        const avx_t<T> scale = BroadcastAvx<T>(cycles_per_radian);
+        const avx_t<T> offset = BroadcastAvx<T>(cycle_offset);
+        for (std::size_t i = 0; i < vector_count; i += 2 * lanes)
+        {
+            const avx_t<T> cycles_low = Add(Mul(LoadAvx(radians + i), scale), offset);
+            const avx_t<T> cycles_high = Add(Mul(LoadAvx(radians + i + lanes), scale), offset);
+            Store(out + i, Neato::SineOfCyclesAvx2<accuracy>(Sub(cycles_low, RoundNearest(cycles_low))));
+            Store(out + i + lanes, Neato::SineOfCyclesAvx2<accuracy>(Sub(cycles_high, RoundNearest(cycles_high))));
+        }
+        _mm256_zeroupper();
+        SineBlockScalar<accuracy>(radians + vector_count, out + vector_count, frame_count - vector_count, cycle_offset);
+    }
+#endif //NEATO_SIMD_X86
+
+    template <Neato::SineAccuracy accuracy, typename T>
+    sine_block_fn<T> SelectSineKernel()
+    {
+#if NEATO_SIMD_X86
+        return Neato::CpuHasAvx2() ? &SineBlockAvx2<accuracy, T> : &SineBlockSse2<accuracy, T>;
+#else
+        return &SineBlockScalar<accuracy, T>;
+#endif //NEATO_SIMD_X86
+    }
+
+    template <typename T>
+    void SineBlock(std::span<const T> radians, std::span<T> out, Neato::SineAccuracy accuracy, double cycle_offset)
+    {
+        // indexed by SineAccuracy
+        static const sine_block_fn<T> kernels[] =
+        {
+            SelectSineKernel<Neato::SineAccuracy::low, T>(),
+            SelectSineKernel<Neato::SineAccuracy::medium, T>(),
+            SelectSineKernel<Neato::SineAccuracy::high, T>(),
+            SelectSineKernel<Neato::SineAccuracy::full, T>(),
+        };
+        assert(out.size() >= radians.size());
+        kernels[static_cast<std::size_t>(accuracy)](radians.data(), out.data(), radians.size(), cycle_offset);
+    }
+}
+
+void Neato::FastSinBlock(std::span<const double> radians, std::span<double> out, SineAccuracy accuracy)
+{
+    SineBlock(radians, out, accuracy, 0.0);
+}
+
+void Neato::FastSinBlock(std::span<const float> radians, std::span<float> out, SineAccuracy accuracy)
+{
+    SineBlock(radians, out, accuracy, 0.0);
+}
+
+void Neato::FastCosBlock(std::span<const double> radians, std::span<double> out, SineAccuracy accuracy)
+{
+    SineBlock(radians, out, accuracy, 0.25);
+}
+
+void Neato::FastCosBlock(std::span<const float> radians, std::span<float> out, SineAccuracy accuracy)
+{
+    SineBlock(radians, out, accuracy, 0.25);
+}
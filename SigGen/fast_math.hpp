@@ -0,0 +1,151 @@
+//
+//  fast_math.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <numbers>
+#include <span>
+#include "simd.hpp"
+
+namespace Neato
+{
+    // polynomial sines for oscillators whose phase changes every sample, where a table can't follow.
+    // each tier is a minimax fit of sin(x)/x in x^2 on a quarter cycle, the errors are worst case
+    // against std::sin over a cycle. siggen --bench reports the measured error next to the cost
+    enum class SineAccuracy
+    {
+        low,        // 1.3e-4, about -78 dB. modulators and LFOs
+        medium,     // 7e-9, below 24 bit resolution
+        high,       // 1e-13
+        full        // 5e-15 over the first few cycles, the range reduction dominates. a drop-in for std::sin
+    };
+
+    template <SineAccuracy accuracy> struct sine_polynomial;
+
+    template <> struct sine_polynomial<SineAccuracy::low>
+    {
+        static constexpr double coefficients[] = {0.99991152837960384, -0.16602000425894697, 0.0076266621511777583};
+    };
+
+    template <> struct sine_polynomial<SineAccuracy::medium>
+    {
+        static constexpr double coefficients[] = {0.99999999569880902, -0.16666657947846011, 0.0083330501706717736, -0.00019809017408678017, 2.605107635334804e-06};
+    };
+
+    template <> struct sine_polynomial<SineAccuracy::high>
+    {
+        static constexpr double coefficients[] = {0.99999999999994965, -0.16666666666466672, 0.008333333320358348, -0.00019841266683130573, 2.7556952912849565e-06, -2.5030268188486325e-08, 1.5411219741637458e-10};
+    };
+
+    template <> struct sine_polynomial<SineAccuracy::full>
+    {
+        static constexpr double coefficients[] = {0.99999999999999989, -0.16666666666666073, 0.0083333333332827532, -0.00019841269824861313, 2.7557316609009702e-06, -2.5051881943268918e-08, 1.604816822895853e-10, -7.3743866197167684e-13};
+    };
+
+    // sin(2 pi t) for t in [-0.5, 0.5]: fold into [0, 0.25], evaluate the odd polynomial, put the sign back.
+    // the vector versions below are the same steps lane by lane. float evaluates in float, so the tiers
+    // above medium only buy what float can hold
+    template <SineAccuracy accuracy, typename T>
+    inline T SineOfCycles(T t)
+    {
+        constexpr auto& c = sine_polynomial<accuracy>::coefficients;
+        const T a = T(0.25) - std::abs(T(0.25) - std::abs(t));
+        const T x = T(2.0 * std::numbers::pi) * a;
+        const T x2 = x * x;
+        T p = T(c[std::size(c) - 1]);
+        for (std::size_t k = std::size(c) - 1; k-- > 0;)
+        {
+            p = p * x2 + T(c[k]);
+        }
+        return std::copysign(x * p, t);
+    }
+
+    template <SineAccuracy accuracy = SineAccuracy::full>
+    inline double FastSin(double radians)
+    {
+        const double cycles = radians * (0.5 / std::numbers::pi);
+        return SineOfCycles<accuracy>(cycles - std::floor(cycles + 0.5));
+    }
+
+    template <SineAccuracy accuracy = SineAccuracy::full>
+    inline double FastCos(double radians)
+    {
+        const double cycles = radians * (0.5 / std::numbers::pi) + 0.25;
+        return SineOfCycles<accuracy>(cycles - std::floor(cycles + 0.5));
+    }
+
+    inline double FastSin(double radians, SineAccuracy accuracy)
+    {
+        switch (accuracy)
+        {
+            case SineAccuracy::low: return FastSin<SineAccuracy::low>(radians);
+            case SineAccuracy::medium: return FastSin<SineAccuracy::medium>(radians);
+            case SineAccuracy::high: return FastSin<SineAccuracy::high>(radians);
+            case SineAccuracy::full: break;
+        }
+        return FastSin<SineAccuracy::full>(radians);
+    }
+
+    inline double FastCos(double radians, SineAccuracy accuracy)
+    {
+        switch (accuracy)
+        {
+            case SineAccuracy::low: return FastCos<SineAccuracy::low>(radians);
+            case SineAccuracy::medium: return FastCos<SineAccuracy::medium>(radians);
+            case SineAccuracy::high: return FastCos<SineAccuracy::high>(radians);
+            case SineAccuracy::full: break;
+        }
+        return FastCos<SineAccuracy::full>(radians);
+    }
+
+    // out[i] = sin(radians[i]), the spans can be the same memory. two AVX2 or SSE2 registers at a time,
+    // so 8 doubles or 16 floats per loop on AVX2. the SSE2 range reduction goes through int32, so keep
+    // |radians| under 1e10
+    void FastSinBlock(std::span<const double> radians, std::span<double> out, SineAccuracy accuracy);
+    void FastSinBlock(std::span<const float> radians, std::span<float> out, SineAccuracy accuracy);
+    void FastCosBlock(std::span<const double> radians, std::span<double> out, SineAccuracy accuracy);
+    void FastCosBlock(std::span<const float> radians, std::span<float> out, SineAccuracy accuracy);
+
+#if NEATO_SIMD_X86
+    template <SineAccuracy accuracy, typename V>
+    inline V SineOfCyclesSse(V t)
+    {
+        using T = simd::lane_t<V>;
+        constexpr auto& c = sine_polynomial<accuracy>::coefficients;
+        const V sign_mask = simd::BroadcastSse<T>(-0.0);
+        const V quarter = simd::BroadcastSse<T>(0.25);
+        const V a = simd::Sub(quarter, simd::AndNot(sign_mask, simd::Sub(quarter, simd::AndNot(sign_mask, t))));
+        const V x = simd::Mul(simd::BroadcastSse<T>(2.0 * std::numbers::pi), a);
+        const V x2 = simd::Mul(x, x);
+        V p = simd::BroadcastSse<T>(c[std::size(c) - 1]);
+        for (std::size_t k = std::size(c) - 1; k-- > 0;)
+        {
+            p = simd::Add(simd::Mul(p, x2), simd::BroadcastSse<T>(c[k]));
+        }
+        return simd::Or(simd::Mul(x, p), simd::And(sign_mask, t));
+    }
+
+    template <SineAccuracy accuracy, typename V>
+    NEATO_TARGET_AVX2 inline V SineOfCyclesAvx2(V t)
+    {
+        using T = simd::lane_t<V>;
+        constexpr auto& c = sine_polynomial<accuracy>::coefficients;
+        const V sign_mask = simd::BroadcastAvx<T>(-0.0);
+        const V quarter = simd::BroadcastAvx<T>(0.25);
+        const V a = simd::Sub(quarter, simd::AndNot(sign_mask, simd::Sub(quarter, simd::AndNot(sign_mask, t))));
+        const V x = simd::Mul(simd::BroadcastAvx<T>(2.0 * std::numbers::pi), a);
+        const V x2 = simd::Mul(x, x);
+        V p = simd::BroadcastAvx<T>(c[std::size(c) - 1]);
+        for (std::size_t k = std::size(c) - 1; k-- > 0;)
+        {
+            p = simd::Add(simd::Mul(p, x2), simd::BroadcastAvx<T>(c[k]));
+        }
+        return simd::Or(simd::Mul(x, p), simd::And(sign_mask, t));
+    }
+#endif //NEATO_SIMD_X86
+};
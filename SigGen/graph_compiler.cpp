@@ -0,0 +1,429 @@
+//
+//  graph_compiler.cpp
+//  SigGen
+//
+
+#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+#include "graph_compiler.hpp"
+
+namespace
+{
+    enum class TapeOp : uint8_t
+    {
+        render_node,    // node->SampleBlock(destination)
+        read_table,     // destination = next samples of a shared wavetable
+        fill,           // destination = value
+        copy,           // destination = source
+        accumulate,     // destination += source
+        multiply,       // destination *= source
+        scale,          // destination *= value
+    };
+
+    struct tape_instruction_t
+    {
+        TapeOp op = TapeOp::fill;
+        uint32_t destination = 0;
+        uint32_t source = 0;
+        uint32_t table_cursor = 0;
+        Neato::sample_t value = 0;
+        Neato::ISampleSource* node = nullptr;
+    };
+
+    struct table_cursor_t
+    {
+        const Neato::sample_t* table = nullptr;
+        uint32_t phase = 0;
+        uint32_t increment = 0;
+        Neato::Interpolation interpolation = Neato::Interpolation::linear;
+    };
+
+    class CompiledGraph : public Neato::ISampleSource
+    {
+    public:
+        CompiledGraph(std::shared_ptr<Neato::ISampleSource> root_in, uint32_t max_block_frames_in)
+            : root(root_in)
+            , max_block_frames(max_block_frames_in)
+            , output_buffer(0)
+        {
+            FindOpaqueReaders(root);
+            CountUses(root.get());
+            output_buffer = EmitOwned(root);
+            scratch.resize(static_cast<std::size_t>(buffer_count) * max_block_frames);
+            buffer_pointers.resize(buffer_count);
+            use_counts.clear();
+            node_buffers.clear();
+            node_cursors.clear();
+            walked.clear();
+            read_opaquely.clear();
+            free_buffers.clear();
+            // a node pulled more than once has a step per pull, it only wants resetting once
+            std::unordered_set<Neato::ISampleSource*> listed;
+            for (const tape_instruction_t& instruction : tape)
+            {
+                if (instruction.op == TapeOp::render_node && listed.insert(instruction.node).second)
+                {
+                    opaque_nodes.push_back(instruction.node);
+                }
+            }
+        }
+
+        virtual Neato::sample_t Sample()
+        {
+            Neato::sample_t value = 0;
+            SampleBlock(std::span<Neato::sample_t>(&value, 1));
+            return value;
+        }
+
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            std::size_t written = 0;
+            while (written < block.size())
+            {
+                const std::size_t count = std::min<std::size_t>(block.size() - written, max_block_frames);
+                Run(block.subspan(written, count));
+                written += count;
+            }
+        }
+
+        virtual void ForEachChild(const Neato::child_visitor_t& visitor)
+        {
+            // the tape holds raw pointers into the graph, swapping nodes underneath it isn't allowed
+        }
+
+        virtual void Reset()
+        {
+            // flattened tables read through their own cursors, the opaque nodes still hold their state
+            for (table_cursor_t& cursor : table_cursors)
+            {
+                cursor.phase = 0;
+            }
+            for (Neato::ISampleSource* node : opaque_nodes)
+            {
+                node->Reset();
+            }
+        }
+
+        // renders what the graph it was compiled from renders, so it's described as that graph
+        virtual bool Describe(Neato::GraphDescription& description) const
+        {
+            description.Add(max_block_frames);
+            return description.Child(root.get());
+        }
+
+    private:
+        void Run(std::span<Neato::sample_t> block)
+        {
+            const std::size_t frame_count = block.size();
+            for (uint32_t buffer = 0; buffer < buffer_count; buffer++)
+            {
+                buffer_pointers[buffer] = scratch.data() + static_cast<std::size_t>(buffer) * max_block_frames;
+            }
+            // the root's value is only live at the very end, so it can be produced in the caller's block
+            buffer_pointers[output_buffer] = block.data();
+
+            for (const tape_instruction_t& instruction : tape)
+            {
+                Neato::sample_t* destination = buffer_pointers[instruction.destination];
+                const Neato::sample_t* source = buffer_pointers[instruction.source];
+                switch (instruction.op)
+                {
+                    case TapeOp::render_node:
+                        instruction.node->SampleBlock(std::span<Neato::sample_t>(destination, frame_count));
+                        break;
+                    case TapeOp::read_table:
+                    {
+                        table_cursor_t& cursor = table_cursors[instruction.table_cursor];
+                        Neato::ReadWavetableBlock(cursor.table, cursor.phase, cursor.increment, cursor.interpolation, std::span<Neato::sample_t>(destination, frame_count));
+                        break;
+                    }
+                    case TapeOp::fill:
+                        std::fill_n(destination, frame_count, instruction.value);
+                        break;
+                    case TapeOp::copy:
+                        std::copy_n(source, frame_count, destination);
+                        break;
+                    case TapeOp::accumulate:
+                        for (std::size_t i = 0; i < frame_count; i++)
+                        {
+                            destination[i] += source[i];
+                        }
+                        break;
+                    case TapeOp::multiply:
+                        for (std::size_t i = 0; i < frame_count; i++)
+                        {
+                            destination[i] *= source[i];
+                        }
+                        break;
+                    case TapeOp::scale:
+                        for (std::size_t i = 0; i < frame_count; i++)
+                        {
+                            destination[i] *= instruction.value;
+                        }
+                        break;
+                }
+            }
+        }
+
+        static bool IsFlattened(Neato::ISampleSource* node)
+        {
+            return dynamic_cast<Neato::SampleSummer*>(node) || dynamic_cast<Neato::SampleMultiplier*>(node);
+        }
+
+        static bool IsShareable(Neato::ISampleSource* node)
+        {
+            return dynamic_cast<Neato::DCOffset*>(node) != nullptr;
+        }
+
+        // marks everything under a node that renders its own children. a table oscillator in there moves its
+        // own phase, so it can't be read through a cursor of the tape's as well
+        void FindOpaqueReaders(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            if (!walked.insert(node.get()).second)
+            {
+                return;
+            }
+            const bool flattened = IsFlattened(node.get());
+            node->ForEachChild([this, flattened](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                if (!flattened)
+                {
+                    MarkReadOpaquely(child);
+                }
+                FindOpaqueReaders(child);
+            });
+        }
+
+        void MarkReadOpaquely(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            if (read_opaquely.insert(node.get()).second)
+            {
+                node->ForEachChild([this](std::shared_ptr<Neato::ISampleSource>& child)
+                {
+                    MarkReadOpaquely(child);
+                });
+            }
+        }
+
+        // how many times each constant is read, so its buffer can be recycled after the last read. everything
+        // else is emitted once per read, the same as the interpreter pulling it once per parent, so a shared
+        // subtree is counted once per path to it
+        void CountUses(Neato::ISampleSource* node)
+        {
+            if (IsShareable(node))
+            {
+                use_counts[node]++;
+            }
+            if (!IsFlattened(node))
+            {
+                return;
+            }
+            node->ForEachChild([this](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                CountUses(child.get());
+            });
+        }
+
+        uint32_t AllocateBuffer()
+        {
+            if (!free_buffers.empty())
+            {
+                uint32_t buffer = free_buffers.back();
+                free_buffers.pop_back();
+                return buffer;
+            }
+            return buffer_count++;
+        }
+
+        void Emit(TapeOp op, uint32_t destination, uint32_t source = 0, Neato::sample_t value = 0, Neato::ISampleSource* node = nullptr, uint32_t table_cursor = 0)
+        {
+            tape_instruction_t instruction;
+            instruction.op = op;
+            instruction.destination = destination;
+            instruction.source = source;
+            instruction.value = value;
+            instruction.node = node;
+            instruction.table_cursor = table_cursor;
+            tape.push_back(instruction);
+        }
+
+        // an oscillator read by several parents has one cursor that each read moves on, the way each pull of
+        // the node moves its phase on
+        template <typename TableSource>
+        uint32_t EmitTableRead(const TableSource& table_source)
+        {
+            auto existing = node_cursors.find(&table_source);
+            uint32_t cursor_index = 0;
+            if (existing != node_cursors.end())
+            {
+                cursor_index = existing->second;
+            }
+            else
+            {
+                table_cursor_t cursor;
+                cursor.table = table_source.Table();
+                cursor.phase = table_source.Phase();
+                cursor.increment = table_source.Increment();
+                cursor.interpolation = table_source.GetInterpolation();
+                table_cursors.push_back(cursor);
+                cursor_index = static_cast<uint32_t>(table_cursors.size() - 1);
+                node_cursors[&table_source] = cursor_index;
+            }
+            uint32_t destination = AllocateBuffer();
+            Emit(TapeOp::read_table, destination, 0, 0.0, nullptr, cursor_index);
+            return destination;
+        }
+
+        // returns the buffer that holds the node's block for one read of it, give it back with Release().
+        // only a constant's buffer is shared between reads
+        uint32_t EmitValue(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            auto existing = node_buffers.find(node.get());
+            if (existing != node_buffers.end())
+            {
+                return existing->second;
+            }
+
+            uint32_t destination = 0;
+            const bool table_readable = (read_opaquely.count(node.get()) == 0);
+            if (auto dc_offset = dynamic_cast<Neato::DCOffset*>(node.get()))
+            {
+                destination = AllocateBuffer();
+                Emit(TapeOp::fill, destination, 0, dc_offset->Value());
+                node_buffers[node.get()] = destination;
+                return destination;
+            }
+            else if (auto sine = dynamic_cast<Neato::ConstSine*>(node.get()); sine && table_readable)
+            {
+                destination = EmitTableRead(*sine);
+            }
+            else if (auto saw = dynamic_cast<Neato::ConstSaw*>(node.get()); saw && table_readable)
+            {
+                destination = EmitTableRead(*saw);
+            }
+            else if (dynamic_cast<Neato::SampleSummer*>(node.get()))
+            {
+                destination = EmitSum(node);
+            }
+            else if (dynamic_cast<Neato::SampleMultiplier*>(node.get()))
+            {
+                destination = EmitProduct(node);
+            }
+            else
+            {
+                destination = AllocateBuffer();
+                Emit(TapeOp::render_node, destination, 0, 0.0, node.get());
+            }
+            return destination;
+        }
+
+        void Release(const std::shared_ptr<Neato::ISampleSource>& node, uint32_t buffer)
+        {
+            if (IsShareable(node.get()) && --use_counts[node.get()] != 0)
+            {
+                return;
+            }
+            node_buffers.erase(node.get());
+            free_buffers.push_back(buffer);
+        }
+
+        // a buffer with the node's block that the caller is free to overwrite
+        uint32_t EmitOwned(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            uint32_t buffer = EmitValue(node);
+            if (!IsShareable(node.get()) || use_counts[node.get()] == 1)
+            {
+                // nobody else reads it, take the buffer over instead of copying it
+                use_counts[node.get()] = 0;
+                node_buffers.erase(node.get());
+                return buffer;
+            }
+            uint32_t destination = AllocateBuffer();
+            Emit(TapeOp::copy, destination, buffer);
+            Release(node, buffer);
+            return destination;
+        }
+
+        std::vector<std::shared_ptr<Neato::ISampleSource>> Children(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            std::vector<std::shared_ptr<Neato::ISampleSource>> children;
+            node->ForEachChild([&children](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                children.push_back(child);
+            });
+            return children;
+        }
+
+        uint32_t EmitSum(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            std::vector<std::shared_ptr<Neato::ISampleSource>> children = Children(node);
+            if (children.empty())
+            {
+                uint32_t destination = AllocateBuffer();
+                Emit(TapeOp::fill, destination, 0, 0.0);
+                return destination;
+            }
+            uint32_t destination = EmitOwned(children.front());
+            for (std::size_t i = 1; i < children.size(); i++)
+            {
+                uint32_t addend = EmitValue(children[i]);
+                Emit(TapeOp::accumulate, destination, addend);
+                Release(children[i], addend);
+            }
+            return destination;
+        }
+
+        uint32_t EmitProduct(const std::shared_ptr<Neato::ISampleSource>& node)
+        {
+            std::vector<std::shared_ptr<Neato::ISampleSource>> children = Children(node);
+            assert(children.size() == 2);
+            uint32_t destination = EmitOwned(children[0]);
+            if (auto dc_offset = dynamic_cast<Neato::DCOffset*>(children[1].get()))
+            {
+                // constant gains are by far the common case, no need for a buffer full of them
+                Emit(TapeOp::scale, destination, 0, dc_offset->Value());
+                if (--use_counts[dc_offset] == 0)
+                {
+                    auto existing = node_buffers.find(dc_offset);
+                    if (existing != node_buffers.end())
+                    {
+                        free_buffers.push_back(existing->second);
+                        node_buffers.erase(existing);
+                    }
+                }
+            }
+            else
+            {
+                uint32_t multiplier = EmitValue(children[1]);
+                Emit(TapeOp::multiply, destination, multiplier);
+                Release(children[1], multiplier);
+            }
+            return destination;
+        }
+
+    private:
+        std::shared_ptr<Neato::ISampleSource> root;
+        const uint32_t max_block_frames;
+        std::vector<tape_instruction_t> tape;
+        std::vector<table_cursor_t> table_cursors;
+        std::vector<Neato::ISampleSource*> opaque_nodes;
+        std::vector<Neato::sample_t> scratch;
+        std::vector<Neato::sample_t*> buffer_pointers;
+        uint32_t buffer_count = 0;
+        uint32_t output_buffer;
+
+        // compile time only
+        std::unordered_map<Neato::ISampleSource*, uint32_t> use_counts;
+        std::unordered_map<Neato::ISampleSource*, uint32_t> node_buffers;
+        std::unordered_map<const Neato::ISampleSource*, uint32_t> node_cursors;
+        std::unordered_set<Neato::ISampleSource*> walked;
+        std::unordered_set<Neato::ISampleSource*> read_opaquely;
+        std::vector<uint32_t> free_buffers;
+    };
+}
+
+std::shared_ptr<Neato::ISampleSource> Neato::CompileGraph(std::shared_ptr<ISampleSource> root, uint32_t max_block_frames)
+{
+    return std::make_shared<CompiledGraph>(root, max_block_frames);
+}
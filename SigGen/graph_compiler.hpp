@@ -0,0 +1,21 @@
+//
+//  graph_compiler.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    // Walks a finished graph once and flattens the SampleSummer/SampleMultiplier/DCOffset/ConstSine/ConstSaw
+    // parts of it into a linear tape of block operations. Intermediate blocks live in one reusable
+    // scratch allocation and the table cursors in one contiguous array. Any other node (envelopes,
+    // noise, modulated oscillators, sequences...) becomes a single tape step that calls its SampleBlock().
+    //
+    // The returned source owns the graph, don't keep pulling samples from the original root.
+    // A node shared by several parents is pulled once per parent in the same order the interpreter pulls it,
+    // so the output is the interpreter's. Only a DCOffset's block is shared between its readers.
+    std::shared_ptr<ISampleSource> CompileGraph(std::shared_ptr<ISampleSource> root, uint32_t max_block_frames = 4096);
+};
@@ -5,36 +5,87 @@
 //  Created by Mike Erickson on 10/7/22.
 //
 #include "RenderGraph.h"
+#include "RenderGraph_Offline.h"
+#include "RenderAhead.h"
 #include <iostream>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <chrono>
+#include <thread>
 #include "TestRenderer.hpp"
+#include "benchmark.hpp"
+#include "wav_file.h"
+#include "rt_audit.hpp"
+#include "profiler.hpp"
+#include "RenderGraph_Null.h"
 
-int main(int argc, const char * argv[])
+// set by a leading --stereo, which plays the panned demo instead of the mono one
+static bool panned_demo = false;
+
+static std::shared_ptr<TestRenderer> CreateDemo(bool compile_graphs = true, std::shared_ptr<Neato::RenderCache> render_cache = nullptr)
+{
+    return std::make_shared<TestRenderer>(compile_graphs, render_cache, panned_demo);
+}
+
+// 16 bit stereo at 48 kHz, interleaved, so a frame holds every channel
+static Neato::audio_stream_description_t DeviceStreamRequest()
 {
-    HRESULT hr = CoInitialize(nullptr);
-    if FAILED(hr)
-    {
-        std::cout << "Unable to initialize COM library" << std::endl;
-        return -1;
-    }
-    int ret_val = 0;
     Neato::audio_stream_description_t create_params;
     std::shared_ptr<Neato::PlatformRenderConstantsDictionary> render_constants = Neato::CreateRenderConstantsDictionary();
     create_params.format_id = render_constants->Format(Neato::format_id_pcm);
     create_params.flags = 0
                           | render_constants->Flag(Neato::format_flag_signed_int)
-                          | render_constants->Flag(Neato::format_flag_packed)
-                          | render_constants->Flag(Neato::format_flag_non_interleaved);
-    create_params.bytes_per_frame = 2;
+                          | render_constants->Flag(Neato::format_flag_packed);
     create_params.channels_per_frame = 2;
     create_params.bits_per_channel = 16;
+    create_params.bytes_per_frame = create_params.channels_per_frame * (create_params.bits_per_channel / 8);
     create_params.sample_rate = 48000;
+    return create_params;
+}
+
+static void PrintRenderAheadStats(const Neato::IRenderAhead& render_ahead)
+{
+    Neato::render_ahead_stats_t stats = render_ahead.GetStats();
+    std::cout << "Render ahead: " << stats.callbacks << " callbacks, " << stats.underruns << " underruns ("
+              << stats.frames_short << " frames of silence), lowest fill " << stats.min_fill_frames
+              << " of " << stats.capacity_frames << " frames" << std::endl;
+}
 
-    std::shared_ptr<Neato::IRenderCallback> callback = std::make_shared<TestRenderer>();
+static int RenderToDevice(double lookahead_ms)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    HRESULT hr = CoInitialize(nullptr);
+    if FAILED(hr)
+    {
+        std::cout << "Unable to initialize COM library" << std::endl;
+        return -1;
+    }
+#endif //_WIN32 || _WIN64
+    int ret_val = 0;
+    Neato::audio_stream_description_t create_params = DeviceStreamRequest();
+
+    std::shared_ptr<TestRenderer> test_renderer = CreateDemo();
+    std::shared_ptr<Neato::IRenderCallback> callback = test_renderer;
+    std::shared_ptr<Neato::IRenderParamsValidatedCallback> params_callback = test_renderer;
+
+    // with a lookahead the device thread only copies out of a ring that a synthesis thread keeps full
+    std::shared_ptr<Neato::IRenderAhead> render_ahead;
+    if (lookahead_ms > 0.0)
+    {
+        render_ahead = Neato::CreateRenderAhead(test_renderer, test_renderer, static_cast<uint32_t>(lookahead_ms * create_params.sample_rate / 1000.0));
+        callback = render_ahead;
+        params_callback = render_ahead;
+    }
     
     std::shared_ptr<Neato::IRenderGraph> renderer;
     try
     {
-        renderer = Neato::CreateRenderGraph(create_params, callback);
+        renderer = Neato::CreateRenderGraph(create_params, params_callback);
     }
     catch(std::runtime_error e)
     {
@@ -42,12 +93,410 @@ int main(int argc, const char * argv[])
         return -1;
     }
     
-    std::shared_ptr<Neato::IRenderReturn> ret = renderer->Start();
+    std::shared_ptr<Neato::IRenderReturn> ret = renderer->Start(callback);
     std::cout << "Press enter to stop annoying sound" << std::endl;
     int dummy = getchar();
     renderer->Stop();
+    Neato::WriteDeadlineReport(std::cout, renderer->GetDeadlineStats());
+
+    if (render_ahead)
+    {
+        PrintRenderAheadStats(*render_ahead);
+    }
 
     return ret_val;
 }
 
+#if defined(__linux__)
+// plays into the null device for a while and reports how the callbacks kept up, for boxes with no sound card
+// realtime sets up the render and synthesis threads with DefaultRealtimeThreadConfig()
+static int RenderToNullDevice(double duration_seconds, Neato::null_device_options_t options, double lookahead_ms, bool realtime)
+{
+    Neato::realtime_thread_config_t synthesis_thread;
+    if (realtime)
+    {
+        options.render_thread = Neato::DefaultRealtimeThreadConfig();
+        // below the device thread, which only copies out of the ring and has to win when both are runnable
+        synthesis_thread = Neato::DefaultRealtimeThreadConfig();
+        synthesis_thread.priority = options.render_thread.priority - 10;
+    }
+    Neato::audio_stream_description_t create_params = DeviceStreamRequest();
+
+    std::shared_ptr<TestRenderer> test_renderer = CreateDemo();
+    std::shared_ptr<Neato::IRenderCallback> callback = test_renderer;
+    std::shared_ptr<Neato::IRenderParamsValidatedCallback> params_callback = test_renderer;
+    std::shared_ptr<Neato::IRenderAhead> render_ahead;
+    if (lookahead_ms > 0.0)
+    {
+        render_ahead = Neato::CreateRenderAhead(test_renderer, test_renderer, static_cast<uint32_t>(lookahead_ms * create_params.sample_rate / 1000.0), 0, synthesis_thread);
+        callback = render_ahead;
+        params_callback = render_ahead;
+    }
 
+    std::shared_ptr<Neato::INullRenderGraph> renderer;
+    try
+    {
+        renderer = Neato::CreateNullRenderGraph(create_params, params_callback, options);
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+
+    renderer->Start(callback);
+    if (realtime)
+    {
+        std::cout << "Render thread" << std::endl;
+        Neato::WriteRealtimeThreadReport(std::cout, renderer->RenderThreadReport());
+        if (render_ahead)
+        {
+            std::cout << "Synthesis thread" << std::endl;
+            Neato::WriteRealtimeThreadReport(std::cout, render_ahead->SynthesisThreadReport());
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration_seconds));
+    std::shared_ptr<Neato::IRenderReturn> ret = renderer->Stop();
+    if (!ret->DidSucceed())
+    {
+        std::cout << "Null device render failed: " << ret->GetErrorString() << std::endl;
+        return -1;
+    }
+
+    Neato::null_device_stats_t stats = renderer->GetStats();
+    std::cout << "Null device: " << stats.wakeups << " wakeups, " << stats.callbacks << " callbacks, " << stats.frames_rendered
+              << " frames, " << stats.underruns << " underruns (" << stats.frames_short << " frames of silence), latest wakeup "
+              << stats.max_wakeup_late_ns / 1000.0 << " us behind schedule" << std::endl;
+    if (options.checksum)
+    {
+        std::cout << "Checksum " << std::hex << stats.checksum << std::dec << std::endl;
+    }
+    Neato::WriteDeadlineReport(std::cout, renderer->GetDeadlineStats());
+    if (render_ahead)
+    {
+        PrintRenderAheadStats(*render_ahead);
+    }
+    return 0;
+}
+#endif //__linux__
+
+static int RenderOffline(const utf8_string& file_path, double duration_seconds, const utf8_string& sample_format)
+{
+    Neato::audio_stream_description_t create_params;
+    // TestRenderer writes whatever the file is set up for
+    create_params.format_id = Neato::format_id_float_32;
+    if (sample_format == "i16" || sample_format == "i24")
+    {
+        create_params.format_id = Neato::format_id_pcm;
+        create_params.bits_per_channel = (sample_format == "i24") ? 24 : 16;
+    }
+    else if (sample_format == "f64")
+    {
+        create_params.format_id = Neato::format_id_float_64;
+    }
+    create_params.channels_per_frame = 2;
+    create_params.sample_rate = 48000;
+    create_params.frames_per_packet = 4096;
+
+    std::shared_ptr<TestRenderer> callback = CreateDemo();
+
+    std::shared_ptr<Neato::IOfflineRenderGraph> renderer;
+    try
+    {
+        renderer = Neato::CreateOfflineRenderGraph(create_params, callback, file_path, duration_seconds);
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+
+    renderer->Start(callback);
+    std::shared_ptr<Neato::IRenderReturn> ret = renderer->WaitForCompletion();
+    if (!ret->DidSucceed())
+    {
+        std::cout << "Offline render failed: " << ret->GetErrorString() << std::endl;
+        return -1;
+    }
+    Neato::offline_render_stats_t stats = renderer->GetStats();
+    std::cout << "Rendered " << stats.rendered_seconds << " s of audio to " << file_path
+              << " in " << stats.wall_clock_seconds << " s (" << stats.realtime_factor << "x realtime)" << std::endl;
+    Neato::WriteDeadlineReport(std::cout, renderer->GetDeadlineStats());
+    return 0;
+}
+
+// how far a render is from a reference render of the same thing, e.g. a NEATO_SINGLE_PRECISION build against a double one
+static int CompareRenders(const utf8_string& reference_path, const utf8_string& test_path)
+{
+    Neato::wav_contents_t reference;
+    Neato::wav_contents_t test;
+    try
+    {
+        reference = Neato::ReadWavFile(reference_path);
+        test = Neato::ReadWavFile(test_path);
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+    if (reference.stream_desc.channels_per_frame != test.stream_desc.channels_per_frame || reference.stream_desc.sample_rate != test.stream_desc.sample_rate)
+    {
+        std::cout << "The files have different channel counts or sample rates" << std::endl;
+        return -1;
+    }
+
+    const std::size_t sample_count = std::min(reference.samples.size(), test.samples.size());
+    double max_error = 0.0;
+    std::size_t max_error_index = 0;
+    double signal_power = 0.0;
+    double error_power = 0.0;
+    for (std::size_t i = 0; i < sample_count; i++)
+    {
+        const double error = test.samples[i] - reference.samples[i];
+        if (std::abs(error) > max_error)
+        {
+            max_error = std::abs(error);
+            max_error_index = i;
+        }
+        signal_power += reference.samples[i] * reference.samples[i];
+        error_power += error * error;
+    }
+    const uint32_t channels = reference.stream_desc.channels_per_frame;
+    const double rms_error = (sample_count > 0) ? std::sqrt(error_power / sample_count) : 0.0;
+    std::cout << "Compared " << sample_count / channels << " frames" << std::endl;
+    std::cout << "max |error| " << max_error << " at " << (max_error_index / channels) / reference.stream_desc.sample_rate << " s" << std::endl;
+    std::cout << "rms error   " << rms_error << " (" << ((rms_error > 0.0) ? 20.0 * std::log10(rms_error) : -std::numeric_limits<double>::infinity()) << " dBFS)" << std::endl;
+    std::cout << "SNR         " << ((error_power > 0.0) ? 10.0 * std::log10(signal_power / error_power) : std::numeric_limits<double>::infinity()) << " dB" << std::endl;
+    if (reference.samples.size() != test.samples.size())
+    {
+        std::cout << "Lengths differ, only the first " << sample_count / channels << " frames were compared" << std::endl;
+    }
+    return 0;
+}
+
+// renders the demo the way a device callback would, with the real-time audit on. exits non zero if anything
+// allocated, freed or took a lock while rendering, so CI can run it against a NEATO_RT_AUDIT build
+static int RunRtAudit(double duration_seconds)
+{
+    if (!Neato::RtAuditAvailable())
+    {
+        std::cout << "Built without NEATO_RT_AUDIT, there is nothing to audit with" << std::endl;
+        return -1;
+    }
+    Neato::audio_stream_description_t create_params;
+    create_params.format_id = Neato::format_id_float_32;
+    create_params.bits_per_channel = 32;
+    create_params.channels_per_frame = 2;
+    create_params.bytes_per_frame = create_params.channels_per_frame * (create_params.bits_per_channel / 8);
+    create_params.sample_rate = 48000;
+    create_params.frames_per_packet = 512;
+
+    std::shared_ptr<TestRenderer> renderer = CreateDemo();
+    renderer->RenderParamsValidated(create_params);
+    Neato::AuditGraph(*renderer->Mix());
+    std::vector<uint8_t> buffer(static_cast<std::size_t>(create_params.frames_per_packet) * create_params.bytes_per_frame);
+    Neato::render_params_t params;
+    params.frame_buffer = buffer.data();
+    params.frame_count = create_params.frames_per_packet;
+    const uint64_t callback_count = static_cast<uint64_t>(duration_seconds * create_params.sample_rate / create_params.frames_per_packet);
+
+    Neato::EnableRtAudit(true);
+    for (uint64_t i = 0; i < callback_count; i++)
+    {
+        Neato::rt_scope_t realtime;
+        renderer->Render(params);
+    }
+    Neato::EnableRtAudit(false);
+
+    std::vector<Neato::rt_violation_t> violations = Neato::TakeRtViolations();
+    const uint64_t dropped = Neato::DroppedRtViolations();
+    Neato::WriteRtViolationReport(std::cout, violations);
+    std::cout << "Audited " << callback_count << " callbacks of " << create_params.frames_per_packet << " frames: "
+              << violations.size() + dropped << " real-time violations" << std::endl;
+    return (violations.empty() && dropped == 0) ? 0 : 1;
+}
+
+// renders the demo with every node profiled, prints the cost tree and optionally writes folded stacks for a flame graph
+static int RunProfile(double duration_seconds, const utf8_string& folded_path)
+{
+    Neato::audio_stream_description_t create_params;
+    create_params.format_id = Neato::format_id_float_32;
+    create_params.bits_per_channel = 32;
+    create_params.channels_per_frame = 2;
+    create_params.bytes_per_frame = create_params.channels_per_frame * (create_params.bits_per_channel / 8);
+    create_params.sample_rate = 48000;
+    create_params.frames_per_packet = 512;
+
+    // uncompiled, so every oscillator and envelope shows up in the profile on its own
+    std::shared_ptr<TestRenderer> renderer = CreateDemo(false);
+    renderer->RenderParamsValidated(create_params);
+    std::shared_ptr<Neato::GraphProfile> profile = Neato::ProfileGraph(*renderer->Mix());
+    std::vector<uint8_t> buffer(static_cast<std::size_t>(create_params.frames_per_packet) * create_params.bytes_per_frame);
+    Neato::render_params_t params;
+    params.frame_buffer = buffer.data();
+    params.frame_count = create_params.frames_per_packet;
+    const uint64_t callback_count = static_cast<uint64_t>(duration_seconds * create_params.sample_rate / create_params.frames_per_packet);
+    for (uint64_t i = 0; i < callback_count; i++)
+    {
+        renderer->Render(params);
+    }
+
+    profile->WriteTreeReport(std::cout);
+    if (!folded_path.empty())
+    {
+        std::ofstream folded_out(folded_path);
+        if (!folded_out)
+        {
+            std::cout << "Unable to open " << folded_path << std::endl;
+            return -1;
+        }
+        profile->WriteFoldedStacks(folded_out);
+    }
+    return 0;
+}
+
+// builds and renders the demo once without and once with a render cache, and checks the two come out the same
+static int RunRenderCacheComparison(double duration_seconds)
+{
+    Neato::audio_stream_description_t create_params;
+    create_params.format_id = Neato::format_id_float_32;
+    create_params.bits_per_channel = 32;
+    create_params.channels_per_frame = 2;
+    create_params.bytes_per_frame = create_params.channels_per_frame * (create_params.bits_per_channel / 8);
+    create_params.sample_rate = 48000;
+    create_params.frames_per_packet = 512;
+    const uint64_t callback_count = static_cast<uint64_t>(duration_seconds * create_params.sample_rate / create_params.frames_per_packet);
+
+    // graph construction is timed too, it's where the cache does its rendering
+    auto render = [&](std::shared_ptr<Neato::RenderCache> render_cache, uint64_t& checksum)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<TestRenderer> renderer = CreateDemo(true, render_cache);
+        renderer->RenderParamsValidated(create_params);
+        std::vector<uint8_t> buffer(static_cast<std::size_t>(create_params.frames_per_packet) * create_params.bytes_per_frame);
+        Neato::render_params_t params;
+        params.frame_buffer = buffer.data();
+        params.frame_count = create_params.frames_per_packet;
+        checksum = 14695981039346656037ull;
+        for (uint64_t i = 0; i < callback_count; i++)
+        {
+            renderer->Render(params);
+            // FNV-1a
+            for (uint8_t byte : buffer)
+            {
+                checksum = (checksum ^ byte) * 1099511628211ull;
+            }
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    uint64_t uncached_checksum = 0;
+    uint64_t cached_checksum = 0;
+    const double uncached_seconds = render(nullptr, uncached_checksum);
+    std::shared_ptr<Neato::RenderCache> render_cache = std::make_shared<Neato::RenderCache>(create_params.sample_rate, 64 * 1024 * 1024);
+    const double cached_seconds = render(render_cache, cached_checksum);
+
+    Neato::render_cache_stats_t stats = render_cache->Stats();
+    std::cout << "Without the cache " << uncached_seconds << " s, with it " << cached_seconds << " s ("
+              << uncached_seconds / cached_seconds << "x)" << std::endl;
+    std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.uncacheable << " uncacheable, "
+              << stats.entries << " renders in " << stats.bytes / 1024 << " KB" << std::endl;
+    std::cout << ((uncached_checksum == cached_checksum) ? "Renders match" : "Renders differ") << std::endl;
+    return (uncached_checksum == cached_checksum) ? 0 : 1;
+}
+
+static int RunBenchmarks(const utf8_string& format, const utf8_string& file_path)
+{
+    std::vector<Neato::benchmark_result_t> results = Neato::RunBenchmarks(Neato::DefaultBenchmarkCases(), Neato::benchmark_options_t());
+    std::ofstream file_out;
+    if (!file_path.empty())
+    {
+        file_out.open(file_path);
+        if (!file_out)
+        {
+            std::cout << "Unable to open " << file_path << std::endl;
+            return -1;
+        }
+    }
+    std::ostream& out = file_path.empty() ? std::cout : file_out;
+    if (format == "csv")
+    {
+        Neato::WriteBenchmarkCsv(out, results);
+    }
+    else
+    {
+        Neato::WriteBenchmarkJson(out, results);
+    }
+    return 0;
+}
+
+int main(int argc, const char * argv[])
+{
+    // siggen --stereo [any of the below]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--stereo"))
+    {
+        panned_demo = true;
+        argv++;
+        argc--;
+    }
+    // siggen --offline [file.wav] [seconds] [i16|i24|f32|f64]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--offline"))
+    {
+        utf8_string file_path = (argc >= 3) ? argv[2] : "siggen.wav";
+        double duration_seconds = (argc >= 4) ? std::atof(argv[3]) : 20.0;
+        utf8_string sample_format = (argc >= 5) ? argv[4] : "f32";
+        return RenderOffline(file_path, duration_seconds, sample_format);
+    }
+    // siggen --compare reference.wav test.wav
+    if (argc >= 4 && 0 == std::strcmp(argv[1], "--compare"))
+    {
+        return CompareRenders(argv[2], argv[3]);
+    }
+    // siggen --bench [json|csv] [file]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--bench"))
+    {
+        utf8_string format = (argc >= 3) ? argv[2] : "json";
+        utf8_string file_path = (argc >= 4) ? argv[3] : "";
+        return RunBenchmarks(format, file_path);
+    }
+    // siggen --cache [seconds]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--cache"))
+    {
+        double duration_seconds = (argc >= 3) ? std::atof(argv[2]) : 20.0;
+        return RunRenderCacheComparison(duration_seconds);
+    }
+    // siggen --rt-audit [seconds]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--rt-audit"))
+    {
+        double duration_seconds = (argc >= 3) ? std::atof(argv[2]) : 20.0;
+        return RunRtAudit(duration_seconds);
+    }
+    // siggen --profile [seconds] [folded.txt]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--profile"))
+    {
+        double duration_seconds = (argc >= 3) ? std::atof(argv[2]) : 20.0;
+        utf8_string folded_path = (argc >= 4) ? argv[3] : "";
+        return RunProfile(duration_seconds, folded_path);
+    }
+#if defined(__linux__)
+    // siggen --null [seconds] [jitter milliseconds] [fixed|variable] [lookahead milliseconds] [rt]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--null"))
+    {
+        Neato::null_device_options_t options;
+        double duration_seconds = (argc >= 3) ? std::atof(argv[2]) : 10.0;
+        options.jitter_seconds = (argc >= 4) ? std::atof(argv[3]) / 1000.0 : 0.0;
+        options.variable_buffer_size = (argc >= 5) && (0 == std::strcmp(argv[4], "variable"));
+        double lookahead_ms = (argc >= 6) ? std::atof(argv[5]) : 0.0;
+        bool realtime = (argc >= 7) && (0 == std::strcmp(argv[6], "rt"));
+        return RenderToNullDevice(duration_seconds, options, lookahead_ms, realtime);
+    }
+#endif //__linux__
+    // siggen --ahead [milliseconds]
+    if (argc >= 2 && 0 == std::strcmp(argv[1], "--ahead"))
+    {
+        double lookahead_ms = (argc >= 3) ? std::atof(argv[2]) : 50.0;
+        return RenderToDevice(lookahead_ms);
+    }
+    return RenderToDevice(0.0);
+}
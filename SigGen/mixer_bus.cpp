@@ -0,0 +1,280 @@
+//
+//  mixer_bus.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include "mixer_bus.hpp"
+#include "simd.hpp"
+
+namespace
+{
+    // outputs[m][i] += in[i] * (start_gains[m] + i * steps[m]) for every output, reading the input once
+    template <typename T>
+    void MixScalar(const T* in, T* const* outputs, const double* start_gains, const double* steps, uint32_t output_count, std::size_t frame_count)
+    {
+        for (std::size_t i = 0; i < frame_count; i++)
+        {
+            const T sample = in[i];
+            for (uint32_t m = 0; m < output_count; m++)
+            {
+                outputs[m][i] += sample * static_cast<T>(start_gains[m] + i * steps[m]);
+            }
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // the gain of every lane comes from its own frame index, so a ramp doesn't drift over the block
+    template <typename T>
+    NEATO_TARGET_AVX2 void MixAvx2(const T* in, T* const* outputs, const double* start_gains, const double* steps, uint32_t output_count, std::size_t frame_count)
+    {
+        using namespace Neato::simd;
+        constexpr std::size_t lanes = avx_lanes<T>;
+        const std::size_t vector_count = frame_count & ~(lanes - 1);
+        T first_lanes[lanes];
+        for (std::size_t k = 0; k < lanes; k++)
+        {
+            first_lanes[k] = static_cast<T>(k);
+        }
+        const avx_t<T> lane_index = LoadAvx(first_lanes);
+        avx_t<T> start[Neato::MixerBus::max_outputs];
+        avx_t<T> step[Neato::MixerBus::max_outputs];
+        for (uint32_t m = 0; m < output_count; m++)
+        {
+            start[m] = BroadcastAvx<T>(start_gains[m]);
+            step[m] = BroadcastAvx<T>(steps[m]);
+        }
+        for (std::size_t i = 0; i < vector_count; i += lanes)
+        {
+            const avx_t<T> sample = LoadAvx(in + i);
+            const avx_t<T> index = Add(BroadcastAvx<T>(static_cast<double>(i)), lane_index);
+            for (uint32_t m = 0; m < output_count; m++)
+            {
+                const avx_t<T> gain = Add(start[m], Mul(step[m], index));
+                Store(outputs[m] + i, Add(LoadAvx(outputs[m] + i), Mul(sample, gain)));
+            }
+        }
+        _mm256_zeroupper();
+        if (vector_count < frame_count)
+        {
+            T* tail_outputs[Neato::MixerBus::max_outputs];
+            double tail_gains[Neato::MixerBus::max_outputs];
+            for (uint32_t m = 0; m < output_count; m++)
+            {
+                tail_outputs[m] = outputs[m] + vector_count;
+                tail_gains[m] = start_gains[m] + vector_count * steps[m];
+            }
+            MixScalar(in + vector_count, tail_outputs, tail_gains, steps, output_count, frame_count - vector_count);
+        }
+    }
+#endif //NEATO_SIMD_X86
+
+    using mix_fn = void (*)(const Neato::sample_t* in, Neato::sample_t* const* outputs, const double* start_gains, const double* steps, uint32_t output_count, std::size_t frame_count);
+
+    mix_fn SelectMixKernel()
+    {
+#if NEATO_SIMD_X86
+        if (Neato::CpuHasAvx2())
+        {
+            return &MixAvx2<Neato::sample_t>;
+        }
+#endif //NEATO_SIMD_X86
+        return &MixScalar<Neato::sample_t>;
+    }
+
+    uint32_t OutputCountOf(const std::vector<std::vector<double>>& gains)
+    {
+        if (gains.empty() || gains.front().empty())
+        {
+            throw std::runtime_error("MixerBus needs at least one input and one output");
+        }
+        const std::size_t output_count = gains.front().size();
+        for (const std::vector<double>& row : gains)
+        {
+            if (row.size() != output_count)
+            {
+                throw std::runtime_error("MixerBus gain rows must all be the same length");
+            }
+        }
+        if (output_count > Neato::MixerBus::max_outputs)
+        {
+            throw std::runtime_error("MixerBus has too many outputs");
+        }
+        return static_cast<uint32_t>(output_count);
+    }
+}
+
+void Neato::ConstantPowerPan(double pan, double gain, std::span<double> row)
+{
+    std::fill(row.begin(), row.end(), 0.0);
+    if (row.empty())
+    {
+        return;
+    }
+    if (row.size() == 1)
+    {
+        row[0] = gain;
+        return;
+    }
+    const double position = 0.5 * (std::clamp(pan, -1.0, 1.0) + 1.0) * (row.size() - 1);
+    const std::size_t low = std::min(static_cast<std::size_t>(position), row.size() - 2);
+    const double angle = (position - low) * 0.5 * std::numbers::pi;
+    row[low] = gain * std::cos(angle);
+    row[low + 1] = gain * std::sin(angle);
+}
+
+Neato::MixerBus::MixerBus(const sample_source_vector_t& inputs_in, const std::vector<std::vector<double>>& gains_in, double sample_rate, double smoothing_seconds, uint32_t max_block_frames_in)
+    : inputs(inputs_in)
+    , output_count(OutputCountOf(gains_in))
+    , cells(inputs_in.size() * output_count)
+    , smoothing_frames(static_cast<uint32_t>(std::lround(std::max(0.0, smoothing_seconds) * sample_rate)))
+    , max_block_frames(max_block_frames_in)
+    , scratch(max_block_frames_in)
+{
+    if (gains_in.size() != inputs.size())
+    {
+        throw std::runtime_error("MixerBus needs one row of gains per input");
+    }
+    // the starting gains are in place from the first frame
+    for (uint32_t input = 0; input < inputs.size(); input++)
+    {
+        for (uint32_t output = 0; output < output_count; output++)
+        {
+            gain_cell_t& cell = Cell(input, output);
+            cell.current = gains_in[input][output];
+            cell.target = cell.current;
+        }
+    }
+}
+
+void Neato::MixerBus::setGain(uint32_t input, uint32_t output, double gain)
+{
+    gain_cell_t& cell = Cell(input, output);
+    cell.target = gain;
+    if (smoothing_frames == 0)
+    {
+        cell.current = gain;
+        cell.remaining = 0;
+        return;
+    }
+    // a new target mid ramp starts a fresh ramp from wherever the gain got to
+    cell.step = (gain - cell.current) / smoothing_frames;
+    cell.remaining = smoothing_frames;
+}
+
+void Neato::MixerBus::setPan(uint32_t input, double pan, double gain)
+{
+    double row[max_outputs];
+    ConstantPowerPan(pan, gain, std::span<double>(row, output_count));
+    for (uint32_t output = 0; output < output_count; output++)
+    {
+        setGain(input, output, row[output]);
+    }
+}
+
+void Neato::MixerBus::SampleChannels(std::span<const std::span<sample_t>> channels)
+{
+    assert(channels.size() == output_count);
+    const std::size_t frame_count = channels.front().size();
+    for (const std::span<sample_t>& channel : channels)
+    {
+        assert(channel.size() == frame_count);
+        std::fill(channel.begin(), channel.end(), sample_t(0));
+    }
+    std::size_t written = 0;
+    while (written < frame_count)
+    {
+        const std::size_t count = std::min<std::size_t>(frame_count - written, max_block_frames);
+        std::span<sample_t> block(scratch.data(), count);
+        for (uint32_t input = 0; input < inputs.size(); input++)
+        {
+            inputs[input]->SampleBlock(block);
+            Mix(input, block.data(), channels, written, count);
+        }
+        written += count;
+    }
+}
+
+void Neato::MixerBus::Mix(uint32_t input, const sample_t* in, std::span<const std::span<sample_t>> channels, std::size_t offset, std::size_t frame_count)
+{
+    static const mix_fn mix = SelectMixKernel();
+    sample_t* outputs[max_outputs];
+    double start_gains[max_outputs];
+    double steps[max_outputs];
+    // the block is split wherever a ramp ends, so within each piece every gain is a straight line
+    std::size_t done = 0;
+    while (done < frame_count)
+    {
+        std::size_t segment = frame_count - done;
+        for (uint32_t output = 0; output < output_count; output++)
+        {
+            const gain_cell_t& cell = Cell(input, output);
+            if (cell.remaining > 0)
+            {
+                segment = std::min<std::size_t>(segment, cell.remaining);
+            }
+        }
+        for (uint32_t output = 0; output < output_count; output++)
+        {
+            const gain_cell_t& cell = Cell(input, output);
+            outputs[output] = channels[output].data() + offset + done;
+            start_gains[output] = cell.current;
+            steps[output] = (cell.remaining > 0) ? cell.step : 0.0;
+        }
+        mix(in + done, outputs, start_gains, steps, output_count, segment);
+        for (uint32_t output = 0; output < output_count; output++)
+        {
+            gain_cell_t& cell = Cell(input, output);
+            if (cell.remaining > 0)
+            {
+                cell.remaining -= static_cast<uint32_t>(segment);
+                cell.current = (cell.remaining == 0) ? cell.target : cell.current + segment * cell.step;
+            }
+        }
+        done += segment;
+    }
+}
+
+void Neato::MixerBus::ForEachChild(const child_visitor_t& visitor)
+{
+    for (std::shared_ptr<ISampleSource>& input : inputs)
+    {
+        visitor(input);
+    }
+}
+
+void Neato::MixerBus::Reset()
+{
+    for (std::shared_ptr<ISampleSource>& input : inputs)
+    {
+        input->Reset();
+    }
+    for (gain_cell_t& cell : cells)
+    {
+        cell.current = cell.target;
+        cell.remaining = 0;
+    }
+}
+
+std::shared_ptr<Neato::MixerBus> Neato::CreateMixerBus(const sample_source_vector_t& inputs, const std::vector<std::vector<double>>& gains, double sample_rate)
+{
+    return std::make_shared<MixerBus>(inputs, gains, sample_rate);
+}
+
+std::shared_ptr<Neato::MixerBus> Neato::CreatePannedMixerBus(const sample_source_vector_t& inputs, const std::vector<double>& pans, uint32_t output_count, double sample_rate)
+{
+    if (pans.size() != inputs.size())
+    {
+        throw std::runtime_error("CreatePannedMixerBus needs one pan per input");
+    }
+    std::vector<std::vector<double>> gains(inputs.size(), std::vector<double>(output_count));
+    for (std::size_t input = 0; input < inputs.size(); input++)
+    {
+        ConstantPowerPan(pans[input], 1.0, gains[input]);
+    }
+    return std::make_shared<MixerBus>(inputs, gains, sample_rate);
+}
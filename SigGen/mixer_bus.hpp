@@ -0,0 +1,75 @@
+//
+//  mixer_bus.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    // a node with more than one output channel, every channel's block is filled in one call
+    class IMultichannelSource
+    {
+    public:
+        virtual uint32_t ChannelCount() const = 0;
+        // one block per channel, all the same length
+        virtual void SampleChannels(std::span<const std::span<sample_t>> channels) = 0;
+        virtual void ForEachChild(const child_visitor_t& visitor) {}
+        virtual void Reset() {}
+        virtual ~IMultichannelSource() {}
+    };
+
+    // the gains that put a source at pan (-1 first output, +1 last) on a line of outputs. the two nearest
+    // outputs share it on a sin/cos law so the power stays the same wherever it sits. for stereo that is
+    // the usual -3 dB in the middle
+    void ConstantPowerPan(double pan, double gain, std::span<double> row);
+
+    // N inputs into M outputs through an N x M gain matrix. Each input block is rendered once and added into
+    // every output in the same pass, instead of one summer per channel each rendering its own copy. Gain
+    // changes ramp linearly over the smoothing time so moving a source doesn't click. The setters are for
+    // the render thread, or a ControlledSource parameter, like the rest of the graph.
+    class MixerBus : public IMultichannelSource
+    {
+    public:
+        // enough for 7.1.4 and then some, keeps the per output state of the mixing loop on the stack
+        static constexpr uint32_t max_outputs = 16;
+
+        // gains_in is N rows of M, one row per input
+        MixerBus(const sample_source_vector_t& inputs_in, const std::vector<std::vector<double>>& gains_in, double sample_rate, double smoothing_seconds = 0.01, uint32_t max_block_frames_in = 4096);
+        virtual uint32_t ChannelCount() const { return output_count; }
+        virtual void SampleChannels(std::span<const std::span<sample_t>> channels);
+        virtual void ForEachChild(const child_visitor_t& visitor);
+        // resets the inputs and lands any ramp in progress on its target
+        virtual void Reset();
+        uint32_t InputCount() const { return static_cast<uint32_t>(inputs.size()); }
+        double getGain(uint32_t input, uint32_t output) const { return Cell(input, output).target; }
+        void setGain(uint32_t input, uint32_t output, double gain);
+        void setPan(uint32_t input, double pan, double gain = 1.0);
+
+        struct gain_cell_t
+        {
+            double current = 0.0;
+            double target = 0.0;
+            double step = 0.0;
+            uint32_t remaining = 0;     // frames left on the ramp, 0 when settled
+        };
+
+    private:
+        gain_cell_t& Cell(uint32_t input, uint32_t output) { return cells[static_cast<std::size_t>(input) * output_count + output]; }
+        const gain_cell_t& Cell(uint32_t input, uint32_t output) const { return cells[static_cast<std::size_t>(input) * output_count + output]; }
+        void Mix(uint32_t input, const sample_t* in, std::span<const std::span<sample_t>> channels, std::size_t offset, std::size_t frame_count);
+
+        sample_source_vector_t inputs;
+        const uint32_t output_count;
+        std::vector<gain_cell_t> cells;
+        const uint32_t smoothing_frames;
+        const uint32_t max_block_frames;
+        std::vector<sample_t> scratch;
+    };
+
+    std::shared_ptr<MixerBus> CreateMixerBus(const sample_source_vector_t& inputs, const std::vector<std::vector<double>>& gains, double sample_rate);
+    // every input at unity gain, placed with ConstantPowerPan
+    std::shared_ptr<MixerBus> CreatePannedMixerBus(const sample_source_vector_t& inputs, const std::vector<double>& pans, uint32_t output_count, double sample_rate);
+};
@@ -0,0 +1,26 @@
+//
+//  node_decorator.cpp
+//  SigGen
+//
+
+#include <cstdlib>
+#include "node_decorator.hpp"
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif //__GNUG__
+
+std::string Neato::DemangleTypeName(const char* name)
+{
+#if defined(__GNUG__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (demangled)
+    {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif //__GNUG__
+    return name;
+}
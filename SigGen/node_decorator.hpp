@@ -0,0 +1,71 @@
+//
+//  node_decorator.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <string>
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    // a typeid() name the way it reads in the source, or as it came where the platform can't demangle it
+    std::string DemangleTypeName(const char* name);
+
+    // Stands in for a node and forwards everything to it, for the decorators that go around every node of
+    // a graph (the profiler, the real-time audit) to override the render calls of. It's transparent: the
+    // wrapped node's children are this one's, and it describes as the wrapped node, so a decorated graph
+    // still goes through a RenderCache.
+    template <typename Interface>
+    class ForwardingNode : public Interface
+    {
+    public:
+        explicit ForwardingNode(std::shared_ptr<Interface> inner_in)
+            : inner(inner_in)
+        {
+        }
+        virtual sample_t Sample()
+        {
+            return inner->Sample();
+        }
+        virtual void SampleBlock(std::span<sample_t> block)
+        {
+            inner->SampleBlock(block);
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor)
+        {
+            inner->ForEachChild(visitor);
+        }
+        virtual void Reset()
+        {
+            inner->Reset();
+        }
+        virtual bool Describe(GraphDescription& description) const
+        {
+            return inner->Describe(description);
+        }
+        virtual const ISampleSource* DescribedNode() const
+        {
+            return inner->DescribedNode();
+        }
+        std::shared_ptr<ISampleSource> Inner() const
+        {
+            return inner;
+        }
+    protected:
+        std::shared_ptr<Interface> inner;
+    };
+
+    // a decorator over a node with a duration keeps the duration, so a sequence still takes it
+    template <typename Decorator>
+    class DurationForwardingNode : public Decorator
+    {
+    public:
+        using Decorator::Decorator;
+        virtual double Duration() const
+        {
+            return this->inner->Duration();
+        }
+    };
+};
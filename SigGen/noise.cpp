@@ -0,0 +1,339 @@
+//
+//  noise.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <cmath>
+#include "noise.hpp"
+#include "fast_math.hpp"
+#include "simd.hpp"
+
+namespace
+{
+    // which family of streams a key is for, so white and gaussian noise of one seed have nothing to do with
+    // each other
+    constexpr uint64_t uniform_variant = 0;
+    constexpr uint64_t gaussian_variant = 1;
+
+    struct noise_key_t
+    {
+        uint32_t k0;
+        uint32_t k1;
+    };
+
+    constexpr uint32_t mix_multiplier_1 = 0x7feb352d;
+    constexpr uint32_t mix_multiplier_2 = 0x846ca68b;
+    // one key covers 2^32 positions, the high half of the position goes into the key
+    constexpr uint64_t epoch_length = uint64_t(1) << 32;
+
+    uint64_t SplitMix64(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    noise_key_t NoiseKey(uint64_t variant, uint64_t seed, uint64_t stream, uint64_t epoch)
+    {
+        const uint64_t key = SplitMix64(seed ^ SplitMix64(stream ^ SplitMix64(epoch ^ SplitMix64(variant))));
+        return {static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)};
+    }
+
+    // invertible, with low bias in its avalanche
+    inline uint32_t Mix32(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= mix_multiplier_1;
+        x ^= x >> 15;
+        x *= mix_multiplier_2;
+        x ^= x >> 16;
+        return x;
+    }
+
+    inline uint32_t NoiseBits(noise_key_t key, uint32_t counter)
+    {
+        return Mix32(Mix32(counter ^ key.k0) ^ key.k1);
+    }
+
+    // the top bits as a signed fraction, exactly representable in the sample type
+    inline double UniformFromBits(uint32_t bits, double*)
+    {
+        return static_cast<double>(static_cast<int32_t>(bits)) * (1.0 / 2147483648.0);
+    }
+
+    inline float UniformFromBits(uint32_t bits, float*)
+    {
+        return static_cast<float>(static_cast<int32_t>(bits) >> 8) * (1.0f / 8388608.0f);
+    }
+
+    template <typename T>
+    void UniformScalar(noise_key_t key, uint32_t counter, T* out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            out[i] = UniformFromBits(NoiseBits(key, counter + static_cast<uint32_t>(i)), static_cast<T*>(nullptr));
+        }
+    }
+
+    void BitsScalar(noise_key_t key, uint32_t counter, uint32_t* out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            out[i] = NoiseBits(key, counter + static_cast<uint32_t>(i));
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // SSE2 only multiplies the even lanes, do the odd ones shifted down and put them back together
+    inline __m128i MulLo32Sse2(__m128i a, __m128i b)
+    {
+        const __m128i even = _mm_mul_epu32(a, b);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    inline __m128i Mix32Sse2(__m128i x)
+    {
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+        x = MulLo32Sse2(x, _mm_set1_epi32(static_cast<int>(mix_multiplier_1)));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+        x = MulLo32Sse2(x, _mm_set1_epi32(static_cast<int>(mix_multiplier_2)));
+        return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    }
+
+    inline __m128i NoiseBitsSse2(noise_key_t key, __m128i counters)
+    {
+        const __m128i mixed = Mix32Sse2(_mm_xor_si128(counters, _mm_set1_epi32(static_cast<int>(key.k0))));
+        return Mix32Sse2(_mm_xor_si128(mixed, _mm_set1_epi32(static_cast<int>(key.k1))));
+    }
+
+    inline void StoreUniformSse2(double* out, __m128i bits)
+    {
+        const __m128d scale = _mm_set1_pd(1.0 / 2147483648.0);
+        _mm_storeu_pd(out, _mm_mul_pd(_mm_cvtepi32_pd(bits), scale));
+        _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(bits, _MM_SHUFFLE(3, 2, 3, 2))), scale));
+    }
+
+    inline void StoreUniformSse2(float* out, __m128i bits)
+    {
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(bits, 8)), _mm_set1_ps(1.0f / 8388608.0f)));
+    }
+
+    // four positions a register
+    template <typename T>
+    void UniformSse2(noise_key_t key, uint32_t counter, T* out, std::size_t count)
+    {
+        const std::size_t vector_count = count - count % 4;
+        __m128i counters = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(counter)), _mm_setr_epi32(0, 1, 2, 3));
+        for (std::size_t i = 0; i < vector_count; i += 4)
+        {
+            StoreUniformSse2(out + i, NoiseBitsSse2(key, counters));
+            counters = _mm_add_epi32(counters, _mm_set1_epi32(4));
+        }
+        UniformScalar(key, counter + static_cast<uint32_t>(vector_count), out + vector_count, count - vector_count);
+    }
+
+    void BitsSse2(noise_key_t key, uint32_t counter, uint32_t* out, std::size_t count)
+    {
+        const std::size_t vector_count = count - count % 4;
+        __m128i counters = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(counter)), _mm_setr_epi32(0, 1, 2, 3));
+        for (std::size_t i = 0; i < vector_count; i += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), NoiseBitsSse2(key, counters));
+            counters = _mm_add_epi32(counters, _mm_set1_epi32(4));
+        }
+        BitsScalar(key, counter + static_cast<uint32_t>(vector_count), out + vector_count, count - vector_count);
+    }
+
+    NEATO_TARGET_AVX2 inline __m256i Mix32Avx2(__m256i x)
+    {
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(mix_multiplier_1)));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+        x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(mix_multiplier_2)));
+        return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    }
+
+    NEATO_TARGET_AVX2 inline __m256i NoiseBitsAvx2(noise_key_t key, __m256i counters)
+    {
+        const __m256i mixed = Mix32Avx2(_mm256_xor_si256(counters, _mm256_set1_epi32(static_cast<int>(key.k0))));
+        return Mix32Avx2(_mm256_xor_si256(mixed, _mm256_set1_epi32(static_cast<int>(key.k1))));
+    }
+
+    NEATO_TARGET_AVX2 inline void StoreUniformAvx2(double* out, __m256i bits)
+    {
+        const __m256d scale = _mm256_set1_pd(1.0 / 2147483648.0);
+        _mm256_storeu_pd(out, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(bits)), scale));
+        _mm256_storeu_pd(out + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(bits, 1)), scale));
+    }
+
+    NEATO_TARGET_AVX2 inline void StoreUniformAvx2(float* out, __m256i bits)
+    {
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(bits, 8)), _mm256_set1_ps(1.0f / 8388608.0f)));
+    }
+
+    // eight positions a register
+    template <typename T>
+    NEATO_TARGET_AVX2 void UniformAvx2(noise_key_t key, uint32_t counter, T* out, std::size_t count)
+    {
+        const std::size_t vector_count = count - count % 8;
+        __m256i counters = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (std::size_t i = 0; i < vector_count; i += 8)
+        {
+            StoreUniformAvx2(out + i, NoiseBitsAvx2(key, counters));
+            counters = _mm256_add_epi32(counters, _mm256_set1_epi32(8));
+        }
+        // the tail runs legacy SSE code, leaving the upper halves dirty would stall every instruction in it
+        _mm256_zeroupper();
+        UniformScalar(key, counter + static_cast<uint32_t>(vector_count), out + vector_count, count - vector_count);
+    }
+
+    NEATO_TARGET_AVX2 void BitsAvx2(noise_key_t key, uint32_t counter, uint32_t* out, std::size_t count)
+    {
+        const std::size_t vector_count = count - count % 8;
+        __m256i counters = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (std::size_t i = 0; i < vector_count; i += 8)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), NoiseBitsAvx2(key, counters));
+            counters = _mm256_add_epi32(counters, _mm256_set1_epi32(8));
+        }
+        _mm256_zeroupper();
+        BitsScalar(key, counter + static_cast<uint32_t>(vector_count), out + vector_count, count - vector_count);
+    }
+#endif //NEATO_SIMD_X86
+
+    using uniform_fn = void (*)(noise_key_t, uint32_t, Neato::sample_t*, std::size_t);
+    using bits_fn = void (*)(noise_key_t, uint32_t, uint32_t*, std::size_t);
+
+    uniform_fn SelectUniformKernel()
+    {
+#if NEATO_SIMD_X86
+        return Neato::CpuHasAvx2() ? &UniformAvx2<Neato::sample_t> : &UniformSse2<Neato::sample_t>;
+#else
+        return &UniformScalar<Neato::sample_t>;
+#endif //NEATO_SIMD_X86
+    }
+
+    bits_fn SelectBitsKernel()
+    {
+#if NEATO_SIMD_X86
+        return Neato::CpuHasAvx2() ? &BitsAvx2 : &BitsSse2;
+#else
+        return &BitsScalar;
+#endif //NEATO_SIMD_X86
+    }
+}
+
+Neato::NoiseGenerator::NoiseGenerator(uint64_t seed_in, uint64_t stream_in)
+    : seed(seed_in)
+    , stream(stream_in)
+{
+}
+
+void Neato::NoiseGenerator::UpdateKey(cached_key_t& key, uint64_t variant, uint64_t epoch)
+{
+    if (epoch != key.epoch)
+    {
+        const noise_key_t new_key = NoiseKey(variant, seed, stream, epoch);
+        key.epoch = epoch;
+        key.k0 = new_key.k0;
+        key.k1 = new_key.k1;
+    }
+}
+
+// splits the run wherever the position crosses into the next epoch, which takes a new key
+template <typename Out, typename Kernel>
+void Neato::NoiseGenerator::FillByEpoch(cached_key_t& key, uint64_t variant, uint64_t position, Out* out, std::size_t count, Kernel kernel)
+{
+    std::size_t written = 0;
+    while (written < count)
+    {
+        const uint64_t at = position + written;
+        UpdateKey(key, variant, at >> 32);
+        const std::size_t run = static_cast<std::size_t>(std::min<uint64_t>(count - written, epoch_length - (at & (epoch_length - 1))));
+        kernel({key.k0, key.k1}, static_cast<uint32_t>(at), out + written, run);
+        written += run;
+    }
+}
+
+void Neato::NoiseGenerator::FillUniform(uint64_t position, std::span<sample_t> block)
+{
+    static const uniform_fn uniform = SelectUniformKernel();
+    FillByEpoch(uniform_key, uniform_variant, position, block.data(), block.size(), uniform);
+}
+
+Neato::sample_t Neato::NoiseGenerator::Uniform(uint64_t position)
+{
+    UpdateKey(uniform_key, uniform_variant, position >> 32);
+    return UniformFromBits(NoiseBits({uniform_key.k0, uniform_key.k1}, static_cast<uint32_t>(position)), static_cast<sample_t*>(nullptr));
+}
+
+void Neato::NoiseGenerator::FillGaussian(uint64_t position, std::span<sample_t> block)
+{
+    static const bits_fn fill_bits = SelectBitsKernel();
+    // a pair at a time out of a stack buffer of hashes, so nothing here allocates
+    constexpr std::size_t pairs_per_chunk = 128;
+    uint32_t bits[2 * pairs_per_chunk];
+    std::size_t written = 0;
+    while (written < block.size())
+    {
+        const uint64_t first_pair = (position + written) >> 1;
+        const uint64_t last_pair = (position + block.size() - 1) >> 1;
+        const std::size_t pair_count = static_cast<std::size_t>(std::min<uint64_t>(pairs_per_chunk, last_pair - first_pair + 1));
+        FillByEpoch(gaussian_key, gaussian_variant, 2 * first_pair, bits, 2 * pair_count, fill_bits);
+        for (std::size_t pair = 0; pair < pair_count && written < block.size(); pair++)
+        {
+            // (0, 1] for the radius so the log is finite, [0, 1) for the angle
+            const double radius = std::sqrt(-2.0 * std::log((bits[2 * pair] + 1.0) * (1.0 / 4294967296.0)));
+            const double angle = bits[2 * pair + 1] * (1.0 / 4294967296.0);
+            if (position + written == 2 * (first_pair + pair))
+            {
+                const double cycles = angle + 0.25;
+                block[written++] = static_cast<sample_t>(radius * SineOfCycles<SineAccuracy::full>(cycles - std::floor(cycles + 0.5)));
+            }
+            if (written < block.size())
+            {
+                block[written++] = static_cast<sample_t>(radius * SineOfCycles<SineAccuracy::full>(angle - std::floor(angle + 0.5)));
+            }
+        }
+    }
+}
+
+void Neato::FillUniformNoise(uint64_t seed, uint64_t stream, uint64_t position, std::span<sample_t> block)
+{
+    NoiseGenerator(seed, stream).FillUniform(position, block);
+}
+
+void Neato::FillGaussianNoise(uint64_t seed, uint64_t stream, uint64_t position, std::span<sample_t> block)
+{
+    NoiseGenerator(seed, stream).FillGaussian(position, block);
+}
+
+void Neato::pink_filter_t::Process(std::span<sample_t> block)
+{
+    // keeps the output of full scale white under about +-1 most of the time
+    constexpr double output_gain = 0.11;
+    // in locals, otherwise every store to the block could be a store to the state and nothing stays in a register
+    double b0 = b[0], b1 = b[1], b2 = b[2], b3 = b[3], b4 = b[4], b5 = b[5], b6 = b[6];
+    for (sample_t& sample : block)
+    {
+        const double white = sample;
+        b0 = 0.99886 * b0 + white * 0.0555179;
+        b1 = 0.99332 * b1 + white * 0.0750759;
+        b2 = 0.96900 * b2 + white * 0.1538520;
+        b3 = 0.86650 * b3 + white * 0.3104856;
+        b4 = 0.55000 * b4 + white * 0.5329522;
+        b5 = -0.7616 * b5 - white * 0.0168980;
+        const double pink = b0 + b1 + b2 + b3 + b4 + b5 + b6 + white * 0.5362;
+        b6 = white * 0.115926;
+        sample = static_cast<sample_t>(pink * output_gain);
+    }
+    b[0] = b0, b[1] = b1, b[2] = b2, b[3] = b3, b[4] = b4, b[5] = b5, b[6] = b6;
+}
+
+void Neato::pink_filter_t::Reset()
+{
+    std::fill(std::begin(b), std::end(b), 0.0);
+}
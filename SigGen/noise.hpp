@@ -0,0 +1,68 @@
+//
+//  noise.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include "sample_type.hpp"
+
+namespace Neato
+{
+    // Counter-based noise. Sample n of a stream isn't the next state of a generator, it's n run through a
+    // small keyed hash (two rounds of an invertible 32 bit mix, the key folded in before each), so any
+    // position can be jumped to directly and any number of streams run side by side without sharing
+    // anything. The key comes from a 64 bit seed and a 64 bit stream id: the streams of one seed are
+    // independent of each other, and one stream can be split across threads by position. It's all integer
+    // arithmetic up to the last conversion, so a seed, stream and position give the same bits whatever the
+    // block sizes, the CPU or which of the scalar, SSE2 and AVX2 kernels ran.
+    //
+    // Not for anything cryptographic.
+
+    class NoiseGenerator
+    {
+    public:
+        NoiseGenerator(uint64_t seed_in, uint64_t stream_in);
+        // uniform in [-1, 1), positions position ... position + block.size() - 1 of the stream
+        void FillUniform(uint64_t position, std::span<sample_t> block);
+        // the same as a FillUniform of the one position, without going through the block kernels
+        sample_t Uniform(uint64_t position);
+        // zero mean, unit variance. Box-Muller over hashes of their own, positions 2k and 2k + 1 are the cosine
+        // and sine halves of one pair. std::log is the one step that isn't integer or polynomial, so this one
+        // is only bit for bit the same between builds on the same C library
+        void FillGaussian(uint64_t position, std::span<sample_t> block);
+    private:
+        // the key for the 2^32 positions last filled, per kind of noise, so a block at a time doesn't
+        // work it out again every time
+        struct cached_key_t
+        {
+            uint64_t epoch = UINT64_MAX;
+            uint32_t k0 = 0;
+            uint32_t k1 = 0;
+        };
+        void UpdateKey(cached_key_t& key, uint64_t variant, uint64_t epoch);
+        template <typename Out, typename Kernel>
+        void FillByEpoch(cached_key_t& key, uint64_t variant, uint64_t position, Out* out, std::size_t count, Kernel kernel);
+
+        const uint64_t seed;
+        const uint64_t stream;
+        cached_key_t uniform_key;
+        cached_key_t gaussian_key;
+    };
+
+    // one off fills, for when there's no generator to keep
+    void FillUniformNoise(uint64_t seed, uint64_t stream, uint64_t position, std::span<sample_t> block);
+    void FillGaussianNoise(uint64_t seed, uint64_t stream, uint64_t position, std::span<sample_t> block);
+
+    // Paul Kellet's refined pink filter, within 0.05 dB of -3 dB/octave above about 9 Hz at 44.1 kHz. The
+    // output is scaled so pink from full scale white peaks around the same level. It has state, so pink
+    // noise can't be jumped ahead, the filter has to run over every sample skipped
+    struct pink_filter_t
+    {
+        double b[7] = {};
+        void Process(std::span<sample_t> block);
+        void Reset();
+    };
+};
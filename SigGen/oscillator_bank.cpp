@@ -0,0 +1,167 @@
+//
+//  oscillator_bank.cpp
+//  SigGen
+//
+
+#include <cassert>
+#include "oscillator_bank.hpp"
+#include "fast_math.hpp"
+
+namespace
+{
+    // the bank is the cheapest way to a lot of clean partials, so it stays on the 1e-13 polynomial
+    constexpr Neato::SineAccuracy bank_accuracy = Neato::SineAccuracy::high;
+
+    // adds the partial into out starting from phase. the lanes run in the sample type, the caller keeps the
+    // stored phase in double
+    template <typename T>
+    void AccumulatePartialScalar(T* out, std::size_t frame_count, double phase_in, double increment_in, double gain_in)
+    {
+        const T increment = static_cast<T>(increment_in);
+        const T gain = static_cast<T>(gain_in);
+        T phase = static_cast<T>(phase_in);
+        for (std::size_t i = 0; i < frame_count; i++)
+        {
+            const T t = phase - std::floor(phase + T(0.5));
+            out[i] += gain * Neato::SineOfCycles<bank_accuracy>(t);
+            phase = t + increment;
+        }
+    }
+
+    // lane k of a register starts k increments in, and each register steps by the width of the pair
+    template <typename T, std::size_t lanes>
+    void FirstLanePhases(T (&phases)[lanes], double phase, double increment)
+    {
+        for (std::size_t k = 0; k < lanes; k++)
+        {
+            phases[k] = static_cast<T>(phase + k * increment);
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // two registers of consecutive samples per loop. phases never leave [-0.5, 2) so the int32 round
+    // trip in RoundNearest is safe
+    template <typename T>
+    void AccumulatePartialSse2(T* out, std::size_t frame_count, double phase, double increment, double gain)
+    {
+        using namespace Neato::simd;
+        constexpr std::size_t lanes = sse_lanes<T>;
+        const std::size_t vector_count = frame_count - frame_count % (2 * lanes);
+        T first_phases[lanes];
+        FirstLanePhases(first_phases, phase, increment);
+        sse_t<T> lane_phase_low = LoadSse(first_phases);
+        sse_t<T> lane_phase_high = Add(lane_phase_low, BroadcastSse<T>(lanes * increment));
+        const sse_t<T> step = BroadcastSse<T>(2 * lanes * increment);
+        const sse_t<T> lane_gain = BroadcastSse<T>(gain);
+        for (std::size_t i = 0; i < vector_count; i += 2 * lanes)
+        {
+            const sse_t<T> t_low = Sub(lane_phase_low, RoundNearest(lane_phase_low));
+            const sse_t<T> t_high = Sub(lane_phase_high, RoundNearest(lane_phase_high));
+            Store(out + i, Add(LoadSse(out + i), Mul(lane_gain, Neato::SineOfCyclesSse<bank_accuracy>(t_low))));
+            Store(out + i + lanes, Add(LoadSse(out + i + lanes), Mul(lane_gain, Neato::SineOfCyclesSse<bank_accuracy>(t_high))));
+            lane_phase_low = Add(t_low, step);
+            lane_phase_high = Add(t_high, step);
+        }
+        Store(first_phases, lane_phase_low);
+        AccumulatePartialScalar(out + vector_count, frame_count - vector_count, first_phases[0], increment, gain);
+    }
+
+    // two registers in flight per loop, the polynomial is latency bound otherwise
+    template <typename T>
+    NEATO_TARGET_AVX2 void AccumulatePartialAvx2(T* out, std::size_t frame_count, double phase, double increment, double gain)
+    {
+        using namespace Neato::simd;
+        constexpr std::size_t lanes = avx_lanes<T>;
+        const std::size_t vector_count = frame_count - frame_count % (2 * lanes);
+        T first_phases[lanes];
+        FirstLanePhases(first_phases, phase, increment);
+        avx_t<T> lane_phase_low = LoadAvx(first_phases);
+        avx_t<T> lane_phase_high = Add(lane_phase_low, BroadcastAvx<T>(lanes * increment));
+        const avx_t<T> step = BroadcastAvx<T>(2 * lanes * increment);
+        const avx_t<T> lane_gain = BroadcastAvx<T>(gain);
+        for (std::size_t i = 0; i < vector_count; i += 2 * lanes)
+        {
+            const avx_t<T> t_low = Sub(lane_phase_low, RoundNearest(lane_phase_low));
+            const avx_t<T> t_high = Sub(lane_phase_high, RoundNearest(lane_phase_high));
+            const avx_t<T> sum_low = Add(LoadAvx(out + i), Mul(lane_gain, Neato::SineOfCyclesAvx2<bank_accuracy>(t_low)));
+            const avx_t<T> sum_high = Add(LoadAvx(out + i + lanes), Mul(lane_gain, Neato::SineOfCyclesAvx2<bank_accuracy>(t_high)));
+            Store(out + i, sum_low);
+            Store(out + i + lanes, sum_high);
+            lane_phase_low = Add(t_low, step);
+            lane_phase_high = Add(t_high, step);
+        }
+        Store(first_phases, lane_phase_low);
+        // the tail runs legacy SSE code, leaving the upper halves dirty would stall every instruction in it
+        _mm256_zeroupper();
+        AccumulatePartialScalar(out + vector_count, frame_count - vector_count, first_phases[0], increment, gain);
+    }
+#endif //NEATO_SIMD_X86
+
+    using accumulate_partial_fn = void (*)(Neato::sample_t*, std::size_t, double, double, double);
+
+    accumulate_partial_fn SelectPartialKernel()
+    {
+#if NEATO_SIMD_X86
+        return Neato::CpuHasAvx2() ? &AccumulatePartialAvx2<Neato::sample_t> : &AccumulatePartialSse2<Neato::sample_t>;
+#else
+        return &AccumulatePartialScalar<Neato::sample_t>;
+#endif //NEATO_SIMD_X86
+    }
+}
+
+Neato::OscillatorBank::OscillatorBank(const std::vector<double>& frequencies, const std::vector<double>& gains_in, double sample_rate_in)
+    : phases(frequencies.size(), 0.0)
+    , increments(frequencies.size(), 0.0)
+    , gains(gains_in)
+    , sample_rate(sample_rate_in)
+{
+    assert(frequencies.size() == gains_in.size());
+    for (uint32_t partial = 0; partial < frequencies.size(); partial++)
+    {
+        setFrequency(partial, frequencies[partial]);
+    }
+}
+
+void Neato::OscillatorBank::setFrequency(uint32_t partial, double frequency)
+{
+    increments[partial] = frequency / sample_rate;
+}
+
+bool Neato::OscillatorBank::Describe(GraphDescription& description) const
+{
+    // Reset() only puts the phases back, frequencies and gains are described as they are now
+    description.Add(phases.size());
+    for (std::size_t partial = 0; partial < phases.size(); partial++)
+    {
+        description.Add(increments[partial]);
+        description.Add(gains[partial]);
+    }
+    return true;
+}
+
+Neato::sample_t Neato::OscillatorBank::Sample()
+{
+    sample_t value = 0;
+    SampleBlock(std::span<sample_t>(&value, 1));
+    return value;
+}
+
+void Neato::OscillatorBank::SampleBlock(std::span<sample_t> block)
+{
+    static const accumulate_partial_fn accumulate_partial = SelectPartialKernel();
+    std::fill(block.begin(), block.end(), 0.0);
+    const std::size_t partial_count = phases.size();
+    for (std::size_t partial = 0; partial < partial_count; partial++)
+    {
+        accumulate_partial(block.data(), block.size(), phases[partial], increments[partial], gains[partial]);
+        // stepped in double whatever the lanes ran in, so a float build doesn't drift from block to block.
+        // keep it in [0, 1)
+        const double phase = phases[partial] + block.size() * increments[partial];
+        phases[partial] = phase - std::floor(phase);
+    }
+}
+
+std::shared_ptr<Neato::ISampleSource> Neato::CreateOscillatorBank(const std::vector<double>& frequencies, const std::vector<double>& gains, double sample_rate)
+{
+    return std::make_shared<OscillatorBank>(frequencies, gains, sample_rate);
+}
@@ -0,0 +1,37 @@
+//
+//  oscillator_bank.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    // N sine partials in one node. Phase, increment and gain for every partial live in
+    // parallel arrays, and a block is rendered partial by partial with SIMD kernels that
+    // add straight into the output. Replaces a SampleSummer of SampleMultipliers of ConstSines.
+    class OscillatorBank : public ISampleSource
+    {
+    public:
+        OscillatorBank(const std::vector<double>& frequencies, const std::vector<double>& gains, double sample_rate_in);
+        virtual sample_t Sample();
+        virtual void SampleBlock(std::span<sample_t> block);
+        virtual void Reset() { std::fill(phases.begin(), phases.end(), 0.0); }
+        virtual bool Describe(GraphDescription& description) const;
+        uint32_t PartialCount() const { return static_cast<uint32_t>(phases.size()); }
+        double getFrequency(uint32_t partial) const { return increments[partial] * sample_rate; }
+        void setFrequency(uint32_t partial, double frequency);
+        double getGain(uint32_t partial) const { return gains[partial]; }
+        void setGain(uint32_t partial, double gain) { gains[partial] = gain; }
+    private:
+        // phase and increment are in cycles, phase stays in [0, 1)
+        std::vector<double> phases;
+        std::vector<double> increments;
+        std::vector<double> gains;
+        const double sample_rate;
+    };
+
+    std::shared_ptr<ISampleSource> CreateOscillatorBank(const std::vector<double>& frequencies, const std::vector<double>& gains, double sample_rate);
+};
@@ -0,0 +1,386 @@
+//
+//  output_format.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "output_format.hpp"
+#include "simd.hpp"
+
+namespace
+{
+    enum class Encoding
+    {
+        int16,
+        int24,
+        float32,
+        float64
+    };
+
+    template <Encoding encoding> constexpr uint32_t bytes_of = 0;
+    template <> constexpr uint32_t bytes_of<Encoding::int16> = 2;
+    template <> constexpr uint32_t bytes_of<Encoding::int24> = 3;
+    template <> constexpr uint32_t bytes_of<Encoding::float32> = 4;
+    template <> constexpr uint32_t bytes_of<Encoding::float64> = 8;
+
+    // +1.0 lands on the largest positive code, the most negative code is one further out
+    template <Encoding encoding> constexpr float full_scale = 0.0f;
+    template <> constexpr float full_scale<Encoding::int16> = 32767.0f;
+    template <> constexpr float full_scale<Encoding::int24> = 8388607.0f;
+
+    using dither_state_t = Neato::OutputFormatter::dither_state_t;
+
+    // xorshift32, only shifts and xors so SSE2 can run four of them side by side
+    inline uint32_t NextRandom(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // the difference of two uniforms in [0, 1) is triangular over (-1, 1)
+    inline float TriangularDither(uint32_t& state)
+    {
+        const float a = static_cast<float>(NextRandom(state) >> 8);
+        const float b = static_cast<float>(NextRandom(state) >> 8);
+        return (a - b) * (1.0f / 16777216.0f);
+    }
+
+    inline void PutInt24(uint8_t* out, int32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+        out[2] = static_cast<uint8_t>(value >> 16);
+    }
+
+    // integer formats go through float on both paths so the vector body and the scalar tail round the same way
+    template <Encoding encoding, bool dithered>
+    inline void WriteScalar(Neato::sample_t value, uint8_t* out, uint32_t& dither_state)
+    {
+        if constexpr (encoding == Encoding::float32)
+        {
+            const float sample = static_cast<float>(value);
+            std::memcpy(out, &sample, sizeof(sample));
+        }
+        else if constexpr (encoding == Encoding::float64)
+        {
+            const double sample = static_cast<double>(value);
+            std::memcpy(out, &sample, sizeof(sample));
+        }
+        else
+        {
+            constexpr float scale = full_scale<encoding>;
+            float scaled = static_cast<float>(value) * scale;
+            if constexpr (dithered)
+            {
+                scaled += TriangularDither(dither_state);
+            }
+            const int32_t code = static_cast<int32_t>(std::lrint(std::clamp(scaled, -scale - 1.0f, scale)));
+            if constexpr (encoding == Encoding::int16)
+            {
+                const int16_t sample = static_cast<int16_t>(code);
+                std::memcpy(out, &sample, sizeof(sample));
+            }
+            else
+            {
+                PutInt24(out, code);
+            }
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // conversion is bound by the stores, so SSE2 is as far as these go
+    inline __m128 LoadFloats(const double* in) { return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in)), _mm_cvtpd_ps(_mm_loadu_pd(in + 2))); }
+    inline __m128 LoadFloats(const float* in) { return _mm_loadu_ps(in); }
+    inline __m128d LoadDoubles(const double* in) { return _mm_loadu_pd(in); }
+    inline __m128d LoadDoubles(const float* in) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)))); }
+
+    inline __m128i NextRandom(__m128i& state)
+    {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        return state;
+    }
+
+    inline __m128 TriangularDither(__m128i& state)
+    {
+        const __m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(NextRandom(state), 8));
+        const __m128 b = _mm_cvtepi32_ps(_mm_srli_epi32(NextRandom(state), 8));
+        return _mm_mul_ps(_mm_sub_ps(a, b), _mm_set1_ps(1.0f / 16777216.0f));
+    }
+
+    // scale, dither, clamp and round four samples to integer codes
+    template <Encoding encoding, bool dithered>
+    inline __m128i ToCodes(__m128 value, __m128i& dither_state)
+    {
+        constexpr float scale = full_scale<encoding>;
+        __m128 scaled = _mm_mul_ps(value, _mm_set1_ps(scale));
+        if constexpr (dithered)
+        {
+            scaled = _mm_add_ps(scaled, TriangularDither(dither_state));
+        }
+        scaled = _mm_min_ps(_mm_max_ps(scaled, _mm_set1_ps(-scale - 1.0f)), _mm_set1_ps(scale));
+        return _mm_cvtps_epi32(scaled);
+    }
+
+    // SSE2 has no byte shuffle to pack 3 byte samples with, the codes go out one at a time
+    inline void StoreInt24(uint8_t* out, __m128i codes)
+    {
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), codes);
+        for (std::size_t k = 0; k < 4; k++)
+        {
+            PutInt24(out + 3 * k, lanes[k]);
+        }
+    }
+#endif //NEATO_SIMD_X86
+
+    // every channel that isn't part of an interleaved pair: the samples are stride bytes apart
+    template <Encoding encoding, bool dithered>
+    void WriteStrided(const Neato::sample_t* in, uint8_t* out, std::size_t frame_count, std::size_t stride, dither_state_t& dither)
+    {
+        for (std::size_t i = 0; i < frame_count; i++)
+        {
+            WriteScalar<encoding, dithered>(in[i], out + i * stride, dither.lanes[0]);
+        }
+    }
+
+    // one channel on its own, planar or a mono stream: the samples are packed back to back
+    template <Encoding encoding, bool dithered>
+    void WriteContiguous(const Neato::sample_t* in, uint8_t* out, std::size_t frame_count, std::size_t stride, dither_state_t& dither)
+    {
+        constexpr std::size_t bytes = bytes_of<encoding>;
+        std::size_t i = 0;
+#if NEATO_SIMD_X86
+        __m128i state = _mm_load_si128(reinterpret_cast<const __m128i*>(dither.lanes));
+        const std::size_t vector_count = frame_count & ~std::size_t(7);
+        for (; i < vector_count; i += 8)
+        {
+            uint8_t* destination = out + i * bytes;
+            if constexpr (encoding == Encoding::float32)
+            {
+                _mm_storeu_ps(reinterpret_cast<float*>(destination), LoadFloats(in + i));
+                _mm_storeu_ps(reinterpret_cast<float*>(destination + 16), LoadFloats(in + i + 4));
+            }
+            else if constexpr (encoding == Encoding::float64)
+            {
+                for (std::size_t k = 0; k < 8; k += 2)
+                {
+                    _mm_storeu_pd(reinterpret_cast<double*>(destination + k * bytes), LoadDoubles(in + i + k));
+                }
+            }
+            else
+            {
+                const __m128i low = ToCodes<encoding, dithered>(LoadFloats(in + i), state);
+                const __m128i high = ToCodes<encoding, dithered>(LoadFloats(in + i + 4), state);
+                if constexpr (encoding == Encoding::int16)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_packs_epi32(low, high));
+                }
+                else
+                {
+                    StoreInt24(destination, low);
+                    StoreInt24(destination + 4 * bytes, high);
+                }
+            }
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(dither.lanes), state);
+#endif //NEATO_SIMD_X86
+        for (; i < frame_count; i++)
+        {
+            WriteScalar<encoding, dithered>(in[i], out + i * bytes, dither.lanes[0]);
+        }
+    }
+
+    // an interleaved stereo stream, both channels in one pass. a mono block fanned out passes itself twice,
+    // each channel still gets its own dither
+    template <Encoding encoding, bool dithered>
+    void WriteStereo(const Neato::sample_t* left, const Neato::sample_t* right, uint8_t* out, std::size_t frame_count, dither_state_t& dither)
+    {
+        constexpr std::size_t bytes = bytes_of<encoding>;
+        std::size_t i = 0;
+#if NEATO_SIMD_X86
+        __m128i state = _mm_load_si128(reinterpret_cast<const __m128i*>(dither.lanes));
+        const std::size_t vector_count = frame_count & ~std::size_t(3);
+        for (; i < vector_count; i += 4)
+        {
+            uint8_t* destination = out + 2 * i * bytes;
+            if constexpr (encoding == Encoding::float32)
+            {
+                const __m128 l = LoadFloats(left + i);
+                const __m128 r = LoadFloats(right + i);
+                _mm_storeu_ps(reinterpret_cast<float*>(destination), _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(reinterpret_cast<float*>(destination + 16), _mm_unpackhi_ps(l, r));
+            }
+            else if constexpr (encoding == Encoding::float64)
+            {
+                for (std::size_t k = 0; k < 4; k += 2)
+                {
+                    const __m128d l = LoadDoubles(left + i + k);
+                    const __m128d r = LoadDoubles(right + i + k);
+                    _mm_storeu_pd(reinterpret_cast<double*>(destination + 2 * k * bytes), _mm_unpacklo_pd(l, r));
+                    _mm_storeu_pd(reinterpret_cast<double*>(destination + 2 * k * bytes + 16), _mm_unpackhi_pd(l, r));
+                }
+            }
+            else
+            {
+                const __m128i l = ToCodes<encoding, dithered>(LoadFloats(left + i), state);
+                const __m128i r = ToCodes<encoding, dithered>(LoadFloats(right + i), state);
+                const __m128i low = _mm_unpacklo_epi32(l, r);
+                const __m128i high = _mm_unpackhi_epi32(l, r);
+                if constexpr (encoding == Encoding::int16)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_packs_epi32(low, high));
+                }
+                else
+                {
+                    StoreInt24(destination, low);
+                    StoreInt24(destination + 4 * bytes, high);
+                }
+            }
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(dither.lanes), state);
+#endif //NEATO_SIMD_X86
+        for (; i < frame_count; i++)
+        {
+            WriteScalar<encoding, dithered>(left[i], out + 2 * i * bytes, dither.lanes[0]);
+            WriteScalar<encoding, dithered>(right[i], out + (2 * i + 1) * bytes, dither.lanes[0]);
+        }
+    }
+
+    struct kernels_t
+    {
+        Neato::OutputFormatter::channel_fn contiguous;
+        Neato::OutputFormatter::channel_fn strided;
+        Neato::OutputFormatter::stereo_fn stereo;
+    };
+
+    template <Encoding encoding, bool dithered>
+    kernels_t KernelsFor()
+    {
+        return {&WriteContiguous<encoding, dithered>, &WriteStrided<encoding, dithered>, &WriteStereo<encoding, dithered>};
+    }
+
+    Encoding EncodingOf(const Neato::audio_stream_description_t& stream_desc)
+    {
+        switch (stream_desc.format_id)
+        {
+            case Neato::format_id_pcm:
+                if (stream_desc.bits_per_channel == 16)
+                {
+                    return Encoding::int16;
+                }
+                if (stream_desc.bits_per_channel == 24)
+                {
+                    return Encoding::int24;
+                }
+                throw std::runtime_error("Only 16 and 24 bit PCM output is supported");
+            case Neato::format_id_float_32:
+                return Encoding::float32;
+            case Neato::format_id_float_64:
+                return Encoding::float64;
+            default:
+                throw std::runtime_error("Unsupported output sample format");
+        }
+    }
+
+    kernels_t SelectKernels(Encoding encoding, Neato::Dither dither)
+    {
+        // float formats have nothing to round, dither only means something for the integer ones
+        const bool dithered = (dither == Neato::Dither::tpdf);
+        switch (encoding)
+        {
+            case Encoding::int16:
+                return dithered ? KernelsFor<Encoding::int16, true>() : KernelsFor<Encoding::int16, false>();
+            case Encoding::int24:
+                return dithered ? KernelsFor<Encoding::int24, true>() : KernelsFor<Encoding::int24, false>();
+            case Encoding::float32:
+                return KernelsFor<Encoding::float32, false>();
+            case Encoding::float64:
+                break;
+        }
+        return KernelsFor<Encoding::float64, false>();
+    }
+
+    uint32_t BytesOf(Encoding encoding)
+    {
+        switch (encoding)
+        {
+            case Encoding::int16: return bytes_of<Encoding::int16>;
+            case Encoding::int24: return bytes_of<Encoding::int24>;
+            case Encoding::float32: return bytes_of<Encoding::float32>;
+            case Encoding::float64: break;
+        }
+        return bytes_of<Encoding::float64>;
+    }
+}
+
+Neato::OutputFormatter::OutputFormatter(const audio_stream_description_t& stream_desc_in, Dither dither_in)
+    : stream_desc(stream_desc_in)
+    , bytes_per_sample(0)
+    , planar(0 != (stream_desc_in.flags & format_flag_non_interleaved))
+    , dither_state{{0x9E3779B9u, 0x7F4A7C15u, 0x85EBCA6Bu, 0xC2B2AE35u}}
+{
+    if (stream_desc.channels_per_frame == 0)
+    {
+        throw std::runtime_error("Output stream has no channels");
+    }
+    const Encoding encoding = EncodingOf(stream_desc);
+    bytes_per_sample = BytesOf(encoding);
+    const kernels_t kernels = SelectKernels(encoding, dither_in);
+    write_contiguous = kernels.contiguous;
+    write_strided = kernels.strided;
+    write_stereo = kernels.stereo;
+}
+
+void Neato::OutputFormatter::WriteMono(std::span<const sample_t> block, uint8_t* frame_buffer)
+{
+    if (!planar && stream_desc.channels_per_frame == 2)
+    {
+        write_stereo(block.data(), block.data(), frame_buffer, block.size(), dither_state);
+        return;
+    }
+    for (uint32_t channel = 0; channel < stream_desc.channels_per_frame; channel++)
+    {
+        WriteChannel(block.data(), channel, block.size(), frame_buffer);
+    }
+}
+
+void Neato::OutputFormatter::Write(std::span<const std::span<const sample_t>> channels, uint8_t* frame_buffer)
+{
+    assert(channels.size() == stream_desc.channels_per_frame);
+    const std::size_t frame_count = channels.front().size();
+    if (!planar && stream_desc.channels_per_frame == 2)
+    {
+        assert(channels[1].size() == frame_count);
+        write_stereo(channels[0].data(), channels[1].data(), frame_buffer, frame_count, dither_state);
+        return;
+    }
+    for (uint32_t channel = 0; channel < stream_desc.channels_per_frame; channel++)
+    {
+        assert(channels[channel].size() == frame_count);
+        WriteChannel(channels[channel].data(), channel, frame_count, frame_buffer);
+    }
+}
+
+void Neato::OutputFormatter::WriteChannel(const sample_t* in, uint32_t channel, std::size_t frame_count, uint8_t* frame_buffer)
+{
+    if (planar)
+    {
+        write_contiguous(in, frame_buffer + channel * frame_count * bytes_per_sample, frame_count, bytes_per_sample, dither_state);
+        return;
+    }
+    const std::size_t stride = static_cast<std::size_t>(bytes_per_sample) * stream_desc.channels_per_frame;
+    if (stride == bytes_per_sample)
+    {
+        write_contiguous(in, frame_buffer, frame_count, stride, dither_state);
+        return;
+    }
+    write_strided(in, frame_buffer + channel * bytes_per_sample, frame_count, stride, dither_state);
+}
@@ -0,0 +1,58 @@
+//
+//  output_format.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include "RenderGraph.h"
+#include "sample_type.hpp"
+
+namespace Neato
+{
+    enum class Dither
+    {
+        none,
+        tpdf        // triangular, +-1 LSB. keeps the rounding error on integer formats from following the signal
+    };
+
+    // the last stage before the device: turns rendered blocks into the bytes of the negotiated stream,
+    // written straight into the buffer the render graph hands out. handles int16 and packed int24 PCM
+    // (format_id_pcm with 16 or 24 bits_per_channel), float32 and float64, interleaved or planar.
+    // planar (format_flag_non_interleaved) puts each channel's frames back to back, one channel after
+    // another. integer formats are clamped to full scale, float formats keep their headroom
+    class OutputFormatter
+    {
+    public:
+        // throws std::runtime_error for a format it can't write
+        explicit OutputFormatter(const audio_stream_description_t& stream_desc_in, Dither dither_in = Dither::tpdf);
+        // the same block on every channel
+        void WriteMono(std::span<const sample_t> block, uint8_t* frame_buffer);
+        // one block per channel of the stream, all the same length
+        void Write(std::span<const std::span<const sample_t>> channels, uint8_t* frame_buffer);
+        uint32_t BytesPerSample() const { return bytes_per_sample; }
+        // one channel's worth when planar, every channel's when interleaved
+        uint32_t BytesPerFrame() const { return planar ? bytes_per_sample : bytes_per_sample * stream_desc.channels_per_frame; }
+
+        // per lane state of the dither noise, lane 0 doubles as the scalar one
+        struct dither_state_t
+        {
+            alignas(16) uint32_t lanes[4];
+        };
+        using channel_fn = void (*)(const sample_t* in, uint8_t* out, std::size_t frame_count, std::size_t stride, dither_state_t& dither);
+        using stereo_fn = void (*)(const sample_t* left, const sample_t* right, uint8_t* out, std::size_t frame_count, dither_state_t& dither);
+
+    private:
+        void WriteChannel(const sample_t* in, uint32_t channel, std::size_t frame_count, uint8_t* frame_buffer);
+
+        const audio_stream_description_t stream_desc;
+        uint32_t bytes_per_sample;
+        bool planar;
+        channel_fn write_contiguous;
+        channel_fn write_strided;
+        stereo_fn write_stereo;
+        dither_state_t dither_state;
+    };
+};
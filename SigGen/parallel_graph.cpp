@@ -0,0 +1,397 @@
+//
+//  parallel_graph.cpp
+//  SigGen
+//
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include "parallel_graph.hpp"
+
+namespace
+{
+    struct render_slot_t
+    {
+        std::shared_ptr<Neato::ISampleSource> node;
+        std::vector<Neato::sample_t> buffer;
+    };
+
+    // what the spine sees in place of a slot's node, the block the slot already rendered
+    class SlotProxy : public Neato::ISampleSource
+    {
+    public:
+        SlotProxy(render_slot_t* slot_in) : slot(slot_in) {}
+        virtual Neato::sample_t Sample()
+        {
+            return slot->buffer[0];
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            std::copy_n(slot->buffer.begin(), block.size(), block.begin());
+        }
+        virtual void ForEachChild(const Neato::child_visitor_t& visitor)
+        {
+            visitor(slot->node);
+        }
+    private:
+        render_slot_t* slot;
+    };
+
+    // slots that run back to back on one thread, in graph order
+    struct render_task_t
+    {
+        std::vector<render_slot_t*> slots;
+        uint64_t cost = 0;
+    };
+
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool(uint32_t worker_count, uint32_t task_count)
+            : queues(worker_count + 1)
+            , tasks(nullptr)
+            , frame_count(0)
+            , generation(0)
+            , pending(0)
+            , stopping(false)
+        {
+            for (worker_queue_t& queue : queues)
+            {
+                queue.items.resize(task_count);
+            }
+            for (uint32_t worker = 0; worker < worker_count; worker++)
+            {
+                threads.emplace_back([this, worker]() { WorkerLoop(worker); });
+            }
+        }
+
+        ~WorkStealingPool()
+        {
+            stopping = true;
+            generation.fetch_add(1);
+            generation.notify_all();
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        // runs every task once over the workers and the calling thread, returns when all of them are done
+        void Run(std::vector<render_task_t>& tasks_in, std::size_t frame_count_in)
+        {
+            tasks = &tasks_in;
+            frame_count = frame_count_in;
+            pending.store(static_cast<uint32_t>(tasks_in.size()));
+            for (uint32_t task = 0; task < tasks_in.size(); task++)
+            {
+                worker_queue_t& queue = queues[task % queues.size()];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                queue.items[queue.tail++] = task;
+            }
+            generation.fetch_add(1);
+            generation.notify_all();
+
+            // the calling thread owns the last queue and helps out until everything is claimed
+            Drain(static_cast<uint32_t>(queues.size() - 1));
+            uint32_t remaining = pending.load();
+            while (remaining != 0)
+            {
+                pending.wait(remaining);
+                remaining = pending.load();
+            }
+        }
+
+    private:
+        struct worker_queue_t
+        {
+            std::mutex lock;
+            std::vector<uint32_t> items;
+            std::size_t head = 0;
+            std::size_t tail = 0;
+        };
+
+        void WorkerLoop(uint32_t worker)
+        {
+            uint64_t seen = 0;
+            while (true)
+            {
+                generation.wait(seen);
+                seen = generation.load();
+                if (stopping)
+                {
+                    return;
+                }
+                Drain(worker);
+            }
+        }
+
+        // own queue from the back, everyone else's from the front
+        bool PopOwn(uint32_t queue_index, uint32_t& task)
+        {
+            worker_queue_t& queue = queues[queue_index];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.head == queue.tail)
+            {
+                return false;
+            }
+            task = queue.items[--queue.tail];
+            if (queue.head == queue.tail)
+            {
+                queue.head = queue.tail = 0;
+            }
+            return true;
+        }
+
+        bool Steal(uint32_t queue_index, uint32_t& task)
+        {
+            worker_queue_t& queue = queues[queue_index];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.head == queue.tail)
+            {
+                return false;
+            }
+            task = queue.items[queue.head++];
+            if (queue.head == queue.tail)
+            {
+                queue.head = queue.tail = 0;
+            }
+            return true;
+        }
+
+        void Drain(uint32_t queue_index)
+        {
+            const uint32_t queue_count = static_cast<uint32_t>(queues.size());
+            while (true)
+            {
+                uint32_t task = 0;
+                bool found = PopOwn(queue_index, task);
+                for (uint32_t offset = 1; !found && offset < queue_count; offset++)
+                {
+                    found = Steal((queue_index + offset) % queue_count, task);
+                }
+                if (!found)
+                {
+                    return;
+                }
+                for (render_slot_t* slot : (*tasks)[task].slots)
+                {
+                    slot->node->SampleBlock(std::span<Neato::sample_t>(slot->buffer.data(), frame_count));
+                }
+                if (pending.fetch_sub(1) == 1)
+                {
+                    pending.notify_all();
+                }
+            }
+        }
+
+        std::vector<worker_queue_t> queues;
+        std::vector<std::thread> threads;
+        std::vector<render_task_t>* tasks;
+        std::size_t frame_count;
+        std::atomic<uint64_t> generation;
+        std::atomic<uint32_t> pending;
+        std::atomic<bool> stopping;
+    };
+
+    class ParallelGraph : public Neato::ISampleSource
+    {
+    public:
+        ParallelGraph(std::shared_ptr<Neato::ISampleSource> root_in, uint32_t worker_count, uint32_t max_block_frames_in)
+            : root(root_in)
+            , max_block_frames(std::max<uint32_t>(max_block_frames_in, 1))
+        {
+            CountParents(root.get());
+            if (IsSpine(root.get()))
+            {
+                CollectSlots(root.get());
+            }
+            // the proxies point into slots, so the slot list can't move once they're handed out
+            for (std::size_t i = 0; i < slots.size(); i++)
+            {
+                slots[i].buffer.resize(max_block_frames);
+                *slot_owners[i] = std::make_shared<SlotProxy>(&slots[i]);
+            }
+            BuildTasks(worker_count);
+            pool = std::make_unique<WorkStealingPool>(worker_count, static_cast<uint32_t>(tasks.size()));
+            parent_counts.clear();
+            slot_owners.clear();
+        }
+
+        virtual Neato::sample_t Sample()
+        {
+            Neato::sample_t value = 0;
+            SampleBlock(std::span<Neato::sample_t>(&value, 1));
+            return value;
+        }
+
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            std::size_t written = 0;
+            while (written < block.size())
+            {
+                const std::size_t count = std::min<std::size_t>(block.size() - written, max_block_frames);
+                if (!tasks.empty())
+                {
+                    pool->Run(tasks, count);
+                }
+                root->SampleBlock(block.subspan(written, count));
+                written += count;
+            }
+        }
+
+        virtual void ForEachChild(const Neato::child_visitor_t& visitor)
+        {
+            // the slots are rendered through their proxies, swapping the root out from under them isn't allowed
+        }
+
+        virtual void Reset()
+        {
+            root->Reset();
+        }
+
+    private:
+        static bool IsSpine(Neato::ISampleSource* node)
+        {
+            return dynamic_cast<Neato::SampleSummer*>(node) || dynamic_cast<Neato::SampleMultiplier*>(node);
+        }
+
+        void CountParents(Neato::ISampleSource* node)
+        {
+            node->ForEachChild([this](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                if (parent_counts[child.get()]++ == 0)
+                {
+                    CountParents(child.get());
+                }
+            });
+        }
+
+        // a spine node with a single parent is pulled exactly once per block, so it's safe to keep
+        // evaluating it on the calling thread. a shared one gets rendered as a slot like anything else
+        void CollectSlots(Neato::ISampleSource* node)
+        {
+            node->ForEachChild([this](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                if (IsSpine(child.get()) && parent_counts[child.get()] == 1)
+                {
+                    CollectSlots(child.get());
+                }
+                else if (!dynamic_cast<Neato::DCOffset*>(child.get()))
+                {
+                    render_slot_t slot;
+                    slot.node = child;
+                    slots.push_back(slot);
+                    slot_owners.push_back(&child);
+                }
+            });
+        }
+
+        void ReachableNodes(Neato::ISampleSource* node, std::unordered_set<Neato::ISampleSource*>& reached)
+        {
+            if (reached.insert(node).second)
+            {
+                node->ForEachChild([this, &reached](std::shared_ptr<Neato::ISampleSource>& child)
+                {
+                    ReachableNodes(child.get(), reached);
+                });
+            }
+        }
+
+        uint32_t FindGroup(std::vector<uint32_t>& groups, uint32_t slot)
+        {
+            while (groups[slot] != slot)
+            {
+                groups[slot] = groups[groups[slot]];
+                slot = groups[slot];
+            }
+            return slot;
+        }
+
+        void BuildTasks(uint32_t worker_count)
+        {
+            // slots that can reach the same node have to stay on one thread, in the order they are pulled
+            std::vector<uint32_t> groups(slots.size());
+            std::iota(groups.begin(), groups.end(), 0);
+            std::vector<uint64_t> costs(slots.size());
+            std::unordered_map<Neato::ISampleSource*, uint32_t> first_reached_by;
+            for (uint32_t i = 0; i < slots.size(); i++)
+            {
+                std::unordered_set<Neato::ISampleSource*> reached;
+                ReachableNodes(slots[i].node.get(), reached);
+                costs[i] = reached.size();
+                for (Neato::ISampleSource* node : reached)
+                {
+                    auto existing = first_reached_by.find(node);
+                    if (existing == first_reached_by.end())
+                    {
+                        first_reached_by[node] = i;
+                    }
+                    else
+                    {
+                        groups[FindGroup(groups, i)] = FindGroup(groups, existing->second);
+                    }
+                }
+            }
+
+            std::unordered_map<uint32_t, render_task_t> grouped;
+            for (uint32_t i = 0; i < slots.size(); i++)
+            {
+                render_task_t& group = grouped[FindGroup(groups, i)];
+                group.slots.push_back(&slots[i]);
+                group.cost += costs[i];
+            }
+            std::vector<render_task_t> independent;
+            for (auto& it : grouped)
+            {
+                independent.push_back(std::move(it.second));
+            }
+
+            // a few tasks per thread is enough to balance, more just adds queue traffic.
+            // biggest groups first, each into the lightest task so far
+            const std::size_t task_count = std::min<std::size_t>(independent.size(), 4 * (static_cast<std::size_t>(worker_count) + 1));
+            std::sort(independent.begin(), independent.end(), [](const render_task_t& a, const render_task_t& b)
+            {
+                return a.cost > b.cost;
+            });
+            tasks.resize(task_count);
+            for (render_task_t& group : independent)
+            {
+                render_task_t& lightest = *std::min_element(tasks.begin(), tasks.end(), [](const render_task_t& a, const render_task_t& b)
+                {
+                    return a.cost < b.cost;
+                });
+                lightest.slots.insert(lightest.slots.end(), group.slots.begin(), group.slots.end());
+                lightest.cost += group.cost;
+            }
+            // within a task, graph order. slots live in one vector in the order they were collected
+            for (render_task_t& task : tasks)
+            {
+                std::sort(task.slots.begin(), task.slots.end());
+            }
+        }
+
+        std::shared_ptr<Neato::ISampleSource> root;
+        const uint32_t max_block_frames;
+        std::vector<render_slot_t> slots;
+        std::vector<render_task_t> tasks;
+        std::unique_ptr<WorkStealingPool> pool;
+
+        // construction only
+        std::unordered_map<Neato::ISampleSource*, uint32_t> parent_counts;
+        std::vector<std::shared_ptr<Neato::ISampleSource>*> slot_owners;
+    };
+}
+
+std::shared_ptr<Neato::ISampleSource> Neato::CreateParallelGraph(std::shared_ptr<ISampleSource> root, uint32_t worker_count, uint32_t max_block_frames)
+{
+    return std::make_shared<ParallelGraph>(root, worker_count, max_block_frames);
+}
+
+uint32_t Neato::DefaultWorkerCount()
+{
+    const uint32_t cores = std::thread::hardware_concurrency();
+    return (cores > 1) ? cores - 1 : 0;
+}
@@ -0,0 +1,27 @@
+//
+//  parallel_graph.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+
+namespace Neato
+{
+    // Renders the independent branches of a graph on a work-stealing thread pool.
+    //
+    // The SampleSummer/SampleMultiplier spine from the root down is kept, and every other child hanging
+    // off it becomes a render slot with a proxy standing in for it. Each block, the slots render on the
+    // workers (and the calling thread) into their own buffers. Then the spine runs on the calling thread
+    // over the proxies in its usual order, so the sums come out bit-identical to rendering the graph
+    // serially. Slots whose subtrees share any node are kept in one task and rendered in graph order,
+    // so shared state advances exactly the way it does serially. Blocks longer than max_block_frames
+    // are split, and a graph with shared state only matches a serial render that was split the same way.
+    //
+    // worker_count 0 renders everything on the calling thread. The returned source owns the graph,
+    // don't keep pulling samples from the original root.
+    std::shared_ptr<ISampleSource> CreateParallelGraph(std::shared_ptr<ISampleSource> root, uint32_t worker_count, uint32_t max_block_frames = 4096);
+    // one worker per core, less the calling thread
+    uint32_t DefaultWorkerCount();
+};
@@ -0,0 +1,290 @@
+//
+//  profiler.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <string>
+#include <typeinfo>
+#include <unordered_set>
+#include "profiler.hpp"
+#include "node_decorator.hpp"
+#include "sequence.h"
+#include "simd.hpp"
+
+#if NEATO_SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif //_MSC_VER
+#endif //NEATO_SIMD_X86
+
+namespace
+{
+    inline uint64_t ReadTicks()
+    {
+#if NEATO_SIMD_X86
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif //NEATO_SIMD_X86
+    }
+
+    template <typename Interface>
+    class ProfiledNode : public Neato::ForwardingNode<Interface>
+    {
+    public:
+        ProfiledNode(std::shared_ptr<Interface> inner_in, Neato::GraphProfile::node_stats_t* stats_in, std::shared_ptr<Neato::GraphProfile> profile_in)
+            : Neato::ForwardingNode<Interface>(inner_in)
+            , stats(stats_in)
+            , profile(profile_in)
+        {
+        }
+        virtual Neato::sample_t Sample()
+        {
+            const uint64_t start = ReadTicks();
+            const Neato::sample_t sample = this->inner->Sample();
+            Count(1, ReadTicks() - start);
+            return sample;
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            const uint64_t start = ReadTicks();
+            this->inner->SampleBlock(block);
+            Count(block.size(), ReadTicks() - start);
+        }
+        Neato::GraphProfile::node_stats_t* Stats() const
+        {
+            return stats;
+        }
+    protected:
+        void Count(std::size_t samples, uint64_t ticks)
+        {
+            stats->calls.fetch_add(1, std::memory_order_relaxed);
+            stats->samples.fetch_add(samples, std::memory_order_relaxed);
+            stats->ticks.fetch_add(ticks, std::memory_order_relaxed);
+        }
+
+        Neato::GraphProfile::node_stats_t* stats;
+        // the decorators keep the stats they point into alive
+        std::shared_ptr<Neato::GraphProfile> profile;
+    };
+
+    using ProfiledNodeWithDuration = Neato::DurationForwardingNode<ProfiledNode<Neato::ISampleSourceWithDuration>>;
+
+    // the original node if this one is a profiling decorator, nullptr otherwise
+    std::shared_ptr<Neato::ISampleSource> ProfiledInner(Neato::ISampleSource* node)
+    {
+        if (auto plain = dynamic_cast<ProfiledNode<Neato::ISampleSource>*>(node))
+        {
+            return plain->Inner();
+        }
+        if (auto with_duration = dynamic_cast<ProfiledNode<Neato::ISampleSourceWithDuration>*>(node))
+        {
+            return with_duration->Inner();
+        }
+        return nullptr;
+    }
+
+    struct profile_walk_t
+    {
+        std::shared_ptr<Neato::GraphProfile> profile;
+        std::unordered_set<Neato::ISampleSource*> visited;
+    };
+
+    void ProfileNode(std::shared_ptr<Neato::ISampleSource>& node, Neato::GraphProfile::node_stats_t* parent, profile_walk_t& walk)
+    {
+        if (!node || ProfiledInner(node.get()))
+        {
+            return;
+        }
+        const bool first_visit = walk.visited.insert(node.get()).second;
+        Neato::GraphProfile::node_stats_t* stats = walk.profile->AddNode(typeid(*node).name(), parent);
+        if (auto with_duration = std::dynamic_pointer_cast<Neato::ISampleSourceWithDuration>(node))
+        {
+            node = std::make_shared<ProfiledNodeWithDuration>(with_duration, stats, walk.profile);
+        }
+        else
+        {
+            node = std::make_shared<ProfiledNode<Neato::ISampleSource>>(node, stats, walk.profile);
+        }
+        if (first_visit)
+        {
+            node->ForEachChild([stats, &walk](std::shared_ptr<Neato::ISampleSource>& child)
+            {
+                ProfileNode(child, stats, walk);
+            });
+        }
+    }
+
+    void UnprofileNode(std::shared_ptr<Neato::ISampleSource>& node)
+    {
+        if (!node)
+        {
+            return;
+        }
+        if (std::shared_ptr<Neato::ISampleSource> inner = ProfiledInner(node.get()))
+        {
+            node = inner;
+        }
+        node->ForEachChild([](std::shared_ptr<Neato::ISampleSource>& child)
+        {
+            UnprofileNode(child);
+        });
+    }
+
+    uint64_t ChildTicks(const Neato::GraphProfile::node_stats_t& stats)
+    {
+        uint64_t ticks = 0;
+        for (const Neato::GraphProfile::node_stats_t* child : stats.children)
+        {
+            ticks += child->ticks.load(std::memory_order_relaxed);
+        }
+        return ticks;
+    }
+
+    uint64_t SelfTicks(const Neato::GraphProfile::node_stats_t& stats)
+    {
+        // a clock read can land either side of a child's, don't let that go negative
+        const uint64_t ticks = stats.ticks.load(std::memory_order_relaxed);
+        return ticks - std::min(ticks, ChildTicks(stats));
+    }
+
+    void WriteTreeNode(std::ostream& out, const Neato::GraphProfile::node_stats_t& stats, uint32_t depth, double ticks_per_ns, uint64_t graph_ticks)
+    {
+        const uint64_t ticks = stats.ticks.load(std::memory_order_relaxed);
+        const uint64_t samples = stats.samples.load(std::memory_order_relaxed);
+        const double total_us = ticks / ticks_per_ns / 1000.0;
+        const double self_us = SelfTicks(stats) / ticks_per_ns / 1000.0;
+        out << std::string(depth * 2, ' ') << Neato::DemangleTypeName(stats.type_name)
+            << "  calls " << stats.calls.load(std::memory_order_relaxed)
+            << ", samples " << samples
+            << ", total " << total_us << " us"
+            << ", self " << self_us << " us"
+            << ", " << ((graph_ticks > 0) ? 100.0 * ticks / graph_ticks : 0.0) << "%"
+            << ", " << ((samples > 0) ? total_us * 1000.0 / samples : 0.0) << " ns/sample" << std::endl;
+        for (const Neato::GraphProfile::node_stats_t* child : stats.children)
+        {
+            WriteTreeNode(out, *child, depth + 1, ticks_per_ns, graph_ticks);
+        }
+    }
+
+    void WriteFoldedNode(std::ostream& out, const Neato::GraphProfile::node_stats_t& stats, const std::string& parent_stack, double ticks_per_ns)
+    {
+        std::string name = Neato::DemangleTypeName(stats.type_name);
+        // ';' separates the frames
+        std::replace(name.begin(), name.end(), ';', ':');
+        const std::string stack = parent_stack.empty() ? name : parent_stack + ";" + name;
+        const uint64_t self_ns = static_cast<uint64_t>(SelfTicks(stats) / ticks_per_ns);
+        if (self_ns > 0)
+        {
+            out << stack << " " << self_ns << std::endl;
+        }
+        for (const Neato::GraphProfile::node_stats_t* child : stats.children)
+        {
+            WriteFoldedNode(out, *child, stack, ticks_per_ns);
+        }
+    }
+}
+
+Neato::GraphProfile::GraphProfile()
+    : start_ticks(ReadTicks())
+    , start_time(std::chrono::steady_clock::now())
+{
+}
+
+Neato::GraphProfile::node_stats_t* Neato::GraphProfile::AddNode(const char* type_name, node_stats_t* parent)
+{
+    node_stats_t& stats = nodes.emplace_back();
+    stats.type_name = type_name;
+    stats.parent = parent;
+    if (parent)
+    {
+        parent->children.push_back(&stats);
+    }
+    else
+    {
+        roots.push_back(&stats);
+    }
+    return &stats;
+}
+
+void Neato::GraphProfile::Clear()
+{
+    for (node_stats_t& stats : nodes)
+    {
+        stats.calls.store(0, std::memory_order_relaxed);
+        stats.samples.store(0, std::memory_order_relaxed);
+        stats.ticks.store(0, std::memory_order_relaxed);
+    }
+    start_ticks = ReadTicks();
+    start_time = std::chrono::steady_clock::now();
+}
+
+double Neato::GraphProfile::TicksPerNanosecond() const
+{
+#if NEATO_SIMD_X86
+    // the TSC runs at a fixed rate on anything recent, measure it over the time the profile has been running
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start_time;
+    const uint64_t ticks = ReadTicks() - start_ticks;
+    return (elapsed.count() > 0.0 && ticks > 0) ? ticks / elapsed.count() : 1.0;
+#else
+    return 1.0;
+#endif //NEATO_SIMD_X86
+}
+
+void Neato::GraphProfile::WriteTreeReport(std::ostream& out) const
+{
+    const double ticks_per_ns = TicksPerNanosecond();
+    uint64_t graph_ticks = 0;
+    for (const node_stats_t* root : roots)
+    {
+        graph_ticks += root->ticks.load(std::memory_order_relaxed);
+    }
+    for (const node_stats_t* root : roots)
+    {
+        WriteTreeNode(out, *root, 0, ticks_per_ns, graph_ticks);
+    }
+}
+
+void Neato::GraphProfile::WriteFoldedStacks(std::ostream& out) const
+{
+    const double ticks_per_ns = TicksPerNanosecond();
+    for (const node_stats_t* root : roots)
+    {
+        WriteFoldedNode(out, *root, std::string(), ticks_per_ns);
+    }
+}
+
+std::shared_ptr<Neato::GraphProfile> Neato::ProfileGraph(std::shared_ptr<ISampleSource>& root)
+{
+    profile_walk_t walk;
+    walk.profile = std::make_shared<GraphProfile>();
+    ProfileNode(root, nullptr, walk);
+    return walk.profile;
+}
+
+std::shared_ptr<Neato::GraphProfile> Neato::ProfileGraph(IMultichannelSource& root)
+{
+    profile_walk_t walk;
+    walk.profile = std::make_shared<GraphProfile>();
+    root.ForEachChild([&walk](std::shared_ptr<ISampleSource>& input)
+    {
+        ProfileNode(input, nullptr, walk);
+    });
+    return walk.profile;
+}
+
+void Neato::RemoveProfiling(std::shared_ptr<ISampleSource>& root)
+{
+    UnprofileNode(root);
+}
+
+void Neato::RemoveProfiling(IMultichannelSource& root)
+{
+    root.ForEachChild([](std::shared_ptr<ISampleSource>& input)
+    {
+        UnprofileNode(input);
+    });
+}
@@ -0,0 +1,66 @@
+//
+//  profiler.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vector>
+#include "base_waveforms.hpp"
+#include "mixer_bus.hpp"
+
+namespace Neato
+{
+    // Per node render cost for a graph that's already built. ProfileGraph() puts every node under the root
+    // behind a decorator that counts calls and samples and times each Sample/SampleBlock with the TSC
+    // (steady_clock off x86), children included. Nothing is wrapped until it's called, so a graph that isn't
+    // being profiled pays nothing, and RemoveProfiling() puts the original nodes back.
+    //
+    // The counters are relaxed atomics, so a graph split across ParallelGraph workers can be profiled too.
+    // A node shared by several parents is timed under each of them, its children only under the first.
+    class GraphProfile
+    {
+    public:
+        struct node_stats_t
+        {
+            const char* type_name = nullptr;
+            node_stats_t* parent = nullptr;
+            std::vector<node_stats_t*> children;
+            std::atomic<uint64_t> calls = 0;
+            std::atomic<uint64_t> samples = 0;
+            // time spent in the node and everything under it
+            std::atomic<uint64_t> ticks = 0;
+        };
+
+        GraphProfile();
+        node_stats_t* AddNode(const char* type_name, node_stats_t* parent);
+        // zeroes the counters and restarts the clock the ticks are converted with
+        void Clear();
+
+        // one line per node, indented under its parent: calls, samples, time with and without the children,
+        // share of the whole graph and ns per sample
+        void WriteTreeReport(std::ostream& out) const;
+        // "root;child;grandchild <self ns>" per node, the input flamegraph.pl and speedscope take
+        void WriteFoldedStacks(std::ostream& out) const;
+
+    private:
+        double TicksPerNanosecond() const;
+
+        // a deque so the pointers the decorators hold stay put as nodes are added
+        std::deque<node_stats_t> nodes;
+        std::vector<node_stats_t*> roots;
+        uint64_t start_ticks;
+        std::chrono::steady_clock::time_point start_time;
+    };
+
+    std::shared_ptr<GraphProfile> ProfileGraph(std::shared_ptr<ISampleSource>& root);
+    // every input of the bus is a root of the profile
+    std::shared_ptr<GraphProfile> ProfileGraph(IMultichannelSource& root);
+    void RemoveProfiling(std::shared_ptr<ISampleSource>& root);
+    void RemoveProfiling(IMultichannelSource& root);
+};
@@ -0,0 +1,238 @@
+//
+//  realtime_thread.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "realtime_thread.hpp"
+#include "simd.hpp"
+
+#if defined(__linux__)
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif //__linux__
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif //__GLIBC__
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <malloc.h>
+#endif //_WIN32 || _WIN64
+
+namespace
+{
+    std::string ErrorString(const char* what, int error)
+    {
+        return std::string(what) + ": " + std::strerror(error);
+    }
+
+    bool FlushDenormals()
+    {
+#if NEATO_SIMD_X86
+        // FTZ is bit 15 of MXCSR, DAZ bit 6
+        _mm_setcsr(_mm_getcsr() | 0x8040);
+        return true;
+#elif defined(__aarch64__) && defined(__GNUC__)
+        // FZ is bit 24 of FPCR, and on AArch64 it covers inputs as well as results
+        uint64_t fpcr = 0;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (uint64_t(1) << 24)));
+        return true;
+#else
+        return false;
+#endif //NEATO_SIMD_X86
+    }
+
+#if defined(__linux__)
+    // its own frame, so the alloca'd pages are below everything the caller has already touched
+    __attribute__((noinline)) void PrefaultStack(std::size_t bytes)
+    {
+        volatile unsigned char* stack = static_cast<volatile unsigned char*>(alloca(bytes));
+        const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        for (std::size_t i = 0; i < bytes; i += page_size)
+        {
+            stack[i] = 0;
+        }
+    }
+
+    void SetRealtimePriority(const Neato::realtime_thread_config_t& config, Neato::realtime_thread_report_t& report)
+    {
+        const int policy = (config.policy == Neato::RealtimePolicy::round_robin) ? SCHED_RR : SCHED_FIFO;
+        const int lowest = sched_get_priority_min(policy);
+        int priority = std::clamp(config.priority, lowest, sched_get_priority_max(policy));
+        sched_param param = {};
+        param.sched_priority = priority;
+        int error = pthread_setschedparam(pthread_self(), policy, &param);
+        if (error == EPERM)
+        {
+            // without CAP_SYS_NICE a process can still go as high as its RLIMIT_RTPRIO, often set for an audio group
+            rlimit limit = {};
+            if (0 == getrlimit(RLIMIT_RTPRIO, &limit) && static_cast<int>(limit.rlim_cur) >= lowest)
+            {
+                priority = std::min(priority, static_cast<int>(limit.rlim_cur));
+                param.sched_priority = priority;
+                error = pthread_setschedparam(pthread_self(), policy, &param);
+            }
+        }
+        if (error == 0)
+        {
+            report.realtime_priority = true;
+            report.policy = (policy == SCHED_RR) ? "SCHED_RR" : "SCHED_FIFO";
+            report.priority = priority;
+            return;
+        }
+        report.failures.push_back(ErrorString("realtime priority", error));
+        // the best a normal time sharing thread can do
+        const pid_t thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+        if (0 == setpriority(PRIO_PROCESS, static_cast<id_t>(thread_id), -10))
+        {
+            report.policy = "SCHED_OTHER";
+            report.priority = -10;
+        }
+        else
+        {
+            report.failures.push_back(ErrorString("nice -10", errno));
+            report.policy = "SCHED_OTHER";
+            report.priority = getpriority(PRIO_PROCESS, static_cast<id_t>(thread_id));
+        }
+    }
+#endif //__linux__
+}
+
+Neato::realtime_thread_config_t Neato::DefaultRealtimeThreadConfig()
+{
+    realtime_thread_config_t config;
+    config.realtime_priority = true;
+    config.lock_memory = true;
+    config.prefault_stack_bytes = 256 * 1024;
+    config.flush_denormals = true;
+    return config;
+}
+
+Neato::realtime_thread_report_t Neato::MakeThreadRealtime(const realtime_thread_config_t& config)
+{
+    realtime_thread_report_t report;
+#if defined(__linux__)
+    if (config.lock_memory)
+    {
+        if (0 == mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            report.memory_locked = true;
+#if defined(__GLIBC__)
+            // no trimming the top of the heap and no mmap'd blocks, either would unmap memory that has to be
+            // faulted back in the next time it's allocated
+            mallopt(M_TRIM_THRESHOLD, -1);
+            mallopt(M_MMAP_MAX, 0);
+#endif //__GLIBC__
+        }
+        else
+        {
+            report.failures.push_back(ErrorString("mlockall", errno));
+        }
+    }
+    if (config.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+        const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error == 0)
+        {
+            report.pinned = true;
+            report.cpu = config.cpu;
+        }
+        else
+        {
+            report.failures.push_back(ErrorString("CPU affinity", error));
+        }
+    }
+    if (config.realtime_priority)
+    {
+        SetRealtimePriority(config, report);
+    }
+    if (config.prefault_stack_bytes > 0)
+    {
+        PrefaultStack(config.prefault_stack_bytes);
+        report.stack_prefaulted_bytes = config.prefault_stack_bytes;
+    }
+#elif defined(_WIN32) || defined(_WIN64)
+    if (config.lock_memory)
+    {
+        report.failures.push_back("locking memory isn't supported on Windows");
+    }
+    if (config.cpu >= 0)
+    {
+        if (0 != SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << config.cpu))
+        {
+            report.pinned = true;
+            report.cpu = config.cpu;
+        }
+        else
+        {
+            report.failures.push_back("SetThreadAffinityMask failed: " + std::to_string(GetLastError()));
+        }
+    }
+    if (config.realtime_priority)
+    {
+        // the device thread also registers with MMCSS, this is for the threads that don't
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        {
+            report.realtime_priority = true;
+            report.policy = "THREAD_PRIORITY_TIME_CRITICAL";
+            report.priority = THREAD_PRIORITY_TIME_CRITICAL;
+        }
+        else
+        {
+            report.failures.push_back("SetThreadPriority failed: " + std::to_string(GetLastError()));
+        }
+    }
+    if (config.prefault_stack_bytes > 0)
+    {
+        volatile unsigned char* stack = static_cast<volatile unsigned char*>(_alloca(config.prefault_stack_bytes));
+        for (std::size_t i = 0; i < config.prefault_stack_bytes; i += 4096)
+        {
+            stack[i] = 0;
+        }
+        report.stack_prefaulted_bytes = config.prefault_stack_bytes;
+    }
+#else
+    if (config.realtime_priority || config.cpu >= 0 || config.lock_memory || config.prefault_stack_bytes > 0)
+    {
+        report.failures.push_back("only denormal flushing is supported on this platform");
+    }
+#endif //__linux__
+    if (config.flush_denormals)
+    {
+        report.denormals_flushed = FlushDenormals();
+        if (!report.denormals_flushed)
+        {
+            report.failures.push_back("no way to flush denormals on this CPU");
+        }
+    }
+    return report;
+}
+
+void Neato::WriteRealtimeThreadReport(std::ostream& out, const realtime_thread_report_t& report)
+{
+    out << "Scheduling: " << (report.policy.empty() ? "unchanged" : report.policy);
+    if (!report.policy.empty())
+    {
+        out << " " << report.priority;
+    }
+    out << (report.realtime_priority ? " (realtime)" : "") << std::endl;
+    out << "Pinned: " << (report.pinned ? "CPU " + std::to_string(report.cpu) : std::string("no"))
+        << ", memory locked: " << (report.memory_locked ? "yes" : "no")
+        << ", stack prefaulted: " << report.stack_prefaulted_bytes / 1024 << " KB"
+        << ", denormals flushed: " << (report.denormals_flushed ? "yes" : "no") << std::endl;
+    for (const std::string& failure : report.failures)
+    {
+        out << "  " << failure << std::endl;
+    }
+}
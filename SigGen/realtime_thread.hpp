@@ -0,0 +1,61 @@
+//
+//  realtime_thread.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Neato
+{
+    enum class RealtimePolicy
+    {
+        fifo,
+        round_robin
+    };
+
+    // everything is off by default, DefaultRealtimeThreadConfig() turns on what an audio thread wants
+    struct realtime_thread_config_t
+    {
+        bool realtime_priority = false;
+        RealtimePolicy policy = RealtimePolicy::fifo;
+        // 1-99 on Linux. if the process isn't allowed that much, the highest it is allowed (RLIMIT_RTPRIO) is
+        // tried next and then a plain nice -10
+        int priority = 80;
+        // pin to this CPU, -1 leaves the thread wherever the scheduler puts it
+        int cpu = -1;
+        // mlockall everything mapped now and later, and keep freed heap in the process so the allocator
+        // never hands pages back to be faulted in again. process wide
+        bool lock_memory = false;
+        // touch this much of the thread's stack so the pages exist before the first callback needs them
+        std::size_t prefault_stack_bytes = 0;
+        // flush to zero and denormals are zero, so a decaying envelope doesn't crawl through denormals.
+        // per thread
+        bool flush_denormals = false;
+    };
+
+    // what took effect, and why anything asked for didn't
+    struct realtime_thread_report_t
+    {
+        bool realtime_priority = false;
+        std::string policy;
+        int priority = 0;
+        bool pinned = false;
+        int cpu = -1;
+        bool memory_locked = false;
+        std::size_t stack_prefaulted_bytes = 0;
+        bool denormals_flushed = false;
+        std::vector<std::string> failures;
+    };
+
+    // SCHED_FIFO at 80, memory locked, 256 KB of stack prefaulted, denormals flushed, not pinned
+    realtime_thread_config_t DefaultRealtimeThreadConfig();
+    // applies config to the calling thread. call it on the thread before it starts rendering, it allocates.
+    // Linux gets all of it; Windows gets priority, pinning and denormals; everything else denormals only
+    realtime_thread_report_t MakeThreadRealtime(const realtime_thread_config_t& config);
+    void WriteRealtimeThreadReport(std::ostream& out, const realtime_thread_report_t& report);
+};
@@ -0,0 +1,134 @@
+//
+//  render_cache.cpp
+//  SigGen
+//
+
+#include <cmath>
+#include "render_cache.hpp"
+
+namespace
+{
+    // plays a finished render, then silence
+    class CachedSound : public Neato::ISampleSourceWithDuration
+    {
+    public:
+        CachedSound(std::shared_ptr<const std::vector<Neato::sample_t>> samples_in, double duration_in, const std::string& key_in)
+            : samples(samples_in)
+            , duration(duration_in)
+            , key(key_in)
+            , position(0)
+        {
+        }
+        virtual Neato::sample_t Sample() override
+        {
+            return (position < samples->size()) ? (*samples)[position++] : 0.0;
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block) override
+        {
+            const std::size_t count = std::min(block.size(), samples->size() - position);
+            std::copy_n(samples->data() + position, count, block.begin());
+            std::fill(block.begin() + count, block.end(), 0.0);
+            position += count;
+        }
+        virtual double Duration() const override
+        {
+            return duration;
+        }
+        virtual void Reset() override
+        {
+            position = 0;
+        }
+        // the same as the sound it was rendered from, so a sequence of cached notes can be cached in turn
+        virtual bool Describe(Neato::GraphDescription& description) const override
+        {
+            description.Add(key);
+            return true;
+        }
+    private:
+        std::shared_ptr<const std::vector<Neato::sample_t>> samples;
+        const double duration;
+        const std::string key;
+        std::size_t position;
+    };
+}
+
+Neato::RenderCache::RenderCache(double sample_rate_in, std::size_t capacity_bytes_in, uint32_t block_frames_in)
+    : sample_rate(sample_rate_in)
+    , capacity_bytes(capacity_bytes_in)
+    , block_frames(std::max<uint32_t>(1, block_frames_in))
+{
+    stats.capacity_bytes = capacity_bytes;
+}
+
+std::shared_ptr<Neato::ISampleSourceWithDuration> Neato::RenderCache::Cached(std::shared_ptr<ISampleSourceWithDuration> sound)
+{
+    GraphDescription description;
+    // the sample rate isn't in every node, but it's in how long the render is
+    description.Add(sample_rate);
+    const bool describable = description.Child(sound.get());
+    // one past the last sample a sound of this duration can play
+    const std::size_t frame_count = static_cast<std::size_t>(std::ceil(sound->Duration() * sample_rate)) + 1;
+    const std::size_t byte_count = frame_count * sizeof(sample_t);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!describable || byte_count > capacity_bytes)
+    {
+        stats.uncacheable++;
+        return sound;
+    }
+    auto found = index.find(description.Bytes());
+    if (found != index.end())
+    {
+        stats.hits++;
+        renders.splice(renders.begin(), renders, found->second);
+        return Playback(renders.front());
+    }
+
+    stats.misses++;
+    std::shared_ptr<std::vector<sample_t>> samples = std::make_shared<std::vector<sample_t>>(frame_count);
+    sound->Reset();
+    for (std::size_t written = 0; written < frame_count; written += block_frames)
+    {
+        sound->SampleBlock(std::span<sample_t>(samples->data() + written, std::min<std::size_t>(block_frames, frame_count - written)));
+    }
+    Evict(byte_count);
+    renders.push_front({description.Bytes(), samples, sound->Duration()});
+    index.emplace(renders.front().key, renders.begin());
+    stats.entries++;
+    stats.bytes += byte_count;
+    return Playback(renders.front());
+}
+
+Neato::render_cache_stats_t Neato::RenderCache::Stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+void Neato::RenderCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    stats.evictions += renders.size();
+    renders.clear();
+    index.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+}
+
+std::shared_ptr<Neato::ISampleSourceWithDuration> Neato::RenderCache::Playback(const cached_render_t& render) const
+{
+    return std::make_shared<CachedSound>(render.samples, render.duration, render.key);
+}
+
+void Neato::RenderCache::Evict(std::size_t incoming_bytes)
+{
+    while (!renders.empty() && stats.bytes + incoming_bytes > capacity_bytes)
+    {
+        const cached_render_t& oldest = renders.back();
+        stats.bytes -= oldest.samples->size() * sizeof(sample_t);
+        stats.entries--;
+        stats.evictions++;
+        index.erase(oldest.key);
+        renders.pop_back();
+    }
+}
@@ -0,0 +1,70 @@
+//
+//  render_cache.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "sequence.h"
+
+namespace Neato
+{
+    struct render_cache_stats_t
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // sounds handed back as they were, because something in them couldn't be described or the render
+        // wouldn't fit under the cap
+        uint64_t uncacheable = 0;
+        uint64_t evictions = 0;
+        uint32_t entries = 0;
+        std::size_t bytes = 0;
+        std::size_t capacity_bytes = 0;
+    };
+
+    // Renders a sound once and plays the samples back every time a sound that describes the same way comes
+    // along again. Cached() describes the sound (see GraphDescription), renders it from Reset() to the end of
+    // its Duration() on the calling thread if nothing matches yet, and hands back a leaf that copies out of
+    // the shared render. Anything after Duration() is taken to be silence, which is what the sounds and
+    // sequences here play.
+    //
+    // Renders are kept least recently used first out, under capacity_bytes. An evicted render stays alive
+    // for as long as something is still playing it, it just isn't counted or found any more. Rendering goes
+    // block_frames at a time, so it matches a live render bit for bit as long as nothing in the sound renders
+    // differently depending on block size. An OscillatorBank steps its phases once a block and can be an LSB out.
+    //
+    // Call it when the graph is being built, never from the render thread: a miss renders the whole sound.
+    class RenderCache
+    {
+    public:
+        RenderCache(double sample_rate_in, std::size_t capacity_bytes_in, uint32_t block_frames_in = 4096);
+        std::shared_ptr<ISampleSourceWithDuration> Cached(std::shared_ptr<ISampleSourceWithDuration> sound);
+        render_cache_stats_t Stats() const;
+        void Clear();
+
+    private:
+        struct cached_render_t
+        {
+            std::string key;
+            std::shared_ptr<const std::vector<sample_t>> samples;
+            double duration = 0.0;
+        };
+        using lru_list_t = std::list<cached_render_t>;
+
+        std::shared_ptr<ISampleSourceWithDuration> Playback(const cached_render_t& render) const;
+        void Evict(std::size_t incoming_bytes);
+
+        const double sample_rate;
+        const std::size_t capacity_bytes;
+        const uint32_t block_frames;
+        mutable std::mutex lock;
+        // most recently used at the front
+        lru_list_t renders;
+        std::unordered_map<std::string, lru_list_t::iterator> index;
+        render_cache_stats_t stats;
+    };
+};
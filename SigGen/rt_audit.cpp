@@ -0,0 +1,419 @@
+//
+//  rt_audit.cpp
+//  SigGen
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include <unordered_set>
+#include "rt_audit.hpp"
+#include "node_decorator.hpp"
+#include "sequence.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <execinfo.h>
+#endif //_WIN32 || _WIN64
+#if NEATO_RT_AUDIT && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#endif //NEATO_RT_AUDIT && __GLIBC__
+
+namespace
+{
+    // fixed up front, recording can't allocate without tripping over itself
+    constexpr uint32_t violation_capacity = 1024;
+    constexpr uint32_t max_node_depth = 64;
+
+    std::atomic<bool> audit_enabled(false);
+    std::atomic<uint32_t> violation_count(0);
+    std::atomic<uint64_t> dropped_count(0);
+    Neato::rt_violation_t violations[violation_capacity];
+
+    thread_local uint32_t realtime_depth = 0;
+    thread_local bool recording = false;
+    thread_local const char* node_stack[max_node_depth];
+    thread_local uint32_t node_depth = 0;
+
+    uint32_t CaptureStack(void** frames, uint32_t max_frames)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        return ::CaptureStackBackTrace(0, max_frames, frames, nullptr);
+#else
+        return static_cast<uint32_t>(std::max(0, ::backtrace(frames, static_cast<int>(max_frames))));
+#endif //_WIN32 || _WIN64
+    }
+
+    [[maybe_unused]] void Record(Neato::RtViolationType type, std::size_t bytes)
+    {
+        // the stack walk can allocate the first time round, that one isn't the audio thread's doing
+        if (realtime_depth == 0 || recording || !audit_enabled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        recording = true;
+        const uint32_t index = violation_count.fetch_add(1, std::memory_order_relaxed);
+        if (index < violation_capacity)
+        {
+            Neato::rt_violation_t& violation = violations[index];
+            violation.type = type;
+            violation.bytes = bytes;
+            violation.node = (node_depth == 0) ? nullptr : node_stack[std::min(node_depth, max_node_depth) - 1];
+            violation.frame_count = CaptureStack(violation.frames, Neato::rt_violation_t::max_frames);
+        }
+        else
+        {
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        recording = false;
+    }
+
+    const char* TypeName(Neato::RtViolationType type)
+    {
+        switch (type)
+        {
+            case Neato::RtViolationType::allocate: return "allocate";
+            case Neato::RtViolationType::deallocate: return "deallocate";
+            case Neato::RtViolationType::lock_mutex: return "lock mutex";
+        }
+        return "unknown";
+    }
+
+    // renders the node it wraps inside a scope that names it
+    template <typename Interface>
+    class AuditedNode : public Neato::ForwardingNode<Interface>
+    {
+    public:
+        explicit AuditedNode(std::shared_ptr<Interface> inner_in)
+            : Neato::ForwardingNode<Interface>(inner_in)
+            , name(typeid(*inner_in).name())
+        {
+        }
+        virtual Neato::sample_t Sample()
+        {
+            Neato::rt_node_scope_t scope(name);
+            return this->inner->Sample();
+        }
+        virtual void SampleBlock(std::span<Neato::sample_t> block)
+        {
+            Neato::rt_node_scope_t scope(name);
+            this->inner->SampleBlock(block);
+        }
+    private:
+        const char* name;
+    };
+
+    using AuditedNodeWithDuration = Neato::DurationForwardingNode<AuditedNode<Neato::ISampleSourceWithDuration>>;
+
+    bool IsAudited(Neato::ISampleSource* node)
+    {
+        return dynamic_cast<AuditedNode<Neato::ISampleSource>*>(node) || dynamic_cast<AuditedNode<Neato::ISampleSourceWithDuration>*>(node);
+    }
+
+    void AuditChildren(Neato::ISampleSource& node, std::unordered_set<Neato::ISampleSource*>& visited);
+
+    void AuditNode(std::shared_ptr<Neato::ISampleSource>& node, std::unordered_set<Neato::ISampleSource*>& visited)
+    {
+        if (!node || IsAudited(node.get()))
+        {
+            return;
+        }
+        // shared nodes get a wrapper per parent but their children are only walked once
+        const bool first_visit = visited.insert(node.get()).second;
+        if (auto with_duration = std::dynamic_pointer_cast<Neato::ISampleSourceWithDuration>(node))
+        {
+            node = std::make_shared<AuditedNodeWithDuration>(with_duration);
+        }
+        else
+        {
+            node = std::make_shared<AuditedNode<Neato::ISampleSource>>(node);
+        }
+        if (first_visit)
+        {
+            AuditChildren(*node, visited);
+        }
+    }
+
+    void AuditChildren(Neato::ISampleSource& node, std::unordered_set<Neato::ISampleSource*>& visited)
+    {
+        node.ForEachChild([&visited](std::shared_ptr<Neato::ISampleSource>& child)
+        {
+            AuditNode(child, visited);
+        });
+    }
+}
+
+bool Neato::RtAuditAvailable()
+{
+#if NEATO_RT_AUDIT
+    return true;
+#else
+    return false;
+#endif //NEATO_RT_AUDIT
+}
+
+void Neato::EnableRtAudit(bool enabled)
+{
+    if (enabled)
+    {
+        // the first stack walk loads the unwinder, get that out of the way while it doesn't count
+        void* frames[1];
+        CaptureStack(frames, 1);
+    }
+    audit_enabled.store(enabled, std::memory_order_release);
+}
+
+std::vector<Neato::rt_violation_t> Neato::TakeRtViolations()
+{
+    const uint32_t count = std::min(violation_count.load(std::memory_order_acquire), violation_capacity);
+    std::vector<rt_violation_t> taken(violations, violations + count);
+    violation_count.store(0, std::memory_order_release);
+    dropped_count.store(0, std::memory_order_relaxed);
+    return taken;
+}
+
+uint64_t Neato::DroppedRtViolations()
+{
+    return dropped_count.load(std::memory_order_relaxed);
+}
+
+void Neato::WriteRtViolationReport(std::ostream& out, const std::vector<rt_violation_t>& violations_in)
+{
+    for (std::size_t i = 0; i < violations_in.size(); i++)
+    {
+        const rt_violation_t& violation = violations_in[i];
+        out << "#" << i << " " << TypeName(violation.type);
+        if (violation.type == RtViolationType::allocate)
+        {
+            out << " " << violation.bytes << " bytes";
+        }
+        out << " in " << (violation.node ? Neato::DemangleTypeName(violation.node) : std::string("(no audited node)")) << std::endl;
+#if defined(_WIN32) || defined(_WIN64)
+        for (uint32_t frame = 0; frame < violation.frame_count; frame++)
+        {
+            out << "    " << violation.frames[frame] << std::endl;
+        }
+#else
+        char** symbols = ::backtrace_symbols(violation.frames, static_cast<int>(violation.frame_count));
+        for (uint32_t frame = 0; frame < violation.frame_count; frame++)
+        {
+            out << "    " << (symbols ? symbols[frame] : "?") << std::endl;
+        }
+        std::free(symbols);
+#endif //_WIN32 || _WIN64
+    }
+}
+
+Neato::rt_scope_t::rt_scope_t()
+{
+    realtime_depth++;
+}
+
+Neato::rt_scope_t::~rt_scope_t()
+{
+    realtime_depth--;
+}
+
+Neato::rt_node_scope_t::rt_node_scope_t(const char* node)
+{
+    if (node_depth < max_node_depth)
+    {
+        node_stack[node_depth] = node;
+    }
+    node_depth++;
+}
+
+Neato::rt_node_scope_t::~rt_node_scope_t()
+{
+    node_depth--;
+}
+
+void Neato::AuditGraph(std::shared_ptr<ISampleSource>& root)
+{
+    std::unordered_set<ISampleSource*> visited;
+    AuditNode(root, visited);
+}
+
+void Neato::AuditGraph(IMultichannelSource& root)
+{
+    std::unordered_set<ISampleSource*> visited;
+    root.ForEachChild([&visited](std::shared_ptr<ISampleSource>& child)
+    {
+        AuditNode(child, visited);
+    });
+}
+
+#if NEATO_RT_AUDIT
+// the hooks. operator new/delete are replaced everywhere; glibc builds also interpose the C allocator and
+// pthread_mutex_lock, which is what std::mutex ends up in. new goes straight to the C allocator underneath
+// so one allocation is never counted twice
+#if defined(__GLIBC__)
+extern "C"
+{
+    void* __libc_malloc(std::size_t bytes);
+    void* __libc_calloc(std::size_t count, std::size_t bytes);
+    void* __libc_realloc(void* memory, std::size_t bytes);
+    void* __libc_memalign(std::size_t alignment, std::size_t bytes);
+    void __libc_free(void* memory);
+}
+#endif //__GLIBC__
+
+namespace
+{
+    void* RawAllocate(std::size_t bytes)
+    {
+#if defined(__GLIBC__)
+        return __libc_malloc(bytes);
+#else
+        return std::malloc(bytes);
+#endif //__GLIBC__
+    }
+
+    void* RawAllocateAligned(std::size_t bytes, std::size_t alignment)
+    {
+#if defined(__GLIBC__)
+        return __libc_memalign(alignment, bytes);
+#elif defined(_WIN32) || defined(_WIN64)
+        return _aligned_malloc(bytes, alignment);
+#else
+        void* memory = nullptr;
+        return (0 == posix_memalign(&memory, std::max(alignment, sizeof(void*)), bytes)) ? memory : nullptr;
+#endif //__GLIBC__
+    }
+
+    void RawFree(void* memory)
+    {
+#if defined(__GLIBC__)
+        __libc_free(memory);
+#else
+        std::free(memory);
+#endif //__GLIBC__
+    }
+
+    void RawFreeAligned(void* memory)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        _aligned_free(memory);
+#else
+        RawFree(memory);
+#endif //_WIN32 || _WIN64
+    }
+
+    void* AuditedNew(std::size_t bytes)
+    {
+        Record(Neato::RtViolationType::allocate, bytes);
+        void* memory = RawAllocate(bytes ? bytes : 1);
+        if (!memory)
+        {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void* AuditedNewAligned(std::size_t bytes, std::align_val_t alignment)
+    {
+        Record(Neato::RtViolationType::allocate, bytes);
+        void* memory = RawAllocateAligned(bytes ? bytes : 1, static_cast<std::size_t>(alignment));
+        if (!memory)
+        {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void AuditedDelete(void* memory)
+    {
+        if (memory)
+        {
+            Record(Neato::RtViolationType::deallocate, 0);
+            RawFree(memory);
+        }
+    }
+
+    void AuditedDeleteAligned(void* memory)
+    {
+        if (memory)
+        {
+            Record(Neato::RtViolationType::deallocate, 0);
+            RawFreeAligned(memory);
+        }
+    }
+}
+
+void* operator new(std::size_t bytes) { return AuditedNew(bytes); }
+void* operator new[](std::size_t bytes) { return AuditedNew(bytes); }
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept { try { return AuditedNew(bytes); } catch (...) { return nullptr; } }
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept { try { return AuditedNew(bytes); } catch (...) { return nullptr; } }
+void* operator new(std::size_t bytes, std::align_val_t alignment) { return AuditedNewAligned(bytes, alignment); }
+void* operator new[](std::size_t bytes, std::align_val_t alignment) { return AuditedNewAligned(bytes, alignment); }
+void* operator new(std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept { try { return AuditedNewAligned(bytes, alignment); } catch (...) { return nullptr; } }
+void* operator new[](std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept { try { return AuditedNewAligned(bytes, alignment); } catch (...) { return nullptr; } }
+void operator delete(void* memory) noexcept { AuditedDelete(memory); }
+void operator delete[](void* memory) noexcept { AuditedDelete(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { AuditedDelete(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { AuditedDelete(memory); }
+void operator delete(void* memory, std::size_t) noexcept { AuditedDelete(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { AuditedDelete(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { AuditedDeleteAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { AuditedDeleteAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { AuditedDeleteAligned(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { AuditedDeleteAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { AuditedDeleteAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { AuditedDeleteAligned(memory); }
+
+#if defined(__GLIBC__)
+namespace
+{
+    using mutex_lock_fn = int (*)(pthread_mutex_t*);
+    // looked up on first use, an atomic rather than a function static so the lookup never waits on a lock
+    std::atomic<mutex_lock_fn> real_mutex_lock(nullptr);
+}
+
+extern "C"
+{
+    void* malloc(std::size_t bytes)
+    {
+        Record(Neato::RtViolationType::allocate, bytes);
+        return __libc_malloc(bytes);
+    }
+
+    void* calloc(std::size_t count, std::size_t bytes)
+    {
+        Record(Neato::RtViolationType::allocate, count * bytes);
+        return __libc_calloc(count, bytes);
+    }
+
+    void* realloc(void* memory, std::size_t bytes)
+    {
+        Record(Neato::RtViolationType::allocate, bytes);
+        return __libc_realloc(memory, bytes);
+    }
+
+    void free(void* memory)
+    {
+        if (memory)
+        {
+            Record(Neato::RtViolationType::deallocate, 0);
+        }
+        __libc_free(memory);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        mutex_lock_fn lock = real_mutex_lock.load(std::memory_order_acquire);
+        if (!lock)
+        {
+            lock = reinterpret_cast<mutex_lock_fn>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+            real_mutex_lock.store(lock, std::memory_order_release);
+        }
+        Record(Neato::RtViolationType::lock_mutex, 0);
+        return lock(mutex);
+    }
+}
+#endif //__GLIBC__
+#endif //NEATO_RT_AUDIT
@@ -0,0 +1,75 @@
+//
+//  rt_audit.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "base_waveforms.hpp"
+#include "mixer_bus.hpp"
+
+// Real-time safety audit. Built with NEATO_RT_AUDIT defined, operator new/delete are replaced and on
+// Linux malloc, calloc, realloc, free and pthread_mutex_lock are interposed too. Anything a thread does
+// inside an rt_scope_t while the audit is enabled is recorded with a stack trace and the audited node
+// that was rendering. Without NEATO_RT_AUDIT the scopes still compile and cost a thread local increment,
+// but nothing is hooked and RtAuditAvailable() is false.
+namespace Neato
+{
+    enum class RtViolationType
+    {
+        allocate,
+        deallocate,
+        lock_mutex
+    };
+
+    struct rt_violation_t
+    {
+        static constexpr uint32_t max_frames = 24;
+        RtViolationType type = RtViolationType::allocate;
+        // typeid name of the innermost audited node, nullptr when it happened outside every node
+        const char* node = nullptr;
+        std::size_t bytes = 0;
+        uint32_t frame_count = 0;
+        void* frames[max_frames] = {};
+    };
+
+    bool RtAuditAvailable();
+    // recording is off until this turns it on, so setup on any thread is never counted
+    void EnableRtAudit(bool enabled);
+    // everything recorded since the last call, oldest first. call it while the audited threads are idle
+    std::vector<rt_violation_t> TakeRtViolations();
+    // violations that didn't fit in the fixed record, also cleared by TakeRtViolations()
+    uint64_t DroppedRtViolations();
+    // symbols where the platform can provide them, addresses otherwise
+    void WriteRtViolationReport(std::ostream& out, const std::vector<rt_violation_t>& violations);
+
+    // marks the calling thread as a render thread until it goes out of scope. scopes nest
+    class rt_scope_t
+    {
+    public:
+        rt_scope_t();
+        ~rt_scope_t();
+        rt_scope_t(const rt_scope_t&) = delete;
+        rt_scope_t& operator=(const rt_scope_t&) = delete;
+    };
+
+    // names the node being rendered, for the violations it causes
+    class rt_node_scope_t
+    {
+    public:
+        explicit rt_node_scope_t(const char* node);
+        ~rt_node_scope_t();
+        rt_node_scope_t(const rt_node_scope_t&) = delete;
+        rt_node_scope_t& operator=(const rt_node_scope_t&) = delete;
+    };
+
+    // puts every node under the root behind a decorator that opens an rt_node_scope_t around its render
+    // calls. ISampleSourceWithDuration children keep their interface so sequences take them. nodes that
+    // hide their children (a compiled graph) are reported as a whole
+    void AuditGraph(std::shared_ptr<ISampleSource>& root);
+    void AuditGraph(IMultichannelSource& root);
+};
@@ -0,0 +1,18 @@
+//
+//  sample_type.hpp
+//  SigGen
+//
+
+#pragma once
+
+namespace Neato
+{
+    // the type every block and every Sample() carries through the graph. define NEATO_SINGLE_PRECISION
+    // to build the whole graph on float, which doubles the lanes per SIMD instruction. phases, frequencies
+    // and other values that accumulate stay double either way
+#ifdef NEATO_SINGLE_PRECISION
+    using sample_t = float;
+#else
+    using sample_t = double;
+#endif //NEATO_SINGLE_PRECISION
+};
@@ -1,11 +1,17 @@
 #include <memory>
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 #include "sequence.h"
 
 namespace Neato
 {
+    ISampleSourceWithDuration::~ISampleSourceWithDuration()
+    {
+
+    }
+
     class SampleSourceWithDuration : public ISampleSourceWithDuration
     {
     public:
@@ -16,7 +22,7 @@ namespace Neato
         , accumulated_samples(0)
         {
         }
-        virtual double Sample() override
+        virtual sample_t Sample() override
         {
             if (accumulated_samples <= duration_in_samples)
             {
@@ -25,6 +31,21 @@ namespace Neato
             }
             return 0.0;
         }
+        virtual void SampleBlock(std::span<sample_t> block) override
+        {
+            std::size_t active_count = 0;
+            if (accumulated_samples <= duration_in_samples)
+            {
+                active_count = std::min<std::size_t>(block.size(), static_cast<std::size_t>(duration_in_samples - accumulated_samples) + 1);
+                source->SampleBlock(block.first(active_count));
+                accumulated_samples += active_count;
+            }
+            std::fill(block.begin() + active_count, block.end(), 0.0);
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor) override
+        {
+            visitor(source);
+        }
         double Duration() const override
         {
             return duration;
@@ -32,6 +53,12 @@ namespace Neato
         void Reset() override
         {
             accumulated_samples = 0;
+            source->Reset();
+        }
+        bool Describe(GraphDescription& description) const override
+        {
+            description.Add(duration_in_samples);
+            return description.Child(source.get());
         }
     private:
         std::shared_ptr<ISampleSource> source;
@@ -40,37 +67,78 @@ namespace Neato
         double accumulated_samples;
     };
 
-    struct SequenceMilestone
+    // an element turning on or off at a sample time. the timeline is sorted once at construction
+    // and walked with a cursor, so the next event time is always events[next_event].sample
+    struct sequence_event_t
     {
-        SequenceMilestone()
-            :on_off(false)
-        {
-        }
-        sequence_element element;
+        uint64_t sample;
+        uint32_t element;
         bool on_off;
     };
-    using milestone_map_t = std::unordered_multimap<uint64_t, SequenceMilestone>;
 
     class SequenceSampleSource : public ISampleSourceWithDuration
     {
     public:
         SequenceSampleSource(const std::vector<sequence_element>& elements_in, double sample_rate_in)
         : elements(elements_in)
-        , summer()
         , accumulated_samples(0)
         , sample_time(1.0 / sample_rate_in)
         , duration(0.0)
+        , next_event(0)
         {
-            CalculateDurationsMilestones();
-            UpdateSummer(0);
+            BuildTimeline();
+            ApplyEvents();
         }
-        virtual double Sample() override
+        virtual sample_t Sample() override
         {
-            double sample_value = summer.Sample();
+            sample_t sample_value = 0;
+            for (std::shared_ptr<ISampleSource>& sound : active_sounds)
+            {
+                sample_value += sound->Sample();
+            }
             accumulated_samples++;
-            UpdateSummer(accumulated_samples);
+            ApplyEvents();
             return sample_value;
         }
+        virtual void SampleBlock(std::span<sample_t> block) override
+        {
+            // the active set only changes at events, so render straight through to the next one
+            std::size_t written = 0;
+            while (written < block.size())
+            {
+                std::size_t count = block.size() - written;
+                if (next_event < events.size())
+                {
+                    count = std::min<std::size_t>(count, static_cast<std::size_t>(events[next_event].sample - accumulated_samples));
+                }
+                SumSourcesIntoBlock(active_sounds, block.subspan(written, count), scratch);
+                written += count;
+                accumulated_samples += count;
+                ApplyEvents();
+            }
+        }
+        virtual void ForEachChild(const child_visitor_t& visitor) override
+        {
+            for (std::size_t i = 0; i < elements.size(); i++)
+            {
+                sequence_element& element = elements[i];
+                std::shared_ptr<ISampleSource> child = element.base_sound;
+                visitor(child);
+                if (child != element.base_sound)
+                {
+                    // a replacement has to keep the duration interface, the timeline depends on it
+                    std::shared_ptr<ISampleSourceWithDuration> replacement = std::dynamic_pointer_cast<ISampleSourceWithDuration>(child);
+                    if (replacement)
+                    {
+                        element.base_sound = replacement;
+                        if (active_slots[i] != inactive_slot)
+                        {
+                            active_sounds[active_slots[i]] = replacement;
+                        }
+                    }
+                }
+            }
+        }
         double Duration() const override
         {
             return duration;
@@ -78,56 +146,114 @@ namespace Neato
         void Reset() override
         {
             accumulated_samples = 0;
-            summer.ClearSources();
-            UpdateSummer(0);
+            next_event = 0;
+            for (sequence_element& element : elements)
+            {
+                element.base_sound->Reset();
+            }
+            active_sounds.clear();
+            active_elements.clear();
+            std::fill(active_slots.begin(), active_slots.end(), inactive_slot);
+            ApplyEvents();
+        }
+        bool Describe(GraphDescription& description) const override
+        {
+            description.Add(sample_time);
+            description.Add(elements.size());
+            for (const sequence_element& element : elements)
+            {
+                description.Add(element.delay_to_start);
+                if (!description.Child(element.base_sound.get()))
+                {
+                    return false;
+                }
+            }
+            return true;
         }
     private:
-        void CalculateDurationsMilestones()
+        static constexpr uint32_t inactive_slot = UINT32_MAX;
+
+        void BuildTimeline()
         {
             duration = 0.0;
-            // loop through elements and find the sample count where notes turn on or off.
-            // also calculate overall duration
-            for (const auto& element : elements)
+            // find the sample count where every element turns on and off, and the overall duration
+            events.reserve(elements.size() * 2);
+            for (uint32_t i = 0; i < static_cast<uint32_t>(elements.size()); i++)
             {
+                const sequence_element& element = elements[i];
                 double element_end_time = element.delay_to_start + element.base_sound->Duration();
                 if (element_end_time > duration)
                 {
                     duration = element_end_time;
                 }
                 uint64_t start_sample = static_cast<uint64_t>(element.delay_to_start / sample_time);
-                uint64_t end_sample = static_cast<uint64_t>((element.delay_to_start + element.base_sound->Duration()) / sample_time);
-                SequenceMilestone start_milestone;
-                start_milestone.element = element;
-                start_milestone.on_off = true;
-                milestones.insert({ start_sample, start_milestone });
-                SequenceMilestone end_milestone;
-                end_milestone.element = element;
-                end_milestone.on_off = false;
-                milestones.insert({end_sample, end_milestone});
+                uint64_t end_sample = static_cast<uint64_t>(element_end_time / sample_time);
+                events.push_back({start_sample, i, true});
+                events.push_back({end_sample, i, false});
             }
+            // stable, so events on the same sample keep element order and an element's on comes before its off
+            std::stable_sort(events.begin(), events.end(), [](const sequence_event_t& a, const sequence_event_t& b)
+            {
+                return a.sample < b.sample;
+            });
+            active_slots.assign(elements.size(), inactive_slot);
+            active_sounds.reserve(elements.size());
+            active_elements.reserve(elements.size());
         }
-        void UpdateSummer(uint64_t sample_count)
+        void ApplyEvents()
         {
-            auto range = milestones.equal_range(static_cast<uint64_t>(sample_count));
-            for (auto& it = range.first; it != range.second; ++it)
+            while (next_event < events.size() && events[next_event].sample <= accumulated_samples)
             {
-                const SequenceMilestone& milestone = it->second;
-                if (milestone.on_off)
+                const sequence_event_t& event = events[next_event];
+                if (event.on_off)
                 {
-                    summer.AddSource(milestone.element.base_sound);
+                    Activate(event.element);
                 }
                 else
                 {
-                    summer.RemoveSource(milestone.element.base_sound);
+                    Deactivate(event.element);
                 }
+                next_event++;
+            }
+        }
+        void Activate(uint32_t element)
+        {
+            if (active_slots[element] != inactive_slot)
+            {
+                return;
+            }
+            active_slots[element] = static_cast<uint32_t>(active_sounds.size());
+            active_sounds.push_back(elements[element].base_sound);
+            active_elements.push_back(element);
+        }
+        void Deactivate(uint32_t element)
+        {
+            const uint32_t slot = active_slots[element];
+            if (slot == inactive_slot)
+            {
+                return;
             }
+            // swap the last active sound into the hole
+            const uint32_t last_element = active_elements.back();
+            active_sounds[slot] = std::move(active_sounds.back());
+            active_elements[slot] = last_element;
+            active_slots[last_element] = slot;
+            active_sounds.pop_back();
+            active_elements.pop_back();
+            active_slots[element] = inactive_slot;
         }
         std::vector<sequence_element> elements;
-        MutableSummer summer;
         uint64_t accumulated_samples;
         const double sample_time;
         double duration;
-        milestone_map_t milestones;
+        std::vector<sequence_event_t> events;
+        std::size_t next_event;
+        // sounds playing right now, with the element each one belongs to at the same index
+        sample_source_vector_t active_sounds;
+        std::vector<uint32_t> active_elements;
+        // where each element sits in active_sounds, or inactive_slot
+        std::vector<uint32_t> active_slots;
+        std::vector<sample_t> scratch;
     };
 
     std::shared_ptr<ISampleSourceWithDuration> CreateSoundWithDuration(std::shared_ptr<ISampleSource> source, double duration, double sample_rate)
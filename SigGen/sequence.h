@@ -8,7 +8,7 @@ namespace Neato
 	{
 		virtual double Duration() const = 0;
 		virtual void Reset() = 0;
-		virtual ~ISampleSourceWithDuration() = 0 {};
+		virtual ~ISampleSourceWithDuration() = 0;
     };
 
 	struct sequence_element
@@ -0,0 +1,37 @@
+//
+//  simd.cpp
+//  SigGen
+//
+
+#include "simd.hpp"
+
+#if NEATO_SIMD_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static bool DetectAvx2()
+{
+#if NEATO_SIMD_X86 && defined(_MSC_VER)
+    int registers[4] = {0};
+    __cpuid(registers, 0);
+    if (registers[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(registers, 1);
+    const bool os_saves_ymm = (registers[2] & (1 << 27)) && (registers[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(registers, 7, 0);
+    return os_saves_ymm && (registers[1] & (1 << 5));
+#elif NEATO_SIMD_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool Neato::CpuHasAvx2()
+{
+    static const bool has_avx2 = DetectAvx2();
+    return has_avx2;
+}
@@ -0,0 +1,97 @@
+//
+//  simd.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// x86 builds get SSE2 kernels unconditionally and AVX2 kernels behind a runtime check,
+// everything else falls back to the scalar loops
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NEATO_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define NEATO_SIMD_X86 0
+#endif
+
+// MSVC lets any function use AVX2 intrinsics, gcc/clang need the function tagged
+#if NEATO_SIMD_X86 && !defined(_MSC_VER)
+#define NEATO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NEATO_TARGET_AVX2
+#endif
+
+namespace Neato
+{
+    // true when the CPU and OS both support AVX2, checked once
+    bool CpuHasAvx2();
+};
+
+#if NEATO_SIMD_X86
+// thin overloads keyed on the register type, so one kernel template runs float or double lanes.
+// sse_t<T> and avx_t<T> are the registers for a sample type, the lane counts follow from the width
+namespace Neato::simd
+{
+    template <typename T> struct registers;
+    template <> struct registers<double> { using sse = __m128d; using avx = __m256d; };
+    template <> struct registers<float> { using sse = __m128; using avx = __m256; };
+    template <typename T> using sse_t = typename registers<T>::sse;
+    template <typename T> using avx_t = typename registers<T>::avx;
+    // the other way round, only ever used in decltype
+    double LaneOf(__m128d);
+    float LaneOf(__m128);
+    double LaneOf(__m256d);
+    float LaneOf(__m256);
+    template <typename V> using lane_t = decltype(LaneOf(std::declval<V>()));
+    template <typename T> constexpr std::size_t sse_lanes = 16 / sizeof(T);
+    template <typename T> constexpr std::size_t avx_lanes = 32 / sizeof(T);
+
+    inline __m128d LoadSse(const double* p) { return _mm_loadu_pd(p); }
+    inline __m128 LoadSse(const float* p) { return _mm_loadu_ps(p); }
+    inline void Store(double* p, __m128d v) { _mm_storeu_pd(p, v); }
+    inline void Store(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+    template <typename T> inline sse_t<T> BroadcastSse(double x);
+    template <> inline __m128d BroadcastSse<double>(double x) { return _mm_set1_pd(x); }
+    template <> inline __m128 BroadcastSse<float>(double x) { return _mm_set1_ps(static_cast<float>(x)); }
+    inline __m128d Add(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+    inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    inline __m128d Sub(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+    inline __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+    inline __m128d Mul(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+    inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    inline __m128d And(__m128d a, __m128d b) { return _mm_and_pd(a, b); }
+    inline __m128 And(__m128 a, __m128 b) { return _mm_and_ps(a, b); }
+    inline __m128d AndNot(__m128d a, __m128d b) { return _mm_andnot_pd(a, b); }
+    inline __m128 AndNot(__m128 a, __m128 b) { return _mm_andnot_ps(a, b); }
+    inline __m128d Or(__m128d a, __m128d b) { return _mm_or_pd(a, b); }
+    inline __m128 Or(__m128 a, __m128 b) { return _mm_or_ps(a, b); }
+    // SSE2 has no round instruction, the int32 round trip rounds to nearest as long as |v| < 2^31
+    inline __m128d RoundNearest(__m128d v) { return _mm_cvtepi32_pd(_mm_cvtpd_epi32(v)); }
+    inline __m128 RoundNearest(__m128 v) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(v)); }
+
+    NEATO_TARGET_AVX2 inline __m256d LoadAvx(const double* p) { return _mm256_loadu_pd(p); }
+    NEATO_TARGET_AVX2 inline __m256 LoadAvx(const float* p) { return _mm256_loadu_ps(p); }
+    NEATO_TARGET_AVX2 inline void Store(double* p, __m256d v) { _mm256_storeu_pd(p, v); }
+    NEATO_TARGET_AVX2 inline void Store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+    template <typename T> NEATO_TARGET_AVX2 inline avx_t<T> BroadcastAvx(double x);
+    template <> NEATO_TARGET_AVX2 inline __m256d BroadcastAvx<double>(double x) { return _mm256_set1_pd(x); }
+    template <> NEATO_TARGET_AVX2 inline __m256 BroadcastAvx<float>(double x) { return _mm256_set1_ps(static_cast<float>(x)); }
+    NEATO_TARGET_AVX2 inline __m256d Add(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d Sub(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d Mul(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d And(__m256d a, __m256d b) { return _mm256_and_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 And(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d AndNot(__m256d a, __m256d b) { return _mm256_andnot_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 AndNot(__m256 a, __m256 b) { return _mm256_andnot_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d Or(__m256d a, __m256d b) { return _mm256_or_pd(a, b); }
+    NEATO_TARGET_AVX2 inline __m256 Or(__m256 a, __m256 b) { return _mm256_or_ps(a, b); }
+    NEATO_TARGET_AVX2 inline __m256d RoundNearest(__m256d v) { return _mm256_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    NEATO_TARGET_AVX2 inline __m256 RoundNearest(__m256 v) { return _mm256_round_ps(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+};
+#endif //NEATO_SIMD_X86
@@ -0,0 +1,206 @@
+//
+//  voice_pool.cpp
+//  SigGen
+//
+
+#include <limits>
+#include <stdexcept>
+#include "voice_pool.hpp"
+
+Neato::VoicePool::VoicePool(const voice_factory_t& factory, uint32_t voice_count, double sample_rate_in, VoiceStealPolicy steal_policy_in, uint32_t max_block_frames)
+    : sample_rate(sample_rate_in)
+    , steal_policy(steal_policy_in)
+    , next_serial(0)
+    , stolen_count(0)
+    , dropped_count(0)
+{
+    if (voice_count == 0)
+    {
+        throw std::runtime_error("A voice pool needs at least one voice");
+    }
+    voices.resize(voice_count);
+    active_voices.reserve(voice_count);
+    free_voices.reserve(voice_count);
+    for (uint32_t i = 0; i < voice_count; i++)
+    {
+        voice_state_t& state = voices[i];
+        state.voice = factory(sample_rate);
+        if (!state.voice.source)
+        {
+            throw std::runtime_error("Voice factory returned an empty voice");
+        }
+        state.duration_samples = (state.voice.duration > 0.0) ? static_cast<uint64_t>(state.voice.duration * sample_rate) : std::numeric_limits<uint64_t>::max();
+        // hand voices out from the front of the pool first
+        free_voices.push_back(voice_count - 1 - i);
+    }
+    scratch.resize(std::max<uint32_t>(max_block_frames, 1));
+    // one full block through every voice grows the scratch buffers inside the nodes now, not on the first note
+    for (voice_state_t& state : voices)
+    {
+        state.voice.source->SampleBlock(scratch);
+        state.voice.source->Reset();
+    }
+}
+
+uint32_t Neato::VoicePool::AcquireVoice()
+{
+    if (!free_voices.empty())
+    {
+        const uint32_t voice = free_voices.back();
+        free_voices.pop_back();
+        active_voices.push_back(voice);
+        return voice;
+    }
+    if (steal_policy == VoiceStealPolicy::none || active_voices.empty())
+    {
+        return static_cast<uint32_t>(voices.size());
+    }
+    // the pool is small, a scan for the oldest start is cheaper than keeping the active list ordered
+    std::size_t oldest = 0;
+    for (std::size_t i = 1; i < active_voices.size(); i++)
+    {
+        if (voices[active_voices[i]].start_serial < voices[active_voices[oldest]].start_serial)
+        {
+            oldest = i;
+        }
+    }
+    stolen_count++;
+    return active_voices[oldest];
+}
+
+bool Neato::VoicePool::NoteOn(uint32_t note_id, double frequency, double gain)
+{
+    const uint32_t voice = AcquireVoice();
+    if (voice >= voices.size())
+    {
+        dropped_count++;
+        return false;
+    }
+    voice_state_t& state = voices[voice];
+    state.voice.source->Reset();
+    if (state.voice.tune)
+    {
+        state.voice.tune(frequency);
+    }
+    state.remaining_samples = state.duration_samples;
+    state.start_serial = next_serial++;
+    state.note_id = note_id;
+    state.gain = gain;
+    state.released = false;
+    return true;
+}
+
+void Neato::VoicePool::NoteOff(uint32_t note_id)
+{
+    std::size_t i = 0;
+    while (i < active_voices.size())
+    {
+        const voice_state_t& state = voices[active_voices[i]];
+        // the swapped in voice lands on i, so look at i again
+        if (state.note_id != note_id || state.released || !ReleaseVoice(i))
+        {
+            i++;
+        }
+    }
+}
+
+void Neato::VoicePool::AllNotesOff()
+{
+    std::size_t i = 0;
+    while (i < active_voices.size())
+    {
+        if (voices[active_voices[i]].released || !ReleaseVoice(i))
+        {
+            i++;
+        }
+    }
+}
+
+bool Neato::VoicePool::ReleaseVoice(std::size_t active_index)
+{
+    voice_state_t& state = voices[active_voices[active_index]];
+    if (!state.voice.release)
+    {
+        ReleaseActive(active_index);
+        return true;
+    }
+    state.voice.release();
+    state.released = true;
+    return false;
+}
+
+void Neato::VoicePool::ReleaseActive(std::size_t active_index)
+{
+    free_voices.push_back(active_voices[active_index]);
+    active_voices[active_index] = active_voices.back();
+    active_voices.pop_back();
+}
+
+Neato::sample_t Neato::VoicePool::Sample()
+{
+    sample_t value = 0;
+    SampleBlock(std::span<sample_t>(&value, 1));
+    return value;
+}
+
+void Neato::VoicePool::SampleBlock(std::span<sample_t> block)
+{
+    std::fill(block.begin(), block.end(), 0.0);
+    std::size_t i = 0;
+    while (i < active_voices.size())
+    {
+        voice_state_t& state = voices[active_voices[i]];
+        const std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(block.size(), state.remaining_samples));
+        std::size_t written = 0;
+        while (written < count)
+        {
+            std::span<sample_t> samples = ScratchBlock(scratch, std::min(count - written, scratch.size()));
+            state.voice.source->SampleBlock(samples);
+            for (std::size_t frame = 0; frame < samples.size(); frame++)
+            {
+                block[written + frame] += state.gain * samples[frame];
+            }
+            written += samples.size();
+        }
+        state.remaining_samples -= count;
+        if (state.remaining_samples == 0 || (state.voice.finished && state.voice.finished()))
+        {
+            ReleaseActive(i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void Neato::VoicePool::ForEachChild(const child_visitor_t& visitor)
+{
+    for (voice_state_t& state : voices)
+    {
+        visitor(state.voice.source);
+    }
+}
+
+void Neato::VoicePool::Reset()
+{
+    while (!active_voices.empty())
+    {
+        ReleaseActive(active_voices.size() - 1);
+    }
+    for (voice_state_t& state : voices)
+    {
+        state.voice.source->Reset();
+    }
+}
+
+void Neato::GateWithEnvelope(pooled_voice_t& voice, std::shared_ptr<IGatedEnvelope> envelope)
+{
+    voice.release = [envelope]() { envelope->Release(); };
+    voice.finished = [envelope]() { return envelope->Finished(); };
+}
+
+std::shared_ptr<Neato::VoicePool> Neato::CreateVoicePool(const voice_factory_t& factory, uint32_t voice_count, double sample_rate, VoiceStealPolicy steal_policy)
+{
+    return std::make_shared<VoicePool>(factory, voice_count, sample_rate, steal_policy);
+}
@@ -0,0 +1,89 @@
+//
+//  voice_pool.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include "base_waveforms.hpp"
+#include "envelope.hpp"
+
+namespace Neato
+{
+    // one playable copy of an instrument. tune is optional and gets the note frequency right after the
+    // voice is reset, for instruments that can be retuned (MutableSine, OscillatorBank). duration is
+    // in seconds, the voice goes back to the pool on its own when it runs out, 0 means no limit.
+    // release is called on NoteOff and the voice keeps playing, a voice without one stops dead instead.
+    // finished is checked after every block the voice plays, and it goes back once that returns true.
+    // see GateWithEnvelope
+    struct pooled_voice_t
+    {
+        std::shared_ptr<ISampleSource> source;
+        std::function<void(double frequency)> tune;
+        double duration = 0.0;
+        std::function<void()> release;
+        std::function<bool()> finished;
+    };
+    using voice_factory_t = std::function<pooled_voice_t(double sample_rate)>;
+
+    // NoteOff starts the envelope's release and the voice goes back to the pool once it has run out
+    void GateWithEnvelope(pooled_voice_t& voice, std::shared_ptr<IGatedEnvelope> envelope);
+
+    enum class VoiceStealPolicy
+    {
+        none,       // drop the new note when every voice is busy
+        oldest      // cut the voice that started first and reuse it
+    };
+
+    // K voices of one instrument built up front. NoteOn resets a free voice and hands it out. It goes back
+    // when it finishes (after its release, for a gated one), at NoteOff if it has no release, or at the end
+    // of its duration. Nothing on the note path allocates, so notes can be
+    // triggered from the render thread without the allocator getting involved.
+    class VoicePool : public ISampleSource
+    {
+    public:
+        VoicePool(const voice_factory_t& factory, uint32_t voice_count, double sample_rate_in, VoiceStealPolicy steal_policy_in, uint32_t max_block_frames = 4096);
+        // returns false if the note was dropped
+        bool NoteOn(uint32_t note_id, double frequency, double gain);
+        void NoteOff(uint32_t note_id);
+        // releases every voice, Reset() is the one that stops them dead
+        void AllNotesOff();
+        uint32_t VoiceCount() const { return static_cast<uint32_t>(voices.size()); }
+        uint32_t ActiveVoiceCount() const { return static_cast<uint32_t>(active_voices.size()); }
+        uint64_t StolenCount() const { return stolen_count; }
+        uint64_t DroppedCount() const { return dropped_count; }
+        virtual sample_t Sample();
+        virtual void SampleBlock(std::span<sample_t> block);
+        virtual void ForEachChild(const child_visitor_t& visitor);
+        virtual void Reset();
+    private:
+        struct voice_state_t
+        {
+            pooled_voice_t voice;
+            uint64_t duration_samples = 0;
+            uint64_t remaining_samples = 0;
+            uint64_t start_serial = 0;
+            uint32_t note_id = 0;
+            sample_t gain = 0;
+            // NoteOff has been and gone, the voice is playing out its release
+            bool released = false;
+        };
+        uint32_t AcquireVoice();
+        // returns true if the voice stopped on the spot and came off the active list
+        bool ReleaseVoice(std::size_t active_index);
+        // swaps the voice at active_voices[active_index] with the last one and pops it
+        void ReleaseActive(std::size_t active_index);
+
+        std::vector<voice_state_t> voices;
+        std::vector<uint32_t> active_voices;
+        std::vector<uint32_t> free_voices;
+        std::vector<sample_t> scratch;
+        const double sample_rate;
+        const VoiceStealPolicy steal_policy;
+        uint64_t next_serial;
+        uint64_t stolen_count;
+        uint64_t dropped_count;
+    };
+
+    std::shared_ptr<VoicePool> CreateVoicePool(const voice_factory_t& factory, uint32_t voice_count, double sample_rate, VoiceStealPolicy steal_policy);
+};
@@ -0,0 +1,326 @@
+//
+//  wav_file.cpp
+//  SigGen
+//
+
+#include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include "wav_file.h"
+
+namespace
+{
+    constexpr uint16_t wave_format_pcm = 1;
+    constexpr uint16_t wave_format_ieee_float = 3;
+    constexpr std::size_t header_bytes = 44;
+
+    constexpr uint16_t wave_format_extensible = 0xFFFE;
+
+    void PutLittleEndian(uint8_t*& out, uint64_t value, std::size_t byte_count)
+    {
+        for (std::size_t i = 0; i < byte_count; i++)
+        {
+            *out++ = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    uint64_t GetLittleEndian(const uint8_t* in, std::size_t byte_count)
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < byte_count; i++)
+        {
+            value |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        return value;
+    }
+}
+
+Neato::audio_stream_description_t Neato::ValidateWavStreamDescription(const audio_stream_description_t& requested)
+{
+    audio_stream_description_t validated = requested;
+    switch (requested.format_id)
+    {
+        case format_id_pcm:
+            // 16 bit unless 24 was asked for
+            validated.bits_per_channel = (requested.bits_per_channel == 24) ? 24 : 16;
+            validated.flags = format_flag_signed_int | format_flag_packed;
+            break;
+        case format_id_float_32:
+            validated.bits_per_channel = 32;
+            validated.flags = format_flag_packed;
+            break;
+        case format_id_float_64:
+            validated.bits_per_channel = 64;
+            validated.flags = format_flag_packed;
+            break;
+        default:
+            throw std::runtime_error("Unsupported sample format for a WAV file");
+    }
+    if (requested.channels_per_frame == 0 || requested.sample_rate <= 0.0)
+    {
+        throw std::runtime_error("WAV file needs at least one channel and a sample rate");
+    }
+    validated.bytes_per_frame = validated.channels_per_frame * (validated.bits_per_channel / 8);
+    if (validated.frames_per_packet == 0)
+    {
+        validated.frames_per_packet = 1024;
+    }
+    validated.bytes_per_packet = validated.bytes_per_frame * validated.frames_per_packet;
+    return validated;
+}
+
+Neato::wav_contents_t Neato::ReadWavFile(const utf8_string& file_path)
+{
+    std::FILE* file = nullptr;
+#if defined(_WIN32) || defined(_WIN64)
+    if (0 != fopen_s(&file, file_path.c_str(), "rb"))
+    {
+        file = nullptr;
+    }
+#else
+    file = std::fopen(file_path.c_str(), "rb");
+#endif //_WIN32 || _WIN64
+    if (nullptr == file)
+    {
+        throw std::runtime_error("Unable to open WAV file for reading: " + file_path);
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[64 * 1024];
+    std::size_t read_count = 0;
+    while ((read_count = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        bytes.insert(bytes.end(), chunk, chunk + read_count);
+    }
+    std::fclose(file);
+
+    if (bytes.size() < 12 || 0 != std::memcmp(bytes.data(), "RIFF", 4) || 0 != std::memcmp(bytes.data() + 8, "WAVE", 4))
+    {
+        throw std::runtime_error("Not a WAV file: " + file_path);
+    }
+
+    wav_contents_t contents;
+    uint16_t format_tag = 0;
+    const uint8_t* data = nullptr;
+    std::size_t data_bytes = 0;
+    std::size_t position = 12;
+    while (position + 8 <= bytes.size())
+    {
+        const uint8_t* chunk_header = bytes.data() + position;
+        // a writer that died before Close() leaves the sizes at 0, so trust the file length over the header
+        const std::size_t chunk_bytes = std::min<std::size_t>(GetLittleEndian(chunk_header + 4, 4), bytes.size() - position - 8);
+        const uint8_t* body = chunk_header + 8;
+        if (0 == std::memcmp(chunk_header, "fmt ", 4) && chunk_bytes >= 16)
+        {
+            format_tag = static_cast<uint16_t>(GetLittleEndian(body, 2));
+            contents.stream_desc.channels_per_frame = static_cast<uint32_t>(GetLittleEndian(body + 2, 2));
+            contents.stream_desc.sample_rate = static_cast<double>(GetLittleEndian(body + 4, 4));
+            contents.stream_desc.bits_per_channel = static_cast<uint32_t>(GetLittleEndian(body + 14, 2));
+            if (format_tag == wave_format_extensible && chunk_bytes >= 26)
+            {
+                // the real format is the first two bytes of the sub format GUID
+                format_tag = static_cast<uint16_t>(GetLittleEndian(body + 24, 2));
+            }
+        }
+        else if (0 == std::memcmp(chunk_header, "data", 4))
+        {
+            data = body;
+            data_bytes = (chunk_bytes == 0) ? bytes.size() - position - 8 : chunk_bytes;
+        }
+        // chunks are padded to an even length
+        position += 8 + chunk_bytes + (chunk_bytes & 1);
+    }
+
+    const uint32_t bits = contents.stream_desc.bits_per_channel;
+    if (format_tag == wave_format_pcm && (bits == 16 || bits == 24))
+    {
+        contents.stream_desc.format_id = format_id_pcm;
+    }
+    else if (format_tag == wave_format_ieee_float && bits == 32)
+    {
+        contents.stream_desc.format_id = format_id_float_32;
+    }
+    else if (format_tag == wave_format_ieee_float && bits == 64)
+    {
+        contents.stream_desc.format_id = format_id_float_64;
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported WAV sample format in " + file_path);
+    }
+    if (nullptr == data)
+    {
+        throw std::runtime_error("WAV file has no data chunk: " + file_path);
+    }
+    contents.stream_desc = ValidateWavStreamDescription(contents.stream_desc);
+
+    const std::size_t sample_count = data_bytes / (bits / 8);
+    contents.samples.resize(sample_count);
+    for (std::size_t i = 0; i < sample_count; i++)
+    {
+        const uint8_t* in = data + i * (bits / 8);
+        if (bits == 16)
+        {
+            contents.samples[i] = static_cast<int16_t>(GetLittleEndian(in, 2)) / 32768.0;
+        }
+        else if (bits == 24)
+        {
+            // shift the sign bit up to the top and back down again
+            contents.samples[i] = (static_cast<int32_t>(GetLittleEndian(in, 3) << 8) >> 8) / 8388608.0;
+        }
+        else if (bits == 32)
+        {
+            float value;
+            std::memcpy(&value, in, sizeof(value));
+            contents.samples[i] = value;
+        }
+        else
+        {
+            double value;
+            std::memcpy(&value, in, sizeof(value));
+            contents.samples[i] = value;
+        }
+    }
+    return contents;
+}
+
+Neato::WavFileWriter::WavFileWriter(const utf8_string& file_path, const audio_stream_description_t& stream_desc_in, std::size_t buffer_bytes)
+    : file(nullptr)
+    , stream_desc(ValidateWavStreamDescription(stream_desc_in))
+    , buffer(buffer_bytes)
+    , pending_bytes(0)
+    , data_bytes_written(0)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    if (0 != fopen_s(&file, file_path.c_str(), "wb"))
+    {
+        file = nullptr;
+    }
+#else
+    file = std::fopen(file_path.c_str(), "wb");
+#endif //_WIN32 || _WIN64
+    if (nullptr == file)
+    {
+        throw std::runtime_error("Unable to open WAV file for writing: " + file_path);
+    }
+    // we do our own buffering, stdio would just be another copy
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    try
+    {
+        WriteHeader(0);
+    }
+    catch (const std::runtime_error&)
+    {
+        std::fclose(file);
+        throw;
+    }
+}
+
+Neato::WavFileWriter::~WavFileWriter()
+{
+    try
+    {
+        Close();
+    }
+    catch (const std::runtime_error&)
+    {
+        // nowhere to report it from a destructor, call Close() first if you care
+    }
+}
+
+uint8_t* Neato::WavFileWriter::Reserve(std::size_t byte_count)
+{
+    if (pending_bytes + byte_count > buffer.size())
+    {
+        Flush();
+        if (byte_count > buffer.size())
+        {
+            buffer.resize(byte_count);
+        }
+    }
+    return buffer.data() + pending_bytes;
+}
+
+void Neato::WavFileWriter::Commit(std::size_t byte_count)
+{
+    pending_bytes += byte_count;
+}
+
+void Neato::WavFileWriter::Close()
+{
+    if (nullptr == file)
+    {
+        return;
+    }
+    // the file gets closed whatever fails, so a second Close() from the destructor has nothing left to do
+    std::FILE* closing = file;
+    try
+    {
+        Flush();
+        // chunks are padded to an even length, the pad isn't counted in the data chunk's size
+        if (data_bytes_written & 1)
+        {
+            const uint8_t pad = 0;
+            if (std::fwrite(&pad, 1, 1, file) != 1)
+            {
+                throw std::runtime_error("Failed writing WAV data");
+            }
+        }
+        // RIFF sizes are 32 bit, anything past that is still in the file but the header can't say so
+        WriteHeader(std::min<uint64_t>(data_bytes_written, std::numeric_limits<uint32_t>::max() - header_bytes));
+    }
+    catch (const std::runtime_error&)
+    {
+        file = nullptr;
+        std::fclose(closing);
+        throw;
+    }
+    file = nullptr;
+    if (0 != std::fclose(closing))
+    {
+        throw std::runtime_error("Failed closing WAV file");
+    }
+}
+
+void Neato::WavFileWriter::Flush()
+{
+    if (pending_bytes == 0)
+    {
+        return;
+    }
+    if (std::fwrite(buffer.data(), 1, pending_bytes, file) != pending_bytes)
+    {
+        throw std::runtime_error("Failed writing WAV data");
+    }
+    data_bytes_written += pending_bytes;
+    pending_bytes = 0;
+}
+
+void Neato::WavFileWriter::WriteHeader(uint64_t data_byte_count)
+{
+    uint8_t header[header_bytes];
+    uint8_t* out = header;
+    const uint16_t format_tag = (stream_desc.format_id == format_id_pcm) ? wave_format_pcm : wave_format_ieee_float;
+    const uint32_t sample_rate = static_cast<uint32_t>(stream_desc.sample_rate);
+
+    std::memcpy(out, "RIFF", 4); out += 4;
+    PutLittleEndian(out, header_bytes - 8 + data_byte_count + (data_byte_count & 1), 4);
+    std::memcpy(out, "WAVE", 4); out += 4;
+    std::memcpy(out, "fmt ", 4); out += 4;
+    PutLittleEndian(out, 16, 4);
+    PutLittleEndian(out, format_tag, 2);
+    PutLittleEndian(out, stream_desc.channels_per_frame, 2);
+    PutLittleEndian(out, sample_rate, 4);
+    PutLittleEndian(out, static_cast<uint64_t>(sample_rate) * stream_desc.bytes_per_frame, 4);
+    PutLittleEndian(out, stream_desc.bytes_per_frame, 2);
+    PutLittleEndian(out, stream_desc.bits_per_channel, 2);
+    std::memcpy(out, "data", 4); out += 4;
+    PutLittleEndian(out, data_byte_count, 4);
+
+    if (0 != std::fseek(file, 0, SEEK_SET)
+        || std::fwrite(header, 1, header_bytes, file) != header_bytes
+        || 0 != std::fseek(file, 0, SEEK_END))
+    {
+        throw std::runtime_error("Failed writing WAV header");
+    }
+}
@@ -0,0 +1,57 @@
+//
+//  wav_file.h
+//  SigGen
+//
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include "RenderGraph.h"
+
+namespace Neato
+{
+    // Streams frames into a RIFF/WAVE file. Frames are rendered straight into a large
+    // internal buffer (Reserve/Commit) that only hits the file system when it fills up,
+    // and the header sizes get patched in on Close().
+    class WavFileWriter
+    {
+    public:
+        static constexpr std::size_t default_buffer_bytes = 4 * 1024 * 1024;
+
+        WavFileWriter(const utf8_string& file_path, const audio_stream_description_t& stream_desc, std::size_t buffer_bytes = default_buffer_bytes);
+        WavFileWriter(const WavFileWriter&) = delete;
+        WavFileWriter& operator=(const WavFileWriter&) = delete;
+        ~WavFileWriter();
+
+        // returns space for at least byte_count contiguous bytes, flushing what's pending if needed
+        uint8_t* Reserve(std::size_t byte_count);
+        void Commit(std::size_t byte_count);
+        void Close();
+        uint64_t BytesWritten() const { return data_bytes_written + pending_bytes; }
+
+    private:
+        void Flush();
+        void WriteHeader(uint64_t data_byte_count);
+
+        std::FILE* file;
+        audio_stream_description_t stream_desc;
+        std::vector<uint8_t> buffer;
+        std::size_t pending_bytes;
+        uint64_t data_bytes_written;
+    };
+
+    // fills in bytes_per_frame/bytes_per_packet from the format and channel count, and throws for anything a WAV file can't hold
+    audio_stream_description_t ValidateWavStreamDescription(const audio_stream_description_t& requested);
+
+    // a whole WAV file in memory, interleaved and widened to double whatever the file held
+    struct wav_contents_t
+    {
+        audio_stream_description_t stream_desc;
+        std::vector<double> samples;
+    };
+
+    // reads back the 16/24 bit PCM and 32/64 bit float files WavFileWriter makes, throws for anything else
+    wav_contents_t ReadWavFile(const utf8_string& file_path);
+};
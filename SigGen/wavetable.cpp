@@ -0,0 +1,216 @@
+//
+//  wavetable.cpp
+//  SigGen
+//
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <numbers>
+#include "wavetable.hpp"
+#include "simd.hpp"
+
+namespace
+{
+    // the padding LevelForFrequency() callers rely on: one wrapped sample in front, two behind
+    std::vector<Neato::sample_t> PadLevel(const std::vector<double>& cycle)
+    {
+        std::vector<Neato::sample_t> level;
+        level.reserve(cycle.size() + 3);
+        level.push_back(static_cast<Neato::sample_t>(cycle.back()));
+        level.insert(level.end(), cycle.begin(), cycle.end());
+        level.push_back(static_cast<Neato::sample_t>(cycle[0]));
+        level.push_back(static_cast<Neato::sample_t>(cycle[1]));
+        return level;
+    }
+
+    using read_block_fn = void (*)(const Neato::sample_t* table, uint32_t phase, uint32_t increment, Neato::sample_t* out, std::size_t frame_count);
+
+    // every sample's phase comes straight from the start phase, so there is no chain from one sample to the next
+    template <Neato::Interpolation interpolation>
+    void ReadBlockScalar(const Neato::sample_t* table, uint32_t phase, uint32_t increment, Neato::sample_t* out, std::size_t frame_count)
+    {
+        for (std::size_t i = 0; i < frame_count; i++)
+        {
+            out[i] = Neato::ReadWavetable(table, phase + static_cast<uint32_t>(i) * increment, interpolation);
+        }
+    }
+
+#if NEATO_SIMD_X86
+    // the masked forms with a zeroed source, the plain ones leave gcc warning that the source they don't
+    // need may be used uninitialized
+    NEATO_TARGET_AVX2 inline __m256d GatherAvx2(const double* table, __m128i index)
+    {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+    NEATO_TARGET_AVX2 inline __m256 GatherAvx2(const float* table, __m256i index)
+    {
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), table, index, _mm256_castsi256_ps(_mm256_set1_epi32(-1)), 4);
+    }
+    NEATO_TARGET_AVX2 inline __m256d FractionAvx2(__m128i fraction_bits) { return _mm256_cvtepi32_pd(fraction_bits); }
+    NEATO_TARGET_AVX2 inline __m256 FractionAvx2(__m256i fraction_bits) { return _mm256_cvtepi32_ps(fraction_bits); }
+
+    // the same steps as ReadWavetableLinear/Cubic on every lane. four doubles ride on four int32 phases
+    // in an __m128i, eight floats on eight in an __m256i
+    template <Neato::Interpolation interpolation, typename T, typename PhaseVector>
+    NEATO_TARGET_AVX2 void ReadLanesAvx2(const T* table, PhaseVector lane_phase, T* out)
+    {
+        using namespace Neato::simd;
+        PhaseVector index;
+        PhaseVector fraction_bits;
+        if constexpr (sizeof(PhaseVector) == sizeof(__m128i))
+        {
+            index = _mm_srli_epi32(lane_phase, Neato::Wavetable::fraction_bits);
+            fraction_bits = _mm_and_si128(lane_phase, _mm_set1_epi32((1 << Neato::Wavetable::fraction_bits) - 1));
+        }
+        else
+        {
+            index = _mm256_srli_epi32(lane_phase, Neato::Wavetable::fraction_bits);
+            fraction_bits = _mm256_and_si256(lane_phase, _mm256_set1_epi32((1 << Neato::Wavetable::fraction_bits) - 1));
+        }
+        const avx_t<T> fraction = Mul(FractionAvx2(fraction_bits), BroadcastAvx<T>(1.0 / (1u << Neato::Wavetable::fraction_bits)));
+        const avx_t<T> y0 = GatherAvx2(table, index);
+        const avx_t<T> y1 = GatherAvx2(table + 1, index);
+        avx_t<T> value;
+        if constexpr (interpolation == Neato::Interpolation::cubic)
+        {
+            const avx_t<T> before = GatherAvx2(table - 1, index);
+            const avx_t<T> after = GatherAvx2(table + 2, index);
+            const avx_t<T> half = BroadcastAvx<T>(0.5);
+            const avx_t<T> c1 = Mul(half, Sub(y1, before));
+            const avx_t<T> c2 = Sub(Add(Sub(before, Mul(BroadcastAvx<T>(2.5), y0)), Mul(BroadcastAvx<T>(2.0), y1)), Mul(half, after));
+            const avx_t<T> c3 = Add(Mul(half, Sub(after, before)), Mul(BroadcastAvx<T>(1.5), Sub(y0, y1)));
+            value = Add(Mul(Add(Mul(Add(Mul(c3, fraction), c2), fraction), c1), fraction), y0);
+        }
+        else
+        {
+            value = Add(y0, Mul(fraction, Sub(y1, y0)));
+        }
+        Store(out, value);
+    }
+
+    template <Neato::Interpolation interpolation>
+    NEATO_TARGET_AVX2 void ReadBlockAvx2(const double* table, uint32_t phase, uint32_t increment, double* out, std::size_t frame_count)
+    {
+        const std::size_t vector_count = frame_count & ~std::size_t(3);
+        __m128i lane_phase = _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(phase)), _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int32_t>(increment))));
+        const __m128i step = _mm_set1_epi32(static_cast<int32_t>(4u * increment));
+        for (std::size_t i = 0; i < vector_count; i += 4)
+        {
+            ReadLanesAvx2<interpolation>(table, lane_phase, out + i);
+            lane_phase = _mm_add_epi32(lane_phase, step);
+        }
+        _mm256_zeroupper();
+        ReadBlockScalar<interpolation>(table, phase + static_cast<uint32_t>(vector_count) * increment, increment, out + vector_count, frame_count - vector_count);
+    }
+
+    template <Neato::Interpolation interpolation>
+    NEATO_TARGET_AVX2 void ReadBlockAvx2(const float* table, uint32_t phase, uint32_t increment, float* out, std::size_t frame_count)
+    {
+        const std::size_t vector_count = frame_count & ~std::size_t(7);
+        __m256i lane_phase = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(phase)), _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int32_t>(increment))));
+        const __m256i step = _mm256_set1_epi32(static_cast<int32_t>(8u * increment));
+        for (std::size_t i = 0; i < vector_count; i += 8)
+        {
+            ReadLanesAvx2<interpolation>(table, lane_phase, out + i);
+            lane_phase = _mm256_add_epi32(lane_phase, step);
+        }
+        _mm256_zeroupper();
+        ReadBlockScalar<interpolation>(table, phase + static_cast<uint32_t>(vector_count) * increment, increment, out + vector_count, frame_count - vector_count);
+    }
+#endif //NEATO_SIMD_X86
+
+    read_block_fn SelectReadKernel(Neato::Interpolation interpolation)
+    {
+#if NEATO_SIMD_X86
+        if (Neato::CpuHasAvx2())
+        {
+            // overloaded on the sample type, so the return type picks the one this build uses
+            if (interpolation == Neato::Interpolation::cubic)
+            {
+                return &ReadBlockAvx2<Neato::Interpolation::cubic>;
+            }
+            return &ReadBlockAvx2<Neato::Interpolation::linear>;
+        }
+#endif //NEATO_SIMD_X86
+        return (interpolation == Neato::Interpolation::cubic) ? ReadBlockScalar<Neato::Interpolation::cubic> : ReadBlockScalar<Neato::Interpolation::linear>;
+    }
+}
+
+Neato::Wavetable::Wavetable(WaveShape shape_in)
+    : shape(shape_in)
+{
+    // every partial of every level is a sample of one sine cycle, h * i wraps around the same table
+    std::vector<double> sine(table_size);
+    for (uint32_t i = 0; i < table_size; i++)
+    {
+        sine[i] = std::sin(2.0 * std::numbers::pi * i / table_size);
+    }
+
+    if (shape == WaveShape::sine)
+    {
+        levels.push_back(PadLevel(sine));
+        return;
+    }
+
+    // a saw is -2/pi * sum(sin(2 pi h x) / h), the falling one is the same thing negated
+    const double sign = (shape == WaveShape::saw_up) ? -1.0 : 1.0;
+    for (uint32_t harmonics = max_harmonics; harmonics >= 1; harmonics >>= 1)
+    {
+        std::vector<double> level(table_size, 0.0);
+        for (uint32_t i = 0; i < table_size; i++)
+        {
+            double value = 0.0;
+            for (uint32_t h = 1; h <= harmonics; h++)
+            {
+                value += sine[(static_cast<uint64_t>(h) * i) % table_size] / h;
+            }
+            level[i] = sign * (2.0 / std::numbers::pi) * value;
+        }
+        levels.push_back(PadLevel(level));
+    }
+}
+
+const Neato::sample_t* Neato::Wavetable::LevelForFrequency(double frequency, double sample_rate) const
+{
+    const double allowed_harmonics = (0.5 * sample_rate) / std::abs(frequency);
+    uint32_t level = 0;
+    uint32_t harmonics = max_harmonics;
+    while (level + 1 < levels.size() && harmonics > allowed_harmonics)
+    {
+        level++;
+        harmonics >>= 1;
+    }
+    return Level(level);
+}
+
+std::shared_ptr<const Neato::Wavetable> Neato::GetWavetable(WaveShape shape)
+{
+    static std::mutex cache_lock;
+    static std::map<WaveShape, std::weak_ptr<const Wavetable>> cache;
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+    std::shared_ptr<const Wavetable> table = cache[shape].lock();
+    if (!table)
+    {
+        table = std::make_shared<const Wavetable>(shape);
+        cache[shape] = table;
+    }
+    return table;
+}
+
+uint32_t Neato::WavetablePhaseIncrement(double frequency, double sample_rate)
+{
+    const double cycles = frequency / sample_rate;
+    // only the fraction of a cycle matters, the rest wraps away
+    return static_cast<uint32_t>(static_cast<int64_t>(std::llround((cycles - std::floor(cycles)) * 4294967296.0)));
+}
+
+void Neato::ReadWavetableBlock(const sample_t* table, uint32_t& phase, uint32_t increment, Interpolation interpolation, std::span<sample_t> block)
+{
+    static const read_block_fn read_linear = SelectReadKernel(Interpolation::linear);
+    static const read_block_fn read_cubic = SelectReadKernel(Interpolation::cubic);
+    const read_block_fn read_block = (interpolation == Interpolation::cubic) ? read_cubic : read_linear;
+    read_block(table, phase, increment, block.data(), block.size());
+    phase += static_cast<uint32_t>(block.size()) * increment;
+}
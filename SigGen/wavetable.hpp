@@ -0,0 +1,109 @@
+//
+//  wavetable.hpp
+//  SigGen
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "sample_type.hpp"
+
+namespace Neato
+{
+    enum class WaveShape
+    {
+        sine,
+        saw_up,     // -1 to 1 over the cycle
+        saw_down    // 1 to -1 over the cycle
+    };
+
+    enum class Interpolation
+    {
+        linear,
+        cubic       // 4 point Catmull-Rom, two more taps for a much cleaner sine
+    };
+
+    // One immutable single-cycle table per shape, shared by every oscillator that plays it. The
+    // table is stored at several mip levels. Level k only holds the harmonics up to
+    // max_harmonics >> k, and LevelForFrequency() picks the richest level that stays under Nyquist
+    // at the playback frequency, so a high saw doesn't alias. A sine has one level. Each level is
+    // padded with one wrapped sample in front and two behind, so cubic reads never have to wrap.
+    //
+    // Oscillators play it with a 32 bit fixed point phase that covers exactly one cycle. The top
+    // index_bits pick the table sample and the rest is the fraction between samples. Wraparound is
+    // plain unsigned overflow, and pitch is exact to sample_rate / 2^32.
+    class Wavetable
+    {
+    public:
+        static constexpr uint32_t index_bits = 11;
+        static constexpr uint32_t table_size = 1u << index_bits;
+        static constexpr uint32_t fraction_bits = 32 - index_bits;
+        static constexpr uint32_t max_harmonics = table_size / 2;
+
+        explicit Wavetable(WaveShape shape_in);
+        WaveShape Shape() const { return shape; }
+        uint32_t LevelCount() const { return static_cast<uint32_t>(levels.size()); }
+        // points at sample 0, [-1] and [table_size + 1] are valid
+        const sample_t* Level(uint32_t level) const { return levels[level].data() + 1; }
+        const sample_t* LevelForFrequency(double frequency, double sample_rate) const;
+        // which level a pointer handed out by Level() or LevelForFrequency() points into. the pointers only
+        // last as long as the table does, the level number is the same for every table of the shape
+        uint32_t LevelOf(const sample_t* table) const
+        {
+            uint32_t level = 0;
+            while (level < LevelCount() && Level(level) != table)
+            {
+                level++;
+            }
+            return level;
+        }
+    private:
+        WaveShape shape;
+        std::vector<std::vector<sample_t>> levels;
+    };
+
+    // process-wide store. tables are built on first use and freed when the last oscillator holding one goes away.
+    // takes a lock, so call it while building graphs, not while rendering
+    std::shared_ptr<const Wavetable> GetWavetable(WaveShape shape);
+
+    // phase increment per sample for a frequency, anything at or above the sample rate folds back down
+    uint32_t WavetablePhaseIncrement(double frequency, double sample_rate);
+
+    inline sample_t WavetableFraction(uint32_t phase)
+    {
+        constexpr sample_t fraction_scale = sample_t(1.0) / (1u << Wavetable::fraction_bits);
+        return static_cast<sample_t>(static_cast<int32_t>(phase & ((1u << Wavetable::fraction_bits) - 1))) * fraction_scale;
+    }
+
+    inline sample_t ReadWavetableLinear(const sample_t* table, uint32_t phase)
+    {
+        const uint32_t index = phase >> Wavetable::fraction_bits;
+        const sample_t fraction = WavetableFraction(phase);
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+    inline sample_t ReadWavetableCubic(const sample_t* table, uint32_t phase)
+    {
+        const uint32_t index = phase >> Wavetable::fraction_bits;
+        const sample_t fraction = WavetableFraction(phase);
+        const sample_t before = table[static_cast<int32_t>(index) - 1];
+        const sample_t y0 = table[index];
+        const sample_t y1 = table[index + 1];
+        const sample_t after = table[index + 2];
+        const sample_t c1 = sample_t(0.5) * (y1 - before);
+        const sample_t c2 = before - sample_t(2.5) * y0 + sample_t(2.0) * y1 - sample_t(0.5) * after;
+        const sample_t c3 = sample_t(0.5) * (after - before) + sample_t(1.5) * (y0 - y1);
+        return ((c3 * fraction + c2) * fraction + c1) * fraction + y0;
+    }
+
+    inline sample_t ReadWavetable(const sample_t* table, uint32_t phase, Interpolation interpolation)
+    {
+        return (interpolation == Interpolation::cubic) ? ReadWavetableCubic(table, phase) : ReadWavetableLinear(table, phase);
+    }
+
+    // fills the block starting at phase and leaves phase on the sample after it. AVX2 gathers four doubles or eight floats at a time when the CPU has it
+    void ReadWavetableBlock(const sample_t* table, uint32_t& phase, uint32_t increment, Interpolation interpolation, std::span<sample_t> block);
+};